@@ -29,6 +29,20 @@
 
 GLOBAL(void)
 LJPEG_jpeg_CreateCompress (LJPEG_j_compress_ptr cinfo, int version, size_t structsize)
+{
+  LJPEG_jpeg_CreateCompressAlloc(cinfo, (struct LJPEG_jpeg_allocator *) NULL,
+			   version, structsize);
+}
+
+
+/*
+ * As above, but the memory manager gets its chunks from the given allocator.
+ */
+
+GLOBAL(void)
+LJPEG_jpeg_CreateCompressAlloc (LJPEG_j_compress_ptr cinfo,
+			    struct LJPEG_jpeg_allocator * allocator,
+			    int version, size_t structsize)
 {
   int i;
 
@@ -56,7 +70,7 @@ LJPEG_jpeg_CreateCompress (LJPEG_j_compress_ptr cinfo, int version, size_t struc
   cinfo->is_decompressor = FALSE;
 
   /* Initialize a memory manager instance for this object */
-  LJPEG_jinit_memory_mgr((LJPEG_j_common_ptr) cinfo);
+  LJPEG_jinit_memory_mgr((LJPEG_j_common_ptr) cinfo, allocator);
 
   /* Zero out pointers to permanent structures. */
   cinfo->progress = NULL;
@@ -58,6 +58,130 @@ LJPEG_jpeg_start_compress (LJPEG_j_compress_ptr cinfo, boolean write_all_tables)
 }
 
 
+/*
+ * Estimate the resources LJPEG_jpeg_start_compress will need.
+ * Call this with all parameters set up as for LJPEG_jpeg_start_compress.
+ *
+ * The estimate is obtained by running the same module selection and
+ * first-pass setup on a copy of the compression object, with the memory
+ * manager measuring instead of realizing the virtual arrays.  The copy
+ * writes its datastream header into a scratch buffer, and its memory is
+ * released again; the object itself is not changed.
+ */
+
+typedef struct {
+  struct LJPEG_jpeg_compress_struct pub; /* the copy the modules work on */
+  LJPEG_j_compress_ptr owner;		/* the application's object */
+  LJPEG_JMETHOD(noreturn_t, error_exit, (LJPEG_j_common_ptr cinfo));
+  struct LJPEG_jpeg_progress_mgr progress;
+  struct LJPEG_jpeg_destination_mgr dest;
+  JOCTET buffer[64];			/* receives and discards the header */
+  LJPEG_jpeg_component_info comp_info[MAX_COMPONENTS];
+} LJPEG_my_estimate_struct;
+
+typedef LJPEG_my_estimate_struct * LJPEG_my_estimate_ptr;
+
+
+LJPEG_METHODDEF(void)
+LJPEG_estimate_progress (LJPEG_j_common_ptr cinfo)
+{
+  /* no work */
+}
+
+
+LJPEG_METHODDEF(void)
+LJPEG_init_estimate_destination (LJPEG_j_compress_ptr cinfo)
+{
+  LJPEG_my_estimate_ptr est = (LJPEG_my_estimate_ptr) cinfo;
+
+  est->dest.next_output_byte = est->buffer;
+  est->dest.free_in_buffer = SIZEOF(est->buffer);
+}
+
+
+LJPEG_METHODDEF(boolean)
+LJPEG_empty_estimate_output_buffer (LJPEG_j_compress_ptr cinfo)
+{
+  LJPEG_init_estimate_destination(cinfo);
+  return TRUE;
+}
+
+
+LJPEG_METHODDEF(void)
+LJPEG_term_estimate_destination (LJPEG_j_compress_ptr cinfo)
+{
+  /* no work */
+}
+
+
+LJPEG_METHODDEF(noreturn_t)
+LJPEG_estimate_error_exit (LJPEG_j_common_ptr cinfo)
+/* Give up the estimate, then report the error on the application's object */
+{
+  LJPEG_my_estimate_ptr est = (LJPEG_my_estimate_ptr) cinfo;
+
+  cinfo->err->LJPEG_error_exit = est->error_exit;
+  (*cinfo->mem->LJPEG_end_estimate) (cinfo, (LJPEG_jpeg_estimate *) NULL);
+  (*cinfo->err->LJPEG_error_exit) ((LJPEG_j_common_ptr) est->owner);
+}
+
+
+GLOBAL(void)
+LJPEG_jpeg_estimate_compress (LJPEG_j_compress_ptr cinfo,
+			      LJPEG_jpeg_estimate * estimate)
+{
+  LJPEG_my_estimate_struct est;
+  LJPEG_j_compress_ptr copy = & est.pub;
+  LJPEG_jpeg_scan_info * scan_info;
+
+  if (cinfo->global_state != CSTATE_START)
+    ERREXIT1(cinfo, JERR_BAD_STATE, cinfo->global_state);
+  if (cinfo->num_components > MAX_COMPONENTS)
+    ERREXIT2(cinfo, JERR_COMPONENT_COUNT, cinfo->num_components,
+	     MAX_COMPONENTS);
+
+  MEMCOPY(copy, cinfo, SIZEOF(struct LJPEG_jpeg_compress_struct));
+  est.owner = cinfo;
+  /* Work on private copies of the component info */
+  if (cinfo->num_components > 0)
+    MEMCOPY(est.comp_info, cinfo->comp_info,
+	    cinfo->num_components * SIZEOF(LJPEG_jpeg_component_info));
+  copy->comp_info = est.comp_info;
+  /* Collect the pass counts without calling the application */
+  MEMZERO(& est.progress, SIZEOF(struct LJPEG_jpeg_progress_mgr));
+  est.progress.LJPEG_progress_monitor = LJPEG_estimate_progress;
+  copy->progress = & est.progress;
+  est.dest.LJPEG_init_destination = LJPEG_init_estimate_destination;
+  est.dest.LJPEG_empty_output_buffer = LJPEG_empty_estimate_output_buffer;
+  est.dest.LJPEG_term_destination = LJPEG_term_estimate_destination;
+  copy->dest = & est.dest;
+
+  est.error_exit = cinfo->err->LJPEG_error_exit;
+  cinfo->err->LJPEG_error_exit = LJPEG_estimate_error_exit;
+  (*cinfo->mem->LJPEG_begin_estimate) ((LJPEG_j_common_ptr) cinfo);
+
+  /* The master may edit the scan script for reduced block sizes */
+  if (cinfo->scan_info != NULL && cinfo->num_scans > 0) {
+    scan_info = (LJPEG_jpeg_scan_info *)
+      (*cinfo->mem->LJPEG_alloc_small) ((LJPEG_j_common_ptr) copy, JPOOL_IMAGE,
+			cinfo->num_scans * SIZEOF(LJPEG_jpeg_scan_info));
+    MEMCOPY(scan_info, cinfo->scan_info,
+	    cinfo->num_scans * SIZEOF(LJPEG_jpeg_scan_info));
+    copy->scan_info = scan_info;
+  }
+
+  /* Same setup as LJPEG_jpeg_start_compress */
+  (*copy->dest->LJPEG_init_destination) (copy);
+  LJPEG_jinit_compress_master(copy);
+  (*copy->master->LJPEG_prepare_for_pass) (copy);
+
+  estimate->num_scans = copy->num_scans;
+  estimate->total_passes = est.progress.total_passes;
+  (*cinfo->mem->LJPEG_end_estimate) ((LJPEG_j_common_ptr) cinfo, estimate);
+  cinfo->err->LJPEG_error_exit = est.error_exit;
+}
+
+
 /*
  * Write some scanlines of data to the JPEG compressor.
  *
@@ -111,6 +235,72 @@ LJPEG_jpeg_write_scanlines (LJPEG_j_compress_ptr cinfo, LJPEG_JSAMPARRAY scanlin
 }
 
 
+/*
+ * Point the row pointers for the current iMCU row into cinfo->raw_planes.
+ * Rows below the bottom of a plane repeat its last row.  Planes the DCT
+ * can't read in place are copied into scratch rows, and the last block
+ * column of unpadded planes into the edge buffer, replicating the
+ * rightmost sample as the downsampler would.
+ */
+
+LOCAL(LJPEG_JSAMPIMAGE)
+LJPEG_set_plane_rows (LJPEG_j_compress_ptr cinfo, LJPEG_JDIMENSION iMCU_row)
+{
+  struct LJPEG_jpeg_comp_master * master = cinfo->master;
+  LJPEG_jpeg_component_info *compptr;
+  LJPEG_jpeg_raw_plane *plane;
+  LJPEG_JSAMPARRAY rows;
+  register LJPEG_JSAMPROW inptr, outptr;
+  register LJPEG_JDIMENSION count;
+  register int step;
+  register LJPEG_JSAMPLE pixval;
+  LJPEG_JDIMENSION row, first_col, width, padded_width;
+  int ci, r, rows_per;
+
+  if (master->plane_rows == NULL)
+    ERREXIT(cinfo, JERR_NO_RAW_PLANES);
+  for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
+       ci++, compptr++) {
+    plane = &cinfo->raw_planes[ci];
+    rows = master->plane_rows[ci];
+    step = plane->sample_step;
+    rows_per = compptr->v_samp_factor * compptr->DCT_v_scaled_size;
+    padded_width = compptr->width_in_blocks *
+		   (LJPEG_JDIMENSION) compptr->DCT_h_scaled_size;
+    row = iMCU_row * (LJPEG_JDIMENSION) rows_per;
+    for (r = 0; r < rows_per; r++, row++) {
+      if (row >= compptr->downsampled_height && r > 0 &&
+	  master->plane_scratch[ci] != NULL) {
+	rows[r] = rows[r-1];
+	continue;
+      }
+      inptr = plane->base + (size_t) (row < compptr->downsampled_height ?
+	      row : compptr->downsampled_height - 1) * plane->row_stride;
+      if (master->plane_scratch[ci] != NULL) {
+	first_col = 0;
+	outptr = rows[r] = master->plane_scratch[ci][r];
+      } else {
+	rows[r] = inptr;
+	if (master->plane_edge[ci] == NULL)
+	  continue;
+	first_col = padded_width - (LJPEG_JDIMENSION) compptr->DCT_h_scaled_size;
+	inptr += first_col;
+	outptr = master->plane_edge[ci][r];
+      }
+      width = compptr->downsampled_width - first_col;
+      for (count = width; count > 0; count--) {
+	*outptr++ = *inptr;
+	inptr += step;
+      }
+      pixval = outptr[-1];
+      for (count = padded_width - first_col - width; count > 0; count--)
+	*outptr++ = pixval;
+    }
+  }
+  return master->plane_rows;
+}
+
+
 /*
  * Alternate entry point to write raw data.
  * Processes exactly one iMCU row per call, unless suspended.
@@ -149,6 +339,11 @@ LJPEG_jpeg_write_raw_data (LJPEG_j_compress_ptr cinfo, LJPEG_JSAMPIMAGE data,
   if (num_lines < lines_per_iMCU_row)
     ERREXIT(cinfo, JERR_BUFFER_SIZE);
 
+  /* Take the row straight from the application's planes if so asked. */
+  if (data == NULL)
+    data = LJPEG_set_plane_rows(cinfo,
+				cinfo->next_scanline / lines_per_iMCU_row);
+
   /* Directly compress the row. */
   if (! (*cinfo->coef->LJPEG_compress_data) (cinfo, data)) {
     /* If compressor did not consume the whole row, suspend processing. */
@@ -47,6 +47,18 @@ typedef struct {
 
 typedef LJPEG_arith_entropy_encoder * LJPEG_arith_entropy_ptr;
 
+/* Working state of the coding registers while encoding an MCU.
+ * It is loaded from the entropy encoder object at the start of each MCU
+ * and saved back at its end, so that the compiler can keep the registers
+ * in machine registers during the innermost coding loop.
+ */
+
+typedef struct {
+  INT32 c;			/* C register */
+  INT32 a;			/* A register */
+  int ct;			/* bit shift counter */
+} LJPEG_arith_working_state;
+
 /* The following two definitions specify the allocation chunk size
  * for the statistics area.
  * According to sections F.1.4.4.1.3 and F.1.4.4.2, we need at least
@@ -125,6 +137,112 @@ LJPEG_emit_byte (int val, LJPEG_j_compress_ptr cinfo)
 }
 
 
+LOCAL(void)
+LJPEG_emit_zeros (LJPEG_arith_entropy_ptr e, LJPEG_j_compress_ptr cinfo)
+/* Write the pending 0x00 output values counted in e->zc.
+ * Runs of zero bytes are frequent in uniform image areas,
+ * so we write them blockwise into the destination buffer.
+ */
+{
+  struct LJPEG_jpeg_destination_mgr * dest = cinfo->dest;
+  size_t count;
+
+  while (e->zc) {
+    count = dest->free_in_buffer;
+    if ((INT32) count > e->zc)
+      count = (size_t) e->zc;
+    MEMZERO(dest->next_output_byte, count);
+    dest->next_output_byte += count;
+    e->zc -= (INT32) count;
+    if ((dest->free_in_buffer -= count) == 0)
+      if (! (*dest->LJPEG_empty_output_buffer) (cinfo))
+	ERREXIT(cinfo, JERR_CANT_SUSPEND);
+  }
+}
+
+
+LOCAL(void)
+LJPEG_emit_stacked (LJPEG_arith_entropy_ptr e, LJPEG_j_compress_ptr cinfo)
+/* Write the stacked 0xFF values counted in e->sc, each with its
+ * stuffed 0x00 byte.  Like the zero runs, they are written blockwise.
+ */
+{
+  struct LJPEG_jpeg_destination_mgr * dest = cinfo->dest;
+  JOCTET * next_output_byte;
+  size_t count;
+
+  while (e->sc) {
+    count = dest->free_in_buffer >> 1;
+    if (count == 0) {
+      /* Buffer has room for a single byte only */
+      LJPEG_emit_byte(0xFF, cinfo);
+      LJPEG_emit_byte(0x00, cinfo);
+      e->sc--;
+      continue;
+    }
+    if ((INT32) count > e->sc)
+      count = (size_t) e->sc;
+    e->sc -= (INT32) count;
+    next_output_byte = dest->next_output_byte;
+    dest->next_output_byte += count << 1;
+    dest->free_in_buffer -= count << 1;
+    do {
+      *next_output_byte++ = 0xFF;
+      *next_output_byte++ = 0x00;
+    } while (--count);
+    if (dest->free_in_buffer == 0)
+      if (! (*dest->LJPEG_empty_output_buffer) (cinfo))
+	ERREXIT(cinfo, JERR_CANT_SUSPEND);
+  }
+}
+
+
+/*
+ * Output the next byte which is ready in the C register
+ * (called by the renormalization in arith_encode).
+ * We handle the carry over stacked 0xFF bytes here,
+ * as well as the pending zero bytes, which are held back
+ * so that final zero bytes can be discarded.
+ */
+
+LOCAL(void)
+LJPEG_emit_ready_byte (LJPEG_j_compress_ptr cinfo, INT32 temp)
+{
+  register LJPEG_arith_entropy_ptr e = (LJPEG_arith_entropy_ptr) cinfo->entropy;
+
+  if (temp > 0xFF) {
+    /* Handle overflow over all stacked 0xFF bytes */
+    if (e->buffer >= 0) {
+      LJPEG_emit_zeros(e, cinfo);
+      LJPEG_emit_byte(e->buffer + 1, cinfo);
+      if (e->buffer + 1 == 0xFF)
+	LJPEG_emit_byte(0x00, cinfo);
+    }
+    e->zc += e->sc;  /* carry-over converts stacked 0xFF bytes to 0x00 */
+    e->sc = 0;
+    /* Note: The 3 spacer bits in the C register guarantee
+     * that the new buffer byte can't be 0xFF here
+     * (see page 160 in the P&M JPEG book). */
+    e->buffer = (int) (temp & 0xFF);  /* new output byte, might overflow later */
+  } else if (temp == 0xFF) {
+    ++e->sc;  /* stack 0xFF byte (which might overflow later) */
+  } else {
+    /* Output all stacked 0xFF bytes, they will not overflow any more */
+    if (e->buffer == 0)
+      ++e->zc;
+    else if (e->buffer >= 0) {
+      LJPEG_emit_zeros(e, cinfo);
+      LJPEG_emit_byte(e->buffer, cinfo);
+    }
+    if (e->sc) {
+      LJPEG_emit_zeros(e, cinfo);
+      LJPEG_emit_stacked(e, cinfo);
+    }
+    e->buffer = (int) (temp & 0xFF);  /* new output byte (can still overflow) */
+  }
+}
+
+
 /*
  * Finish up at the end of an arithmetic-compressed scan.
  */
@@ -148,9 +266,7 @@ LJPEG_finish_pass (LJPEG_j_compress_ptr cinfo)
   if (e->c & 0xF8000000L) {
     /* One final overflow has to be handled */
     if (e->buffer >= 0) {
-      if (e->zc)
-	do LJPEG_emit_byte(0x00, cinfo);
-	while (--e->zc);
+      LJPEG_emit_zeros(e, cinfo);
       LJPEG_emit_byte(e->buffer + 1, cinfo);
       if (e->buffer + 1 == 0xFF)
 	LJPEG_emit_byte(0x00, cinfo);
@@ -161,26 +277,17 @@ LJPEG_finish_pass (LJPEG_j_compress_ptr cinfo)
     if (e->buffer == 0)
       ++e->zc;
     else if (e->buffer >= 0) {
-      if (e->zc)
-	do LJPEG_emit_byte(0x00, cinfo);
-	while (--e->zc);
+      LJPEG_emit_zeros(e, cinfo);
       LJPEG_emit_byte(e->buffer, cinfo);
     }
     if (e->sc) {
-      if (e->zc)
-	do LJPEG_emit_byte(0x00, cinfo);
-	while (--e->zc);
-      do {
-	LJPEG_emit_byte(0xFF, cinfo);
-	LJPEG_emit_byte(0x00, cinfo);
-      } while (--e->sc);
+      LJPEG_emit_zeros(e, cinfo);
+      LJPEG_emit_stacked(e, cinfo);
     }
   }
   /* Output final bytes only if they are not 0x00 */
   if (e->c & 0x7FFF800L) {
-    if (e->zc)  /* output final pending zero bytes */
-      do LJPEG_emit_byte(0x00, cinfo);
-      while (--e->zc);
+    LJPEG_emit_zeros(e, cinfo);  /* output final pending zero bytes */
     LJPEG_emit_byte((e->c >> 19) & 0xFF, cinfo);
     if (((e->c >> 19) & 0xFF) == 0xFF)
       LJPEG_emit_byte(0x00, cinfo);
@@ -193,6 +300,39 @@ LJPEG_finish_pass (LJPEG_j_compress_ptr cinfo)
 }
 
 
+/*
+ * Renormalization & data output per section D.1.6.
+ * Rather than shifting bit by bit, we shift A and C by the whole
+ * amount at once, stopping only at the byte boundaries where
+ * another byte is ready for output.
+ */
+
+LOCAL(void)
+LJPEG_arith_renorm (LJPEG_j_compress_ptr cinfo, LJPEG_arith_working_state * e)
+{
+  register INT32 temp;
+  register int shift;
+
+  temp = e->a;
+  shift = 0;
+  do {
+    temp <<= 1;
+    shift++;
+  } while (temp < 0x8000L);
+  e->a = temp;
+  while (shift >= e->ct) {
+    /* Another byte is ready for output */
+    e->c <<= e->ct;
+    shift -= e->ct;
+    LJPEG_emit_ready_byte(cinfo, e->c >> 19);
+    e->c &= 0x7FFFFL;
+    e->ct = 8;
+  }
+  e->c <<= shift;
+  e->ct -= shift;
+}
+
+
 /*
  * The core arithmetic encoding routine (common in JPEG and JBIG).
  * This needs to go as fast as possible.
@@ -213,14 +353,21 @@ LJPEG_finish_pass (LJPEG_j_compress_ptr cinfo)
  * I've also introduced a new scheme for accessing
  * the probability estimation state machine table,
  * derived from Markus Kuhn's JBIG implementation.
+ *
+ * The coding registers are held in a working state
+ * local to the MCU encoder (see above), and the
+ * renormalization with its byte output is kept out
+ * of line, so that this routine is small enough to
+ * be inlined.
  */
 
+INLINE
 LOCAL(void)
-LJPEG_arith_encode (LJPEG_j_compress_ptr cinfo, unsigned char *st, int val)
+LJPEG_arith_encode (LJPEG_j_compress_ptr cinfo, LJPEG_arith_working_state * e,
+		    unsigned char *st, int val)
 {
-  register LJPEG_arith_entropy_ptr e = (LJPEG_arith_entropy_ptr) cinfo->entropy;
   register unsigned char nl, nm;
-  register INT32 qe, temp;
+  register INT32 qe;
   register int sv;
 
   /* Fetch values from our compact representation of Table D.3(D.2):
@@ -258,56 +405,38 @@ LJPEG_arith_encode (LJPEG_j_compress_ptr cinfo, unsigned char *st, int val)
     *st = (sv & 0x80) ^ nm;	/* Estimate_after_MPS */
   }
 
-  /* Renormalization & data output per section D.1.6 */
-  do {
+  /* Renormalization & data output per section D.1.6.
+   * The most frequent case is a single shift without byte output,
+   * which we handle here; all others go to the out-of-line routine.
+   */
+  if (e->a >= 0x4000L && e->ct > 1) {
     e->a <<= 1;
     e->c <<= 1;
-    if (--e->ct == 0) {
-      /* Another byte is ready for output */
-      temp = e->c >> 19;
-      if (temp > 0xFF) {
-	/* Handle overflow over all stacked 0xFF bytes */
-	if (e->buffer >= 0) {
-	  if (e->zc)
-	    do LJPEG_emit_byte(0x00, cinfo);
-	    while (--e->zc);
-	  LJPEG_emit_byte(e->buffer + 1, cinfo);
-	  if (e->buffer + 1 == 0xFF)
-	    LJPEG_emit_byte(0x00, cinfo);
-	}
-	e->zc += e->sc;  /* carry-over converts stacked 0xFF bytes to 0x00 */
-	e->sc = 0;
-	/* Note: The 3 spacer bits in the C register guarantee
-	 * that the new buffer byte can't be 0xFF here
-	 * (see page 160 in the P&M JPEG book). */
-	e->buffer = temp & 0xFF;  /* new output byte, might overflow later */
-      } else if (temp == 0xFF) {
-	++e->sc;  /* stack 0xFF byte (which might overflow later) */
-      } else {
-	/* Output all stacked 0xFF bytes, they will not overflow any more */
-	if (e->buffer == 0)
-	  ++e->zc;
-	else if (e->buffer >= 0) {
-	  if (e->zc)
-	    do LJPEG_emit_byte(0x00, cinfo);
-	    while (--e->zc);
-	  LJPEG_emit_byte(e->buffer, cinfo);
-	}
-	if (e->sc) {
-	  if (e->zc)
-	    do LJPEG_emit_byte(0x00, cinfo);
-	    while (--e->zc);
-	  do {
-	    LJPEG_emit_byte(0xFF, cinfo);
-	    LJPEG_emit_byte(0x00, cinfo);
-	  } while (--e->sc);
-	}
-	e->buffer = temp & 0xFF;  /* new output byte (can still overflow) */
-      }
-      e->c &= 0x7FFFFL;
-      e->ct += 8;
-    }
-  } while (e->a < 0x8000L);
+    e->ct--;
+  } else
+    LJPEG_arith_renorm(cinfo, e);
+}
+
+
+LOCAL(void)
+LJPEG_load_state (LJPEG_j_compress_ptr cinfo, LJPEG_arith_working_state * state)
+{
+  LJPEG_arith_entropy_ptr entropy = (LJPEG_arith_entropy_ptr) cinfo->entropy;
+
+  state->c = entropy->c;
+  state->a = entropy->a;
+  state->ct = entropy->ct;
+}
+
+
+LOCAL(void)
+LJPEG_save_state (LJPEG_j_compress_ptr cinfo, LJPEG_arith_working_state * state)
+{
+  LJPEG_arith_entropy_ptr entropy = (LJPEG_arith_entropy_ptr) cinfo->entropy;
+
+  entropy->c = state->c;
+  entropy->a = state->a;
+  entropy->ct = state->ct;
 }
 
 
@@ -362,6 +491,7 @@ LJPEG_METHODDEF(boolean)
 LJPEG_encode_mcu_DC_first (LJPEG_j_compress_ptr cinfo, LJPEG_JBLOCKROW *MCU_data)
 {
   LJPEG_arith_entropy_ptr entropy = (LJPEG_arith_entropy_ptr) cinfo->entropy;
+  LJPEG_arith_working_state state;
   LJPEG_JBLOCKROW block;
   unsigned char *st;
   int blkn, ci, tbl;
@@ -379,6 +509,8 @@ LJPEG_encode_mcu_DC_first (LJPEG_j_compress_ptr cinfo, LJPEG_JBLOCKROW *MCU_data
     entropy->restarts_to_go--;
   }
 
+  LJPEG_load_state(cinfo, &state);
+
   /* Encode the MCU data blocks */
   for (blkn = 0; blkn < cinfo->blocks_in_MCU; blkn++) {
     block = MCU_data[blkn];
@@ -397,37 +529,37 @@ LJPEG_encode_mcu_DC_first (LJPEG_j_compress_ptr cinfo, LJPEG_JBLOCKROW *MCU_data
 
     /* Figure F.4: Encode_DC_DIFF */
     if ((v = m - entropy->last_dc_val[ci]) == 0) {
-      LJPEG_arith_encode(cinfo, st, 0);
+      LJPEG_arith_encode(cinfo, &state, st, 0);
       entropy->dc_context[ci] = 0;	/* zero diff category */
     } else {
       entropy->last_dc_val[ci] = m;
-      LJPEG_arith_encode(cinfo, st, 1);
+      LJPEG_arith_encode(cinfo, &state, st, 1);
       /* Figure F.6: Encoding nonzero value v */
       /* Figure F.7: Encoding the sign of v */
       if (v > 0) {
-	LJPEG_arith_encode(cinfo, st + 1, 0);	/* Table F.4: SS = S0 + 1 */
+	LJPEG_arith_encode(cinfo, &state, st + 1, 0);	/* Table F.4: SS = S0 + 1 */
 	st += 2;			/* Table F.4: SP = S0 + 2 */
 	entropy->dc_context[ci] = 4;	/* small positive diff category */
       } else {
 	v = -v;
-	LJPEG_arith_encode(cinfo, st + 1, 1);	/* Table F.4: SS = S0 + 1 */
+	LJPEG_arith_encode(cinfo, &state, st + 1, 1);	/* Table F.4: SS = S0 + 1 */
 	st += 3;			/* Table F.4: SN = S0 + 3 */
 	entropy->dc_context[ci] = 8;	/* small negative diff category */
       }
       /* Figure F.8: Encoding the magnitude category of v */
       m = 0;
       if (v -= 1) {
-	LJPEG_arith_encode(cinfo, st, 1);
+	LJPEG_arith_encode(cinfo, &state, st, 1);
 	m = 1;
 	v2 = v;
 	st = entropy->dc_stats[tbl] + 20; /* Table F.4: X1 = 20 */
 	while (v2 >>= 1) {
-	  LJPEG_arith_encode(cinfo, st, 1);
+	  LJPEG_arith_encode(cinfo, &state, st, 1);
 	  m <<= 1;
 	  st += 1;
 	}
       }
-      LJPEG_arith_encode(cinfo, st, 0);
+      LJPEG_arith_encode(cinfo, &state, st, 0);
       /* Section F.1.4.4.1.2: Establish dc_context conditioning category */
       if (m < (int) ((1L << cinfo->arith_dc_L[tbl]) >> 1))
 	entropy->dc_context[ci] = 0;	/* zero diff category */
@@ -436,10 +568,11 @@ LJPEG_encode_mcu_DC_first (LJPEG_j_compress_ptr cinfo, LJPEG_JBLOCKROW *MCU_data
       /* Figure F.9: Encoding the magnitude bit pattern of v */
       st += 14;
       while (m >>= 1)
-	LJPEG_arith_encode(cinfo, st, (m & v) ? 1 : 0);
+	LJPEG_arith_encode(cinfo, &state, st, (m & v) ? 1 : 0);
     }
   }
 
+  LJPEG_save_state(cinfo, &state);
   return TRUE;
 }
 
@@ -453,6 +586,7 @@ LJPEG_METHODDEF(boolean)
 LJPEG_encode_mcu_AC_first (LJPEG_j_compress_ptr cinfo, LJPEG_JBLOCKROW *MCU_data)
 {
   LJPEG_arith_entropy_ptr entropy = (LJPEG_arith_entropy_ptr) cinfo->entropy;
+  LJPEG_arith_working_state state;
   LJPEG_JBLOCKROW block;
   unsigned char *st;
   int tbl, k, ke;
@@ -470,6 +604,8 @@ LJPEG_encode_mcu_AC_first (LJPEG_j_compress_ptr cinfo, LJPEG_JBLOCKROW *MCU_data
     entropy->restarts_to_go--;
   }
 
+  LJPEG_load_state(cinfo, &state);
+
   natural_order = cinfo->natural_order;
 
   /* Encode the MCU data block */
@@ -496,56 +632,57 @@ LJPEG_encode_mcu_AC_first (LJPEG_j_compress_ptr cinfo, LJPEG_JBLOCKROW *MCU_data
   /* Figure F.5: Encode_AC_Coefficients */
   for (k = cinfo->Ss - 1; k < ke;) {
     st = entropy->ac_stats[tbl] + 3 * k;
-    LJPEG_arith_encode(cinfo, st, 0);		/* EOB decision */
+    LJPEG_arith_encode(cinfo, &state, st, 0);		/* EOB decision */
     for (;;) {
       if ((v = (*block)[natural_order[++k]]) >= 0) {
 	if (v >>= cinfo->Al) {
-	  LJPEG_arith_encode(cinfo, st + 1, 1);
-	  LJPEG_arith_encode(cinfo, entropy->fixed_bin, 0);
+	  LJPEG_arith_encode(cinfo, &state, st + 1, 1);
+	  LJPEG_arith_encode(cinfo, &state, entropy->fixed_bin, 0);
 	  break;
 	}
       } else {
 	v = -v;
 	if (v >>= cinfo->Al) {
-	  LJPEG_arith_encode(cinfo, st + 1, 1);
-	  LJPEG_arith_encode(cinfo, entropy->fixed_bin, 1);
+	  LJPEG_arith_encode(cinfo, &state, st + 1, 1);
+	  LJPEG_arith_encode(cinfo, &state, entropy->fixed_bin, 1);
 	  break;
 	}
       }
-      LJPEG_arith_encode(cinfo, st + 1, 0);
+      LJPEG_arith_encode(cinfo, &state, st + 1, 0);
       st += 3;
     }
     st += 2;
     /* Figure F.8: Encoding the magnitude category of v */
     m = 0;
     if (v -= 1) {
-      LJPEG_arith_encode(cinfo, st, 1);
+      LJPEG_arith_encode(cinfo, &state, st, 1);
       m = 1;
       v2 = v;
       if (v2 >>= 1) {
-	LJPEG_arith_encode(cinfo, st, 1);
+	LJPEG_arith_encode(cinfo, &state, st, 1);
 	m <<= 1;
 	st = entropy->ac_stats[tbl] +
 	     (k <= cinfo->arith_ac_K[tbl] ? 189 : 217);
 	while (v2 >>= 1) {
-	  LJPEG_arith_encode(cinfo, st, 1);
+	  LJPEG_arith_encode(cinfo, &state, st, 1);
 	  m <<= 1;
 	  st += 1;
 	}
       }
     }
-    LJPEG_arith_encode(cinfo, st, 0);
+    LJPEG_arith_encode(cinfo, &state, st, 0);
     /* Figure F.9: Encoding the magnitude bit pattern of v */
     st += 14;
     while (m >>= 1)
-      LJPEG_arith_encode(cinfo, st, (m & v) ? 1 : 0);
+      LJPEG_arith_encode(cinfo, &state, st, (m & v) ? 1 : 0);
   }
   /* Encode EOB decision only if k < cinfo->Se */
   if (k < cinfo->Se) {
     st = entropy->ac_stats[tbl] + 3 * k;
-    LJPEG_arith_encode(cinfo, st, 1);
+    LJPEG_arith_encode(cinfo, &state, st, 1);
   }
 
+  LJPEG_save_state(cinfo, &state);
   return TRUE;
 }
 
@@ -558,6 +695,7 @@ LJPEG_METHODDEF(boolean)
 LJPEG_encode_mcu_DC_refine (LJPEG_j_compress_ptr cinfo, LJPEG_JBLOCKROW *MCU_data)
 {
   LJPEG_arith_entropy_ptr entropy = (LJPEG_arith_entropy_ptr) cinfo->entropy;
+  LJPEG_arith_working_state state;
   unsigned char *st;
   int Al, blkn;
 
@@ -572,15 +710,18 @@ LJPEG_encode_mcu_DC_refine (LJPEG_j_compress_ptr cinfo, LJPEG_JBLOCKROW *MCU_dat
     entropy->restarts_to_go--;
   }
 
+  LJPEG_load_state(cinfo, &state);
+
   st = entropy->fixed_bin;	/* use fixed probability estimation */
   Al = cinfo->Al;
 
   /* Encode the MCU data blocks */
   for (blkn = 0; blkn < cinfo->blocks_in_MCU; blkn++) {
     /* We simply emit the Al'th bit of the DC coefficient value. */
-    LJPEG_arith_encode(cinfo, st, (MCU_data[blkn][0][0] >> Al) & 1);
+    LJPEG_arith_encode(cinfo, &state, st, (MCU_data[blkn][0][0] >> Al) & 1);
   }
 
+  LJPEG_save_state(cinfo, &state);
   return TRUE;
 }
 
@@ -593,6 +734,7 @@ LJPEG_METHODDEF(boolean)
 LJPEG_encode_mcu_AC_refine (LJPEG_j_compress_ptr cinfo, LJPEG_JBLOCKROW *MCU_data)
 {
   LJPEG_arith_entropy_ptr entropy = (LJPEG_arith_entropy_ptr) cinfo->entropy;
+  LJPEG_arith_working_state state;
   LJPEG_JBLOCKROW block;
   unsigned char *st;
   int tbl, k, ke, kex;
@@ -610,6 +752,8 @@ LJPEG_encode_mcu_AC_refine (LJPEG_j_compress_ptr cinfo, LJPEG_JBLOCKROW *MCU_dat
     entropy->restarts_to_go--;
   }
 
+  LJPEG_load_state(cinfo, &state);
+
   natural_order = cinfo->natural_order;
 
   /* Encode the MCU data block */
@@ -646,15 +790,15 @@ LJPEG_encode_mcu_AC_refine (LJPEG_j_compress_ptr cinfo, LJPEG_JBLOCKROW *MCU_dat
   for (k = cinfo->Ss - 1; k < ke;) {
     st = entropy->ac_stats[tbl] + 3 * k;
     if (k >= kex)
-      LJPEG_arith_encode(cinfo, st, 0);	/* EOB decision */
+      LJPEG_arith_encode(cinfo, &state, st, 0);	/* EOB decision */
     for (;;) {
       if ((v = (*block)[natural_order[++k]]) >= 0) {
 	if (v >>= cinfo->Al) {
 	  if (v >> 1)			/* previously nonzero coef */
-	    LJPEG_arith_encode(cinfo, st + 2, (v & 1));
+	    LJPEG_arith_encode(cinfo, &state, st + 2, (v & 1));
 	  else {			/* newly nonzero coef */
-	    LJPEG_arith_encode(cinfo, st + 1, 1);
-	    LJPEG_arith_encode(cinfo, entropy->fixed_bin, 0);
+	    LJPEG_arith_encode(cinfo, &state, st + 1, 1);
+	    LJPEG_arith_encode(cinfo, &state, entropy->fixed_bin, 0);
 	  }
 	  break;
 	}
@@ -662,24 +806,25 @@ LJPEG_encode_mcu_AC_refine (LJPEG_j_compress_ptr cinfo, LJPEG_JBLOCKROW *MCU_dat
 	v = -v;
 	if (v >>= cinfo->Al) {
 	  if (v >> 1)			/* previously nonzero coef */
-	    LJPEG_arith_encode(cinfo, st + 2, (v & 1));
+	    LJPEG_arith_encode(cinfo, &state, st + 2, (v & 1));
 	  else {			/* newly nonzero coef */
-	    LJPEG_arith_encode(cinfo, st + 1, 1);
-	    LJPEG_arith_encode(cinfo, entropy->fixed_bin, 1);
+	    LJPEG_arith_encode(cinfo, &state, st + 1, 1);
+	    LJPEG_arith_encode(cinfo, &state, entropy->fixed_bin, 1);
 	  }
 	  break;
 	}
       }
-      LJPEG_arith_encode(cinfo, st + 1, 0);
+      LJPEG_arith_encode(cinfo, &state, st + 1, 0);
       st += 3;
     }
   }
   /* Encode EOB decision only if k < cinfo->Se */
   if (k < cinfo->Se) {
     st = entropy->ac_stats[tbl] + 3 * k;
-    LJPEG_arith_encode(cinfo, st, 1);
+    LJPEG_arith_encode(cinfo, &state, st, 1);
   }
 
+  LJPEG_save_state(cinfo, &state);
   return TRUE;
 }
 
@@ -692,6 +837,7 @@ LJPEG_METHODDEF(boolean)
 LJPEG_encode_mcu (LJPEG_j_compress_ptr cinfo, LJPEG_JBLOCKROW *MCU_data)
 {
   LJPEG_arith_entropy_ptr entropy = (LJPEG_arith_entropy_ptr) cinfo->entropy;
+  LJPEG_arith_working_state state;
   LJPEG_jpeg_component_info * compptr;
   LJPEG_JBLOCKROW block;
   unsigned char *st;
@@ -710,6 +856,8 @@ LJPEG_encode_mcu (LJPEG_j_compress_ptr cinfo, LJPEG_JBLOCKROW *MCU_data)
     entropy->restarts_to_go--;
   }
 
+  LJPEG_load_state(cinfo, &state);
+
   natural_order = cinfo->natural_order;
 
   /* Encode the MCU data blocks */
@@ -727,37 +875,37 @@ LJPEG_encode_mcu (LJPEG_j_compress_ptr cinfo, LJPEG_JBLOCKROW *MCU_data)
 
     /* Figure F.4: Encode_DC_DIFF */
     if ((v = (*block)[0] - entropy->last_dc_val[ci]) == 0) {
-      LJPEG_arith_encode(cinfo, st, 0);
+      LJPEG_arith_encode(cinfo, &state, st, 0);
       entropy->dc_context[ci] = 0;	/* zero diff category */
     } else {
       entropy->last_dc_val[ci] = (*block)[0];
-      LJPEG_arith_encode(cinfo, st, 1);
+      LJPEG_arith_encode(cinfo, &state, st, 1);
       /* Figure F.6: Encoding nonzero value v */
       /* Figure F.7: Encoding the sign of v */
       if (v > 0) {
-	LJPEG_arith_encode(cinfo, st + 1, 0);	/* Table F.4: SS = S0 + 1 */
+	LJPEG_arith_encode(cinfo, &state, st + 1, 0);	/* Table F.4: SS = S0 + 1 */
 	st += 2;			/* Table F.4: SP = S0 + 2 */
 	entropy->dc_context[ci] = 4;	/* small positive diff category */
       } else {
 	v = -v;
-	LJPEG_arith_encode(cinfo, st + 1, 1);	/* Table F.4: SS = S0 + 1 */
+	LJPEG_arith_encode(cinfo, &state, st + 1, 1);	/* Table F.4: SS = S0 + 1 */
 	st += 3;			/* Table F.4: SN = S0 + 3 */
 	entropy->dc_context[ci] = 8;	/* small negative diff category */
       }
       /* Figure F.8: Encoding the magnitude category of v */
       m = 0;
       if (v -= 1) {
-	LJPEG_arith_encode(cinfo, st, 1);
+	LJPEG_arith_encode(cinfo, &state, st, 1);
 	m = 1;
 	v2 = v;
 	st = entropy->dc_stats[tbl] + 20; /* Table F.4: X1 = 20 */
 	while (v2 >>= 1) {
-	  LJPEG_arith_encode(cinfo, st, 1);
+	  LJPEG_arith_encode(cinfo, &state, st, 1);
 	  m <<= 1;
 	  st += 1;
 	}
       }
-      LJPEG_arith_encode(cinfo, st, 0);
+      LJPEG_arith_encode(cinfo, &state, st, 0);
       /* Section F.1.4.4.1.2: Establish dc_context conditioning category */
       if (m < (int) ((1L << cinfo->arith_dc_L[tbl]) >> 1))
 	entropy->dc_context[ci] = 0;	/* zero diff category */
@@ -766,7 +914,7 @@ LJPEG_encode_mcu (LJPEG_j_compress_ptr cinfo, LJPEG_JBLOCKROW *MCU_data)
       /* Figure F.9: Encoding the magnitude bit pattern of v */
       st += 14;
       while (m >>= 1)
-	LJPEG_arith_encode(cinfo, st, (m & v) ? 1 : 0);
+	LJPEG_arith_encode(cinfo, &state, st, (m & v) ? 1 : 0);
     }
 
     /* Sections F.1.4.2 & F.1.4.4.2: Encoding of AC coefficients */
@@ -782,52 +930,53 @@ LJPEG_encode_mcu (LJPEG_j_compress_ptr cinfo, LJPEG_JBLOCKROW *MCU_data)
     /* Figure F.5: Encode_AC_Coefficients */
     for (k = 0; k < ke;) {
       st = entropy->ac_stats[tbl] + 3 * k;
-      LJPEG_arith_encode(cinfo, st, 0);	/* EOB decision */
+      LJPEG_arith_encode(cinfo, &state, st, 0);	/* EOB decision */
       while ((v = (*block)[natural_order[++k]]) == 0) {
-	LJPEG_arith_encode(cinfo, st + 1, 0);
+	LJPEG_arith_encode(cinfo, &state, st + 1, 0);
 	st += 3;
       }
-      LJPEG_arith_encode(cinfo, st + 1, 1);
+      LJPEG_arith_encode(cinfo, &state, st + 1, 1);
       /* Figure F.6: Encoding nonzero value v */
       /* Figure F.7: Encoding the sign of v */
       if (v > 0) {
-	LJPEG_arith_encode(cinfo, entropy->fixed_bin, 0);
+	LJPEG_arith_encode(cinfo, &state, entropy->fixed_bin, 0);
       } else {
 	v = -v;
-	LJPEG_arith_encode(cinfo, entropy->fixed_bin, 1);
+	LJPEG_arith_encode(cinfo, &state, entropy->fixed_bin, 1);
       }
       st += 2;
       /* Figure F.8: Encoding the magnitude category of v */
       m = 0;
       if (v -= 1) {
-	LJPEG_arith_encode(cinfo, st, 1);
+	LJPEG_arith_encode(cinfo, &state, st, 1);
 	m = 1;
 	v2 = v;
 	if (v2 >>= 1) {
-	  LJPEG_arith_encode(cinfo, st, 1);
+	  LJPEG_arith_encode(cinfo, &state, st, 1);
 	  m <<= 1;
 	  st = entropy->ac_stats[tbl] +
 	       (k <= cinfo->arith_ac_K[tbl] ? 189 : 217);
 	  while (v2 >>= 1) {
-	    LJPEG_arith_encode(cinfo, st, 1);
+	    LJPEG_arith_encode(cinfo, &state, st, 1);
 	    m <<= 1;
 	    st += 1;
 	  }
 	}
       }
-      LJPEG_arith_encode(cinfo, st, 0);
+      LJPEG_arith_encode(cinfo, &state, st, 0);
       /* Figure F.9: Encoding the magnitude bit pattern of v */
       st += 14;
       while (m >>= 1)
-	LJPEG_arith_encode(cinfo, st, (m & v) ? 1 : 0);
+	LJPEG_arith_encode(cinfo, &state, st, (m & v) ? 1 : 0);
     }
     /* Encode EOB decision only if k < cinfo->lim_Se */
     if (k < cinfo->lim_Se) {
       st = entropy->ac_stats[tbl] + 3 * k;
-      LJPEG_arith_encode(cinfo, st, 1);
+      LJPEG_arith_encode(cinfo, &state, st, 1);
     }
   }
 
+  LJPEG_save_state(cinfo, &state);
   return TRUE;
 }
 
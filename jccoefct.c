@@ -39,6 +39,7 @@ typedef struct {
   LJPEG_JDIMENSION mcu_ctr;		/* counts MCUs processed in current row */
   int MCU_vert_offset;		/* counts MCU rows within iMCU row */
   int MCU_rows_per_iMCU_row;	/* number of such rows needed */
+  LJPEG_J_BUF_MODE pass_mode;	/* current operating mode */
 
   /* For single-pass compression, it's sufficient to buffer just one MCU
    * (although this may prove a bit slow in practice).  We allocate a
@@ -69,6 +70,37 @@ LJPEG_METHODDEF(boolean) LJPEG_compress_output
 #endif
 
 
+/*
+ * Run the forward DCT on a horizontal row of blocks of one component.
+ * Raw data taken from the application's planes (see jcapistd.c) may end
+ * partway through the component's last block; that block is instead
+ * taken from the edge buffer, which holds it padded out.
+ */
+
+LOCAL(void)
+LJPEG_forward_DCT_row (LJPEG_j_compress_ptr cinfo, LJPEG_jpeg_component_info * compptr,
+		 LJPEG_JSAMPIMAGE input_buf, LJPEG_JBLOCKROW coef_blocks,
+		 LJPEG_JDIMENSION start_row, LJPEG_JDIMENSION start_col,
+		 LJPEG_JDIMENSION num_blocks)
+{
+  int ci = compptr->component_index;
+  LJPEG_forward_DCT_ptr LJPEG_forward_DCT = cinfo->fdct->LJPEG_forward_DCT[ci];
+
+  if (input_buf == cinfo->master->plane_rows &&
+      cinfo->master->plane_edge[ci] != NULL &&
+      start_col / compptr->DCT_h_scaled_size + num_blocks ==
+      compptr->width_in_blocks) {
+    num_blocks--;
+    (*LJPEG_forward_DCT) (cinfo, compptr, cinfo->master->plane_edge[ci],
+		    coef_blocks + num_blocks, start_row, (LJPEG_JDIMENSION) 0,
+		    (LJPEG_JDIMENSION) 1);
+  }
+  if (num_blocks > 0)
+    (*LJPEG_forward_DCT) (cinfo, compptr, input_buf[ci], coef_blocks,
+		    start_row, start_col, num_blocks);
+}
+
+
 LOCAL(void)
 LJPEG_start_iMCU_row (LJPEG_j_compress_ptr cinfo)
 /* Reset within-iMCU-row counters for a new row */
@@ -104,6 +136,7 @@ LJPEG_start_pass_coef (LJPEG_j_compress_ptr cinfo, LJPEG_J_BUF_MODE pass_mode)
 
   coef->iMCU_row_num = 0;
   LJPEG_start_iMCU_row(cinfo);
+  coef->pass_mode = pass_mode;
 
   switch (pass_mode) {
   case LJPEG_JBUF_PASS_THRU:
@@ -112,6 +145,7 @@ LJPEG_start_pass_coef (LJPEG_j_compress_ptr cinfo, LJPEG_J_BUF_MODE pass_mode)
     coef->pub.LJPEG_compress_data = LJPEG_compress_data;
     break;
 #ifdef FULL_COEF_BUFFER_SUPPORTED
+  case LJPEG_JBUF_SAVE_SOURCE:
   case LJPEG_JBUF_SAVE_AND_PASS:
     if (coef->whole_image[0] == NULL)
       ERREXIT(cinfo, JERR_BAD_BUFFER_MODE);
@@ -150,7 +184,6 @@ LJPEG_compress_data (LJPEG_j_compress_ptr cinfo, LJPEG_JSAMPIMAGE input_buf)
   int blkn, bi, ci, yindex, yoffset, blockcnt;
   LJPEG_JDIMENSION ypos, xpos;
   LJPEG_jpeg_component_info *compptr;
-  LJPEG_forward_DCT_ptr LJPEG_forward_DCT;
 
   /* Loop to write as much as one whole iMCU row */
   for (yoffset = coef->MCU_vert_offset; yoffset < coef->MCU_rows_per_iMCU_row;
@@ -169,7 +202,6 @@ LJPEG_compress_data (LJPEG_j_compress_ptr cinfo, LJPEG_JSAMPIMAGE input_buf)
       blkn = 0;
       for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
 	compptr = cinfo->cur_comp_info[ci];
-	LJPEG_forward_DCT = cinfo->fdct->LJPEG_forward_DCT[compptr->component_index];
 	blockcnt = (MCU_col_num < last_MCU_col) ? compptr->MCU_width
 						: compptr->last_col_width;
 	xpos = MCU_col_num * compptr->MCU_sample_width;
@@ -178,10 +210,9 @@ LJPEG_compress_data (LJPEG_j_compress_ptr cinfo, LJPEG_JSAMPIMAGE input_buf)
 	for (yindex = 0; yindex < compptr->MCU_height; yindex++) {
 	  if (coef->iMCU_row_num < last_iMCU_row ||
 	      yoffset+yindex < compptr->last_row_height) {
-	    (*LJPEG_forward_DCT) (cinfo, compptr,
-			    input_buf[compptr->component_index],
-			    coef->MCU_buffer[blkn],
-			    ypos, xpos, (LJPEG_JDIMENSION) blockcnt);
+	    LJPEG_forward_DCT_row(cinfo, compptr, input_buf,
+				  coef->MCU_buffer[blkn],
+				  ypos, xpos, (LJPEG_JDIMENSION) blockcnt);
 	    if (blockcnt < compptr->MCU_width) {
 	      /* Create some dummy blocks at the right edge of the image. */
 	      FMEMZERO((void FAR *) coef->MCU_buffer[blkn + blockcnt],
@@ -236,7 +267,8 @@ LJPEG_compress_data (LJPEG_j_compress_ptr cinfo, LJPEG_JSAMPIMAGE input_buf)
  *
  * We must also emit the data to the entropy encoder.  This is conveniently
  * done by calling LJPEG_compress_output() after we've loaded the current strip
- * of the virtual arrays.
+ * of the virtual arrays.  In JBUF_SAVE_SOURCE mode, the scans are instead
+ * entropy-coded after the first pass, so we only fill the buffer.
  *
  * NB: input_buf contains a plane for each component in image.  All
  * components are DCT'd and loaded into the virtual arrays in this pass.
@@ -256,7 +288,6 @@ LJPEG_compress_first_pass (LJPEG_j_compress_ptr cinfo, LJPEG_JSAMPIMAGE input_bu
   LJPEG_jpeg_component_info *compptr;
   LJPEG_JBLOCKARRAY buffer;
   LJPEG_JBLOCKROW thisblockrow, lastblockrow;
-  LJPEG_forward_DCT_ptr LJPEG_forward_DCT;
 
   for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
        ci++, compptr++) {
@@ -279,15 +310,14 @@ LJPEG_compress_first_pass (LJPEG_j_compress_ptr cinfo, LJPEG_JSAMPIMAGE input_bu
     ndummy = (int) (blocks_across % h_samp_factor);
     if (ndummy > 0)
       ndummy = h_samp_factor - ndummy;
-    LJPEG_forward_DCT = cinfo->fdct->LJPEG_forward_DCT[ci];
     /* Perform DCT for all non-dummy blocks in this iMCU row.  Each call
      * on LJPEG_forward_DCT processes a complete horizontal row of DCT blocks.
      */
     for (block_row = 0; block_row < block_rows; block_row++) {
       thisblockrow = buffer[block_row];
-      (*LJPEG_forward_DCT) (cinfo, compptr, input_buf[ci], thisblockrow,
-		      (LJPEG_JDIMENSION) (block_row * compptr->DCT_v_scaled_size),
-		      (LJPEG_JDIMENSION) 0, blocks_across);
+      LJPEG_forward_DCT_row(cinfo, compptr, input_buf, thisblockrow,
+		(LJPEG_JDIMENSION) (block_row * compptr->DCT_v_scaled_size),
+		(LJPEG_JDIMENSION) 0, blocks_across);
       if (ndummy > 0) {
 	/* Create dummy blocks at the right edge of the image. */
 	thisblockrow += blocks_across; /* => first dummy block */
@@ -323,6 +353,11 @@ LJPEG_compress_first_pass (LJPEG_j_compress_ptr cinfo, LJPEG_JSAMPIMAGE input_bu
       }
     }
   }
+  if (coef->pass_mode == LJPEG_JBUF_SAVE_SOURCE) {
+    coef->iMCU_row_num++;
+    return TRUE;
+  }
+
   /* NB: LJPEG_compress_output will increment iMCU_row_num if successful.
    * A suspension return will result in redoing all the work above next time.
    */
@@ -422,17 +457,22 @@ LJPEG_jinit_c_coef_controller (LJPEG_j_compress_ptr cinfo, boolean need_full_buf
 #ifdef FULL_COEF_BUFFER_SUPPORTED
     /* Allocate a full-image virtual array for each component, */
     /* padded to a multiple of samp_factor DCT blocks in each direction. */
+    /* When scans are output in parallel, the arrays are read concurrently */
+    /* by several scans, so each must be held entirely in memory. */
     int ci;
+    LJPEG_JDIMENSION height;
     LJPEG_jpeg_component_info *compptr;
 
     for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
 	 ci++, compptr++) {
+      height = (LJPEG_JDIMENSION) LJPEG_jround_up((long) compptr->height_in_blocks,
+					(long) compptr->v_samp_factor);
       coef->whole_image[ci] = (*cinfo->mem->LJPEG_request_virt_barray)
 	((LJPEG_j_common_ptr) cinfo, JPOOL_IMAGE, FALSE,
 	 (LJPEG_JDIMENSION) LJPEG_jround_up((long) compptr->width_in_blocks,
 				(long) compptr->h_samp_factor),
-	 (LJPEG_JDIMENSION) LJPEG_jround_up((long) compptr->height_in_blocks,
-				(long) compptr->v_samp_factor),
+	 height,
+	 cinfo->master->parallel_scans ? height :
 	 (LJPEG_JDIMENSION) compptr->v_samp_factor);
     }
 #else
@@ -452,3 +492,30 @@ LJPEG_jinit_c_coef_controller (LJPEG_j_compress_ptr cinfo, boolean need_full_buf
     coef->whole_image[0] = NULL; /* flag for no virtual arrays */
   }
 }
+
+
+#ifdef FULL_COEF_BUFFER_SUPPORTED
+
+/*
+ * Initialize a buffer controller for a private copy of the compression
+ * object, used to output one scan in parallel with others.  The new
+ * controller reads from the full-image buffer of the original one, but
+ * keeps its own position counters.
+ */
+
+GLOBAL(void)
+LJPEG_jinit_c_coef_scan_copy (LJPEG_j_compress_ptr cinfo,
+			LJPEG_j_compress_ptr scaninfo)
+{
+  LJPEG_my_coef_ptr coef;
+
+  coef = (LJPEG_my_coef_ptr)
+    (*cinfo->mem->LJPEG_alloc_small) ((LJPEG_j_common_ptr) cinfo, JPOOL_IMAGE,
+				SIZEOF(LJPEG_my_coef_controller));
+  MEMCOPY(coef, cinfo->coef, SIZEOF(LJPEG_my_coef_controller));
+  if (coef->whole_image[0] == NULL)
+    ERREXIT(cinfo, JERR_BAD_BUFFER_MODE);
+  scaninfo->coef = (struct LJPEG_jpeg_c_coef_controller *) coef;
+}
+
+#endif /* FULL_COEF_BUFFER_SUPPORTED */
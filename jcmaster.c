@@ -653,6 +653,360 @@ LJPEG_per_scan_setup (LJPEG_j_compress_ptr cinfo)
 }
 
 
+#ifdef C_MULTISCAN_FILES_SUPPORTED
+
+/*
+ * Parallel scan output.
+ *
+ * Once the main pass has filled the full-image coefficient buffer, every
+ * scan reads only from that buffer, so the scans can be entropy-coded
+ * independently.  Each scan gets a private copy of the compression object,
+ * with its own component info (for the per-scan MCU geometry), entropy
+ * encoder, coefficient controller and Huffman tables, and it writes to a
+ * private memory destination, and its own error manager.  All of this is
+ * set up here beforehand; the only allocations in the tasks are detached
+ * chunks for their output.  The tasks are run by the application's task
+ * dispatcher, first to gather statistics for the optimal Huffman tables
+ * (if required), and then to encode the data.  After each round, errors
+ * caught in the tasks are re-raised here.  Finally the scans are emitted
+ * in script order.
+ */
+
+/* The compressed data of a scan is kept in a list of chunks, each followed
+ * by its data bytes.  The first chunk is a regular large object; the rest
+ * are added by the task and are detached objects until the task is done.
+ */
+
+typedef struct LJPEG_scan_chunk_struct * LJPEG_scan_chunk_ptr;
+
+typedef struct LJPEG_scan_chunk_struct {
+  LJPEG_scan_chunk_ptr next;	/* next chunk of the scan, or NULL */
+  size_t size;			/* # of data bytes the chunk can hold */
+  size_t used;			/* # of data bytes in it */
+  boolean detached;		/* TRUE until attached to the image pool */
+} LJPEG_scan_chunk;
+
+typedef struct {
+  struct LJPEG_jpeg_destination_mgr pub; /* public fields */
+
+  LJPEG_scan_chunk_ptr first;	/* chunks holding the scan's data */
+  LJPEG_scan_chunk_ptr last;	/* chunk being filled */
+} LJPEG_my_scan_destination_mgr;
+
+typedef LJPEG_my_scan_destination_mgr * LJPEG_my_scan_dest_ptr;
+
+typedef struct {
+  struct LJPEG_jpeg_compress_struct cinfo; /* private copy for this scan */
+  LJPEG_my_scan_destination_mgr dest;	/* private destination for this scan */
+  LJPEG_jpeg_task_error_mgr err;	/* private error manager for the task */
+} LJPEG_my_scan_copy;
+
+#define SCAN_BUF_SIZE  16384	/* size of a scan's first output chunk */
+#define SCAN_CHUNK_MAX  1048576L /* no chunk grows beyond this */
+
+
+/*
+ * Methods for the private scan destination.  The first chunk is allocated
+ * by LJPEG_init_scan_destination, which the main thread calls; the task
+ * can only add detached objects (see jmemmgr.c), doubling the chunk size
+ * each time up to SCAN_CHUNK_MAX.  LJPEG_finish_scan_tasks then puts them
+ * into the image pool, so no error path can leak them.
+ */
+
+LJPEG_METHODDEF(void)
+LJPEG_init_scan_destination (LJPEG_j_compress_ptr cinfo)
+{
+  LJPEG_my_scan_dest_ptr dest = (LJPEG_my_scan_dest_ptr) cinfo->dest;
+  LJPEG_scan_chunk_ptr chunk;
+
+  chunk = (LJPEG_scan_chunk_ptr)
+    (*cinfo->mem->LJPEG_alloc_large) ((LJPEG_j_common_ptr) cinfo, JPOOL_IMAGE,
+				SIZEOF(LJPEG_scan_chunk) + SCAN_BUF_SIZE);
+  chunk->next = NULL;
+  chunk->size = SCAN_BUF_SIZE;
+  chunk->used = 0;
+  chunk->detached = FALSE;
+  dest->first = dest->last = chunk;
+  dest->pub.next_output_byte = (JOCTET *) (chunk + 1);
+  dest->pub.free_in_buffer = chunk->size;
+}
+
+LJPEG_METHODDEF(boolean)
+LJPEG_empty_scan_output_buffer (LJPEG_j_compress_ptr cinfo)
+{
+  LJPEG_my_scan_dest_ptr dest = (LJPEG_my_scan_dest_ptr) cinfo->dest;
+  LJPEG_scan_chunk_ptr chunk;
+  size_t nextsize;
+
+  nextsize = dest->last->size * 2;
+  if (nextsize > (size_t) SCAN_CHUNK_MAX)
+    nextsize = (size_t) SCAN_CHUNK_MAX;
+  chunk = (LJPEG_scan_chunk_ptr)
+    (*cinfo->mem->LJPEG_alloc_detached) ((LJPEG_j_common_ptr) cinfo,
+				   SIZEOF(LJPEG_scan_chunk) + nextsize);
+  chunk->next = NULL;
+  chunk->size = nextsize;
+  chunk->used = 0;
+  chunk->detached = TRUE;
+
+  dest->last->used = dest->last->size;
+  dest->last->next = chunk;
+  dest->last = chunk;
+  dest->pub.next_output_byte = (JOCTET *) (chunk + 1);
+  dest->pub.free_in_buffer = chunk->size;
+
+  return TRUE;
+}
+
+LJPEG_METHODDEF(void)
+LJPEG_term_scan_destination (LJPEG_j_compress_ptr cinfo)
+{
+  LJPEG_my_scan_dest_ptr dest = (LJPEG_my_scan_dest_ptr) cinfo->dest;
+
+  dest->last->used = dest->last->size - dest->pub.free_in_buffer;
+}
+
+
+LOCAL(void)
+LJPEG_copy_huff_table (LJPEG_j_compress_ptr cinfo,
+		 LJPEG_JHUFF_TBL ** htblptr, LJPEG_JHUFF_TBL * srctbl)
+/* Give a scan copy a private table, unless it already has one */
+{
+  if (*htblptr != srctbl)
+    return;
+  *htblptr = (LJPEG_JHUFF_TBL *)
+    (*cinfo->mem->LJPEG_alloc_small) ((LJPEG_j_common_ptr) cinfo, JPOOL_IMAGE,
+				SIZEOF(LJPEG_JHUFF_TBL));
+  if (srctbl != NULL)
+    MEMCOPY(*htblptr, srctbl, SIZEOF(LJPEG_JHUFF_TBL));
+  else
+    MEMZERO(*htblptr, SIZEOF(LJPEG_JHUFF_TBL));
+}
+
+
+LOCAL(void)
+LJPEG_install_huff_table (LJPEG_j_compress_ptr cinfo,
+		    LJPEG_JHUFF_TBL ** htblptr, LJPEG_JHUFF_TBL * srctbl)
+/* Copy a table computed by a scan copy back into the master record */
+{
+  if (*htblptr == NULL)
+    *htblptr = LJPEG_jpeg_alloc_huff_table((LJPEG_j_common_ptr) cinfo);
+  MEMCOPY(*htblptr, srctbl, SIZEOF(LJPEG_JHUFF_TBL));
+}
+
+
+LOCAL(void)
+LJPEG_prepare_scan_copy (LJPEG_j_compress_ptr cinfo, LJPEG_my_scan_copy * copy)
+/* Set up a private copy of the compression object for the current scan */
+{
+  LJPEG_j_compress_ptr scaninfo = &copy->cinfo;
+  LJPEG_my_scan_dest_ptr dest = &copy->dest;
+  LJPEG_jpeg_component_info *compptr;
+  int ci;
+
+  MEMCOPY(scaninfo, cinfo, SIZEOF(struct LJPEG_jpeg_compress_struct));
+  LJPEG_jinit_task_error((LJPEG_j_common_ptr) cinfo, &copy->err);
+  scaninfo->err = &copy->err.pub;
+
+  /* The per-scan MCU geometry lives in the component info */
+  scaninfo->comp_info = (LJPEG_jpeg_component_info *)
+    (*cinfo->mem->LJPEG_alloc_small) ((LJPEG_j_common_ptr) cinfo, JPOOL_IMAGE,
+				cinfo->num_components *
+				SIZEOF(LJPEG_jpeg_component_info));
+  MEMCOPY(scaninfo->comp_info, cinfo->comp_info,
+	  cinfo->num_components * SIZEOF(LJPEG_jpeg_component_info));
+
+  LJPEG_select_scan_parameters(scaninfo);
+  LJPEG_per_scan_setup(scaninfo);
+
+  /* Optimal tables are generated into private copies of the tables */
+  if (cinfo->optimize_coding && ! cinfo->arith_code) {
+    for (ci = 0; ci < scaninfo->comps_in_scan; ci++) {
+      compptr = scaninfo->cur_comp_info[ci];
+      if (scaninfo->Ss == 0 && scaninfo->Ah == 0)
+	LJPEG_copy_huff_table(cinfo, &scaninfo->dc_huff_tbl_ptrs[compptr->dc_tbl_no],
+			cinfo->dc_huff_tbl_ptrs[compptr->dc_tbl_no]);
+      if (scaninfo->Se)
+	LJPEG_copy_huff_table(cinfo, &scaninfo->ac_huff_tbl_ptrs[compptr->ac_tbl_no],
+			cinfo->ac_huff_tbl_ptrs[compptr->ac_tbl_no]);
+    }
+  }
+
+  /* Private entropy encoder and coefficient controller */
+  if (cinfo->arith_code)
+    LJPEG_jinit_LJPEG_arith_encoder(scaninfo);
+  else
+    LJPEG_jinit_huff_encoder(scaninfo);
+  LJPEG_jinit_c_coef_scan_copy(cinfo, scaninfo);
+
+  /* Private destination */
+  dest->pub.LJPEG_init_destination = LJPEG_init_scan_destination;
+  dest->pub.LJPEG_empty_output_buffer = LJPEG_empty_scan_output_buffer;
+  dest->pub.LJPEG_term_destination = LJPEG_term_scan_destination;
+  dest->first = dest->last = NULL;
+  scaninfo->dest = (struct LJPEG_jpeg_destination_mgr *) dest;
+}
+
+
+LJPEG_METHODDEF(void)
+LJPEG_process_scan_copy (void * task_data)
+/* Task routine: run one scan through the entropy encoder */
+{
+  LJPEG_my_scan_copy * copy = (LJPEG_my_scan_copy *) task_data;
+  LJPEG_j_compress_ptr scaninfo = &copy->cinfo;
+  LJPEG_JDIMENSION iMCU_row;
+
+  /* An error ends the task here; the main thread re-raises it */
+  if (setjmp(copy->err.setjmp_buffer))
+    return;
+
+  (*scaninfo->coef->LJPEG_start_pass) (scaninfo, LJPEG_JBUF_CRANK_DEST);
+  for (iMCU_row = 0; iMCU_row < scaninfo->total_iMCU_rows; iMCU_row++) {
+    /* We don't support data suspension here */
+    if (! (*scaninfo->coef->LJPEG_compress_data) (scaninfo, (LJPEG_JSAMPIMAGE) NULL))
+      ERREXIT(scaninfo, JERR_CANT_SUSPEND);
+  }
+  (*scaninfo->entropy->LJPEG_finish_pass) (scaninfo);
+}
+
+
+LOCAL(void)
+LJPEG_finish_scan_tasks (LJPEG_j_compress_ptr cinfo, LJPEG_my_scan_copy * copies)
+/* Take over what the tasks left, and re-raise the first error among them */
+{
+  LJPEG_scan_chunk_ptr chunk;
+  int scan, failed = -1;
+
+  /* First put all detached chunks in the pool, so they cannot leak */
+  for (scan = 0; scan < cinfo->num_scans; scan++) {
+    for (chunk = copies[scan].dest.first; chunk != NULL; chunk = chunk->next) {
+      if (chunk->detached) {
+	(*cinfo->mem->LJPEG_attach_detached) ((LJPEG_j_common_ptr) cinfo,
+					JPOOL_IMAGE, (void FAR *) chunk);
+	chunk->detached = FALSE;
+      }
+    }
+  }
+
+  for (scan = 0; scan < cinfo->num_scans; scan++) {
+    if (LJPEG_jmerge_task_error((LJPEG_j_common_ptr) cinfo, &copies[scan].err) &&
+	failed < 0)
+      failed = scan;
+  }
+  if (failed >= 0)
+    LJPEG_jraise_task_error((LJPEG_j_common_ptr) cinfo, &copies[failed].err);
+}
+
+
+LOCAL(void)
+LJPEG_emit_scan_data (LJPEG_j_compress_ptr cinfo, LJPEG_my_scan_dest_ptr src)
+/* Copy a scan's buffered data to the real destination */
+{
+  struct LJPEG_jpeg_destination_mgr * dest = cinfo->dest;
+  LJPEG_scan_chunk_ptr chunk;
+  const JOCTET * dataptr;
+  size_t datalen, count;
+
+  for (chunk = src->first; chunk != NULL; chunk = chunk->next) {
+    dataptr = (const JOCTET *) (chunk + 1);
+    datalen = chunk->used;
+    while (datalen > 0) {
+      count = MIN(datalen, dest->free_in_buffer);
+      MEMCOPY(dest->next_output_byte, dataptr, count);
+      dest->next_output_byte += count;
+      dest->free_in_buffer -= count;
+      dataptr += count;
+      datalen -= count;
+      if (dest->free_in_buffer == 0) {
+	if (! (*dest->LJPEG_empty_output_buffer) (cinfo))
+	  ERREXIT(cinfo, JERR_CANT_SUSPEND);
+      }
+    }
+  }
+}
+
+
+LOCAL(void)
+LJPEG_output_scans_parallel (LJPEG_j_compress_ptr cinfo)
+/* Entropy-code all scans concurrently, then emit them in script order */
+{
+  LJPEG_my_master_ptr master = (LJPEG_my_master_ptr) cinfo->master;
+  LJPEG_my_scan_copy * copies;
+  LJPEG_j_compress_ptr scaninfo;
+  LJPEG_jpeg_component_info *compptr;
+  void ** task_data;
+  int scan, num_tasks, ci;
+
+  copies = (LJPEG_my_scan_copy *)
+    (*cinfo->mem->LJPEG_alloc_small) ((LJPEG_j_common_ptr) cinfo, JPOOL_IMAGE,
+				cinfo->num_scans * SIZEOF(LJPEG_my_scan_copy));
+  task_data = (void **)
+    (*cinfo->mem->LJPEG_alloc_small) ((LJPEG_j_common_ptr) cinfo, JPOOL_IMAGE,
+				cinfo->num_scans * SIZEOF(void *));
+
+  for (scan = 0; scan < cinfo->num_scans; scan++) {
+    master->scan_number = scan;
+    LJPEG_prepare_scan_copy(cinfo, &copies[scan]);
+  }
+
+#ifdef ENTROPY_OPT_SUPPORTED
+  if (cinfo->optimize_coding) {
+    /* Gather statistics for all scans which need Huffman tables.
+     * As in the sequential case, Huffman DC refinement scans have none.
+     */
+    num_tasks = 0;
+    for (scan = 0; scan < cinfo->num_scans; scan++) {
+      scaninfo = &copies[scan].cinfo;
+      if (scaninfo->Ss != 0 || scaninfo->Ah == 0) {
+	(*scaninfo->entropy->LJPEG_start_pass) (scaninfo, TRUE);
+	task_data[num_tasks++] = (void *) &copies[scan];
+      }
+    }
+    (*cinfo->task->run_tasks) ((LJPEG_j_common_ptr) cinfo,
+			       LJPEG_process_scan_copy, task_data, num_tasks);
+    LJPEG_finish_scan_tasks(cinfo, copies);
+  }
+#endif
+
+  /* Entropy-code all scans into their private buffers */
+  for (scan = 0; scan < cinfo->num_scans; scan++) {
+    scaninfo = &copies[scan].cinfo;
+    (*scaninfo->entropy->LJPEG_start_pass) (scaninfo, FALSE);
+    (*scaninfo->dest->LJPEG_init_destination) (scaninfo);
+    task_data[scan] = (void *) &copies[scan];
+  }
+  (*cinfo->task->run_tasks) ((LJPEG_j_common_ptr) cinfo,
+			     LJPEG_process_scan_copy, task_data, cinfo->num_scans);
+  LJPEG_finish_scan_tasks(cinfo, copies);
+
+  /* Emit frame header, and the headers and data of all scans in order */
+  for (scan = 0; scan < cinfo->num_scans; scan++) {
+    scaninfo = &copies[scan].cinfo;
+    master->scan_number = scan;
+    LJPEG_select_scan_parameters(cinfo);
+    LJPEG_per_scan_setup(cinfo);
+    if (cinfo->optimize_coding && ! cinfo->arith_code) {
+      for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+	compptr = cinfo->cur_comp_info[ci];
+	if (cinfo->Ss == 0 && cinfo->Ah == 0)
+	  LJPEG_install_huff_table(cinfo, &cinfo->dc_huff_tbl_ptrs[compptr->dc_tbl_no],
+			     scaninfo->dc_huff_tbl_ptrs[compptr->dc_tbl_no]);
+	if (cinfo->Se)
+	  LJPEG_install_huff_table(cinfo, &cinfo->ac_huff_tbl_ptrs[compptr->ac_tbl_no],
+			     scaninfo->ac_huff_tbl_ptrs[compptr->ac_tbl_no]);
+      }
+    }
+    if (scan == 0)
+      (*cinfo->marker->LJPEG_write_frame_header) (cinfo);
+    (*cinfo->marker->LJPEG_write_scan_header) (cinfo);
+    (*scaninfo->dest->LJPEG_term_destination) (scaninfo);
+    LJPEG_emit_scan_data(cinfo, &copies[scan].dest);
+  }
+}
+
+#endif /* C_MULTISCAN_FILES_SUPPORTED */
+
+
 /*
  * Per-pass setup.
  * This is called at the beginning of each pass.  We determine which modules
@@ -670,6 +1024,7 @@ LJPEG_prepare_for_pass (LJPEG_j_compress_ptr cinfo)
   case main_pass:
     /* Initial pass: will collect input data, and do either Huffman
      * optimization or data output for the first scan.
+     * In parallel scan mode, it only collects the input data.
      */
     LJPEG_select_scan_parameters(cinfo);
     LJPEG_per_scan_setup(cinfo);
@@ -679,6 +1034,13 @@ LJPEG_prepare_for_pass (LJPEG_j_compress_ptr cinfo)
       (*cinfo->prep->LJPEG_start_pass) (cinfo, LJPEG_JBUF_PASS_THRU);
     }
     (*cinfo->fdct->LJPEG_start_pass) (cinfo);
+    if (master->pub.parallel_scans) {
+      (*cinfo->coef->LJPEG_start_pass) (cinfo, LJPEG_JBUF_SAVE_SOURCE);
+      (*cinfo->main->LJPEG_start_pass) (cinfo, LJPEG_JBUF_PASS_THRU);
+      /* All output happens at the end of the pass */
+      master->pub.call_LJPEG_pass_startup = FALSE;
+      break;
+    }
     (*cinfo->entropy->LJPEG_start_pass) (cinfo, cinfo->optimize_coding);
     (*cinfo->coef->LJPEG_start_pass) (cinfo,
 				(master->total_passes > 1 ?
@@ -768,6 +1130,15 @@ LJPEG_finish_pass_master (LJPEG_j_compress_ptr cinfo)
 {
   LJPEG_my_master_ptr master = (LJPEG_my_master_ptr) cinfo->master;
 
+#ifdef C_MULTISCAN_FILES_SUPPORTED
+  if (master->pub.parallel_scans) {
+    /* The main pass was the only one; now output all scans at once */
+    LJPEG_output_scans_parallel(cinfo);
+    master->pass_number++;
+    return;
+  }
+#endif
+
   /* The entropy coder always needs an end-of-pass call,
    * either to analyze statistics or to flush its output buffer.
    */
@@ -799,6 +1170,55 @@ LJPEG_finish_pass_master (LJPEG_j_compress_ptr cinfo)
 }
 
 
+/*
+ * Allocate the workspace for raw data input from cinfo->raw_planes.
+ * The DCT reads whole blocks of contiguous samples, so it can read a plane
+ * in place only if the plane's sample step is 1.  Such a plane may still
+ * end partway through its last block column; that column is then copied
+ * with edge replication into a buffer one block wide.  Other planes are
+ * copied an iMCU row at a time into scratch rows.
+ */
+
+LOCAL(void)
+LJPEG_alloc_plane_rows (LJPEG_j_compress_ptr cinfo)
+{
+  int ci, rows_per;
+  LJPEG_JDIMENSION padded_width;
+  LJPEG_jpeg_component_info *compptr;
+  struct LJPEG_jpeg_comp_master * master = cinfo->master;
+
+  master->plane_rows = (LJPEG_JSAMPIMAGE)
+    (*cinfo->mem->LJPEG_alloc_small) ((LJPEG_j_common_ptr) cinfo, JPOOL_IMAGE,
+				cinfo->num_components * SIZEOF(LJPEG_JSAMPARRAY));
+  master->plane_scratch = (LJPEG_JSAMPIMAGE)
+    (*cinfo->mem->LJPEG_alloc_small) ((LJPEG_j_common_ptr) cinfo, JPOOL_IMAGE,
+				cinfo->num_components * SIZEOF(LJPEG_JSAMPARRAY));
+  master->plane_edge = (LJPEG_JSAMPIMAGE)
+    (*cinfo->mem->LJPEG_alloc_small) ((LJPEG_j_common_ptr) cinfo, JPOOL_IMAGE,
+				cinfo->num_components * SIZEOF(LJPEG_JSAMPARRAY));
+  for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
+       ci++, compptr++) {
+    rows_per = compptr->v_samp_factor * compptr->DCT_v_scaled_size;
+    padded_width = compptr->width_in_blocks *
+		   (LJPEG_JDIMENSION) compptr->DCT_h_scaled_size;
+    master->plane_rows[ci] = (LJPEG_JSAMPARRAY)
+      (*cinfo->mem->LJPEG_alloc_small) ((LJPEG_j_common_ptr) cinfo, JPOOL_IMAGE,
+				  (size_t) rows_per * SIZEOF(LJPEG_JSAMPROW));
+    master->plane_scratch[ci] = NULL;
+    master->plane_edge[ci] = NULL;
+    if (cinfo->raw_planes[ci].sample_step != 1)
+      master->plane_scratch[ci] = (*cinfo->mem->LJPEG_alloc_sarray)
+	((LJPEG_j_common_ptr) cinfo, JPOOL_IMAGE, padded_width,
+	 (LJPEG_JDIMENSION) rows_per);
+    else if (compptr->downsampled_width < padded_width)
+      master->plane_edge[ci] = (*cinfo->mem->LJPEG_alloc_sarray)
+	((LJPEG_j_common_ptr) cinfo, JPOOL_IMAGE,
+	 (LJPEG_JDIMENSION) compptr->DCT_h_scaled_size,
+	 (LJPEG_JDIMENSION) rows_per);
+  }
+}
+
+
 /*
  * Initialize master compression control.
  */
@@ -816,10 +1236,17 @@ LJPEG_jinit_c_master_control (LJPEG_j_compress_ptr cinfo, boolean transcode_only
   master->pub.LJPEG_pass_startup = LJPEG_pass_startup;
   master->pub.LJPEG_finish_pass = LJPEG_finish_pass_master;
   master->pub.is_last_pass = FALSE;
+  master->pub.parallel_scans = FALSE;
+  master->pub.plane_rows = NULL;
+  master->pub.plane_scratch = NULL;
+  master->pub.plane_edge = NULL;
 
   /* Validate parameters, determine derived values */
   LJPEG_initial_setup(cinfo, transcode_only);
 
+  if (! transcode_only && cinfo->raw_data_in && cinfo->raw_planes != NULL)
+    LJPEG_alloc_plane_rows(cinfo);
+
   if (cinfo->scan_info != NULL) {
 #ifdef C_MULTISCAN_FILES_SUPPORTED
     LJPEG_validate_script(cinfo);
@@ -855,4 +1282,16 @@ LJPEG_jinit_c_master_control (LJPEG_j_compress_ptr cinfo, boolean transcode_only
     master->total_passes = cinfo->num_scans * 2;
   else
     master->total_passes = cinfo->num_scans;
+
+#ifdef C_MULTISCAN_FILES_SUPPORTED
+  /* Parallel scan output needs a task dispatcher and the full-image
+   * coefficient buffer of normal compression.  All scans are then
+   * output at the end of the main pass.
+   */
+  if (cinfo->parallel_scans && cinfo->task != NULL && ! transcode_only &&
+      cinfo->num_scans > 1) {
+    master->pub.parallel_scans = TRUE;
+    master->total_passes = 1;
+  }
+#endif
 }
@@ -38,7 +38,10 @@ LJPEG_jpeg_abort (LJPEG_j_common_ptr cinfo)
    * with some (brain-damaged) malloc libraries.
    */
   for (pool = JPOOL_NUMPOOLS-1; pool > JPOOL_PERMANENT; pool--) {
-    (*cinfo->mem->LJPEG_free_pool) (cinfo, pool);
+    if (cinfo->mem->recycle_image_pool)
+      (*cinfo->mem->LJPEG_recycle_pool) (cinfo, pool);
+    else
+      (*cinfo->mem->LJPEG_free_pool) (cinfo, pool);
   }
 
   /* Reset overall state for possible reuse of object */
@@ -104,3 +107,100 @@ LJPEG_jpeg_alloc_huff_table (LJPEG_j_common_ptr cinfo)
   tbl->sent_table = FALSE;	/* make sure this is false in any new table */
   return tbl;
 }
+
+
+/*
+ * Error handling within tasks.
+ *
+ * A task run by the application's task dispatcher must not report to the
+ * application's error manager: warnings from concurrent tasks would race
+ * on its state, and an error_exit routine that longjmps would leave the
+ * task's thread for a stack frame of another thread.  So the library
+ * gives each task a private error manager, set up by LJPEG_jinit_task_error.
+ * Warnings are merely counted there, keeping the first for reissue, and
+ * trace messages are dropped.  An error ends the task by returning to the
+ * setjmp point in the task routine.  Once all tasks have completed, the
+ * main thread calls LJPEG_jmerge_task_error for each task, and then, after
+ * any necessary cleanup, LJPEG_jraise_task_error for the first one that
+ * failed.
+ */
+
+LJPEG_METHODDEF(noreturn_t)
+LJPEG_task_error_exit (LJPEG_j_common_ptr cinfo)
+{
+  LJPEG_jpeg_task_error_mgr * err = (LJPEG_jpeg_task_error_mgr *) cinfo->err;
+
+  err->failed = TRUE;
+  longjmp(err->setjmp_buffer, 1);
+}
+
+
+LJPEG_METHODDEF(void)
+LJPEG_task_emit_message (LJPEG_j_common_ptr cinfo, int msg_level)
+{
+  LJPEG_jpeg_task_error_mgr * err = (LJPEG_jpeg_task_error_mgr *) cinfo->err;
+
+  if (msg_level < 0) {
+    if (err->pub.num_warnings == 0) {
+      err->warning_code = err->pub.msg_code;
+      MEMCOPY(&err->warning_parm, &err->pub.msg_parm,
+	      SIZEOF(err->warning_parm));
+    }
+    err->pub.num_warnings++;
+  }
+}
+
+
+/*
+ * Set up the private error manager for a task of object cinfo.
+ * The message tables and trace level are those of cinfo's error manager.
+ */
+
+GLOBAL(void)
+LJPEG_jinit_task_error (LJPEG_j_common_ptr cinfo, LJPEG_jpeg_task_error_mgr * err)
+{
+  MEMCOPY(&err->pub, cinfo->err, SIZEOF(struct LJPEG_jpeg_error_mgr));
+  err->pub.LJPEG_error_exit = LJPEG_task_error_exit;
+  err->pub.LJPEG_emit_message = LJPEG_task_emit_message;
+  err->pub.msg_code = 0;
+  err->pub.num_warnings = 0;
+  err->failed = FALSE;
+}
+
+
+/*
+ * Pass the warnings of a completed task on to cinfo's error manager.
+ * The first is reissued through its emit_message method, which may
+ * decide to abort; the rest are only counted.
+ * Returns TRUE if the task ended with an error.
+ */
+
+GLOBAL(boolean)
+LJPEG_jmerge_task_error (LJPEG_j_common_ptr cinfo, LJPEG_jpeg_task_error_mgr * err)
+{
+  long num_warnings = err->pub.num_warnings;
+
+  if (num_warnings > 0) {
+    err->pub.num_warnings = 0;	/* merge only once */
+    cinfo->err->msg_code = err->warning_code;
+    MEMCOPY(&cinfo->err->msg_parm, &err->warning_parm,
+	    SIZEOF(err->warning_parm));
+    (*cinfo->err->LJPEG_emit_message) (cinfo, -1);
+    cinfo->err->num_warnings += num_warnings - 1;
+  }
+  return err->failed;
+}
+
+
+/*
+ * Re-raise the error that ended a task, through cinfo's error manager.
+ */
+
+GLOBAL(void)
+LJPEG_jraise_task_error (LJPEG_j_common_ptr cinfo, LJPEG_jpeg_task_error_mgr * err)
+{
+  cinfo->err->msg_code = err->pub.msg_code;
+  MEMCOPY(&cinfo->err->msg_parm, &err->pub.msg_parm,
+	  SIZEOF(cinfo->err->msg_parm));
+  (*cinfo->err->LJPEG_error_exit) (cinfo);
+}
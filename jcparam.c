@@ -330,6 +330,9 @@ LJPEG_jpeg_set_defaults (LJPEG_j_compress_ptr cinfo)
   if (cinfo->data_precision > 8)
     cinfo->optimize_coding = TRUE;
 
+  /* By default, output the scans of a multi-scan file one after another */
+  cinfo->parallel_scans = FALSE;
+
   /* By default, use the simpler non-cosited sampling alignment */
   cinfo->CCIR601_sampling = FALSE;
 
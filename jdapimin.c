@@ -29,6 +29,20 @@
 
 GLOBAL(void)
 LJPEG_jpeg_CreateDecompress (LJPEG_j_decompress_ptr cinfo, int version, size_t structsize)
+{
+  LJPEG_jpeg_CreateDecompressAlloc(cinfo, (struct LJPEG_jpeg_allocator *) NULL,
+			   version, structsize);
+}
+
+
+/*
+ * As above, but the memory manager gets its chunks from the given allocator.
+ */
+
+GLOBAL(void)
+LJPEG_jpeg_CreateDecompressAlloc (LJPEG_j_decompress_ptr cinfo,
+			    struct LJPEG_jpeg_allocator * allocator,
+			    int version, size_t structsize)
 {
   int i;
 
@@ -56,7 +70,7 @@ LJPEG_jpeg_CreateDecompress (LJPEG_j_decompress_ptr cinfo, int version, size_t s
   cinfo->is_decompressor = TRUE;
 
   /* Initialize a memory manager instance for this object */
-  LJPEG_jinit_memory_mgr((LJPEG_j_common_ptr) cinfo);
+  LJPEG_jinit_memory_mgr((LJPEG_j_common_ptr) cinfo, allocator);
 
   /* Zero out pointers to permanent structures. */
   cinfo->progress = NULL;
@@ -107,6 +121,25 @@ LJPEG_jpeg_abort_decompress (LJPEG_j_decompress_ptr cinfo)
 }
 
 
+/*
+ * Prepare a decompression object for a Motion-JPEG stream.
+ * Each frame is then decoded by the usual read_header/start_decompress/
+ * read_scanlines/finish_decompress sequence on the same object.  Frames
+ * without DHT markers get the standard Huffman tables, and the per-image
+ * memory and derived tables of one frame are reused by the next.
+ * Must be called between images.
+ */
+
+GLOBAL(void)
+LJPEG_jpeg_mjpeg_stream (LJPEG_j_decompress_ptr cinfo)
+{
+  if (cinfo->global_state != DSTATE_START)
+    ERREXIT1(cinfo, JERR_BAD_STATE, cinfo->global_state);
+  cinfo->std_huff_default = TRUE;
+  cinfo->mem->recycle_image_pool = TRUE;
+}
+
+
 /*
  * Set default decompression parameters.
  */
@@ -194,6 +227,7 @@ LJPEG_default_decompress_parms (LJPEG_j_decompress_ptr cinfo)
   cinfo->dct_method = JDCT_DEFAULT;
   cinfo->do_fancy_upsampling = TRUE;
   cinfo->do_block_smoothing = TRUE;
+  cinfo->parallel_restarts = FALSE;
   cinfo->quantize_colors = FALSE;
   /* We set these in case application only sets quantize_colors. */
   cinfo->dither_mode = JDITHER_FS;
@@ -295,6 +329,7 @@ LJPEG_jpeg_consume_input (LJPEG_j_decompress_ptr cinfo)
     /* Start-of-datastream actions: reset appropriate modules */
     (*cinfo->inputctl->LJPEG_reset_input_controller) (cinfo);
     /* Initialize application's data source module */
+    cinfo->src->resident = FALSE;	/* init_source sets it if it can */
     (*cinfo->src->LJPEG_init_source) (cinfo);
     cinfo->global_state = DSTATE_INHEADER;
     /*FALLTHROUGH*/
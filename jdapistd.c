@@ -134,6 +134,100 @@ LJPEG_output_pass_setup (LJPEG_j_decompress_ptr cinfo)
 }
 
 
+/*
+ * Estimate the resources LJPEG_jpeg_start_decompress will need.
+ * LJPEG_jpeg_read_header must be completed before calling this, and the
+ * decompression parameters set as they will be for LJPEG_jpeg_start_decompress.
+ *
+ * The estimate is obtained by running the same module selection and
+ * initialization on a copy of the decompression object, with the memory
+ * manager measuring instead of realizing the virtual arrays.  The copy's
+ * memory is released again; the object itself is not changed.
+ */
+
+typedef struct {
+  struct LJPEG_jpeg_decompress_struct pub; /* the copy the modules work on */
+  LJPEG_j_decompress_ptr owner;		/* the application's object */
+  LJPEG_JMETHOD(noreturn_t, error_exit, (LJPEG_j_common_ptr cinfo));
+  struct LJPEG_jpeg_progress_mgr progress;
+  LJPEG_jpeg_component_info comp_info[MAX_COMPONENTS];
+} LJPEG_my_estimate_struct;
+
+typedef LJPEG_my_estimate_struct * LJPEG_my_estimate_ptr;
+
+
+LJPEG_METHODDEF(void)
+LJPEG_estimate_progress (LJPEG_j_common_ptr cinfo)
+{
+  /* no work */
+}
+
+
+LJPEG_METHODDEF(noreturn_t)
+LJPEG_estimate_error_exit (LJPEG_j_common_ptr cinfo)
+/* Give up the estimate, then report the error on the application's object */
+{
+  LJPEG_my_estimate_ptr est = (LJPEG_my_estimate_ptr) cinfo;
+
+  cinfo->err->LJPEG_error_exit = est->error_exit;
+  (*cinfo->mem->LJPEG_end_estimate) (cinfo, (LJPEG_jpeg_estimate *) NULL);
+  (*cinfo->err->LJPEG_error_exit) ((LJPEG_j_common_ptr) est->owner);
+}
+
+
+GLOBAL(void)
+LJPEG_jpeg_estimate_decompress (LJPEG_j_decompress_ptr cinfo,
+				LJPEG_jpeg_estimate * estimate)
+{
+  LJPEG_my_estimate_struct est;
+  LJPEG_j_decompress_ptr copy = & est.pub;
+  LJPEG_JMETHOD(int, consume_input, (LJPEG_j_decompress_ptr cinfo));
+  int ci;
+
+  if (cinfo->global_state != DSTATE_READY)
+    ERREXIT1(cinfo, JERR_BAD_STATE, cinfo->global_state);
+
+  MEMCOPY(copy, cinfo, SIZEOF(struct LJPEG_jpeg_decompress_struct));
+  est.owner = cinfo;
+  /* Work on private copies of the component info */
+  MEMCOPY(est.comp_info, cinfo->comp_info,
+	  cinfo->num_components * SIZEOF(LJPEG_jpeg_component_info));
+  copy->comp_info = est.comp_info;
+  for (ci = 0; ci < cinfo->comps_in_scan; ci++)
+    copy->cur_comp_info[ci] = est.comp_info +
+			      (cinfo->cur_comp_info[ci] - cinfo->comp_info);
+  /* Collect the pass counts without calling the application */
+  MEMZERO(& est.progress, SIZEOF(struct LJPEG_jpeg_progress_mgr));
+  est.progress.LJPEG_progress_monitor = LJPEG_estimate_progress;
+  copy->progress = & est.progress;
+  /* Tables cached across images must not point into the estimate */
+  copy->table_cache = NULL;
+  /* The input controller is shared; only its consume_input gets changed */
+  consume_input = cinfo->inputctl->consume_input;
+
+  est.error_exit = cinfo->err->LJPEG_error_exit;
+  cinfo->err->LJPEG_error_exit = LJPEG_estimate_error_exit;
+  (*cinfo->mem->LJPEG_begin_estimate) ((LJPEG_j_common_ptr) cinfo);
+
+  /* Same setup as LJPEG_jpeg_start_decompress and LJPEG_output_pass_setup */
+  LJPEG_jinit_master_decompress(copy);
+  (*copy->master->LJPEG_prepare_for_output_pass) (copy);
+
+  (*cinfo->mem->LJPEG_end_estimate) ((LJPEG_j_common_ptr) cinfo, estimate);
+  cinfo->err->LJPEG_error_exit = est.error_exit;
+  cinfo->inputctl->consume_input = consume_input;
+
+  if (! cinfo->inputctl->has_multiple_scans)
+    estimate->num_scans = 1;
+  else if (cinfo->progressive_mode)
+    /* Same guess as jdmaster.c: 2 DC scans + 3 AC scans/component */
+    estimate->num_scans = 2 + 3 * cinfo->num_components;
+  else
+    estimate->num_scans = cinfo->num_components;
+  estimate->total_passes = est.progress.total_passes;
+}
+
+
 /*
  * Read some scanlines of data from the JPEG decompressor.
  *
@@ -166,6 +260,15 @@ LJPEG_jpeg_read_scanlines (LJPEG_j_decompress_ptr cinfo, LJPEG_JSAMPARRAY scanli
     (*cinfo->progress->LJPEG_progress_monitor) ((LJPEG_j_common_ptr) cinfo);
   }
 
+  /* With no buffer, decode into the library's own strip for the listener */
+  if (scanlines == NULL) {
+    if (cinfo->main->strip == NULL)
+      ERREXIT(cinfo, JERR_NO_ROW_LISTENER);
+    scanlines = cinfo->main->strip;
+    if (max_lines > cinfo->main->strip_height)
+      max_lines = cinfo->main->strip_height;
+  }
+
   /* Process some data */
   row_ctr = 0;
   (*cinfo->main->process_data) (cinfo, scanlines, &row_ctr, max_lines);
@@ -174,15 +277,90 @@ LJPEG_jpeg_read_scanlines (LJPEG_j_decompress_ptr cinfo, LJPEG_JSAMPARRAY scanli
 }
 
 
+/*
+ * Point the row pointers for the current iMCU row into cinfo->raw_planes.
+ * Components that cannot take the IDCT output in place get scratch rows,
+ * which LJPEG_copy_plane_rows moves into the plane afterwards.
+ */
+
+LOCAL(LJPEG_JSAMPIMAGE)
+LJPEG_set_plane_rows (LJPEG_j_decompress_ptr cinfo, LJPEG_JDIMENSION iMCU_row)
+{
+  struct LJPEG_jpeg_decomp_master * master = cinfo->master;
+  LJPEG_jpeg_component_info *compptr;
+  LJPEG_jpeg_raw_plane *plane;
+  LJPEG_JSAMPARRAY rows;
+  LJPEG_JDIMENSION row;
+  int ci, r, rows_per;
+
+  if (master->plane_rows == NULL)
+    ERREXIT(cinfo, JERR_NO_RAW_PLANES);
+  for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
+       ci++, compptr++) {
+    plane = &cinfo->raw_planes[ci];
+    rows = master->plane_rows[ci];
+    rows_per = compptr->v_samp_factor * compptr->DCT_v_scaled_size;
+    row = iMCU_row * (LJPEG_JDIMENSION) rows_per;
+    for (r = 0; r < rows_per; r++, row++) {
+      if (row >= compptr->downsampled_height)
+	rows[r] = master->plane_dummy;
+      else if (master->plane_scratch[ci] != NULL)
+	rows[r] = master->plane_scratch[ci][r];
+      else
+	rows[r] = plane->base + (size_t) row * plane->row_stride;
+    }
+  }
+  return master->plane_rows;
+}
+
+
+/*
+ * Move the visible samples of scratch rows into their planes.
+ */
+
+LOCAL(void)
+LJPEG_copy_plane_rows (LJPEG_j_decompress_ptr cinfo, LJPEG_JDIMENSION iMCU_row)
+{
+  struct LJPEG_jpeg_decomp_master * master = cinfo->master;
+  LJPEG_jpeg_component_info *compptr;
+  LJPEG_jpeg_raw_plane *plane;
+  register LJPEG_JSAMPROW inptr, outptr;
+  register LJPEG_JDIMENSION count;
+  register int step;
+  LJPEG_JDIMENSION row;
+  int ci, r, rows_per;
+
+  for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
+       ci++, compptr++) {
+    if (master->plane_scratch[ci] == NULL)
+      continue;
+    plane = &cinfo->raw_planes[ci];
+    step = plane->sample_step;
+    rows_per = compptr->v_samp_factor * compptr->DCT_v_scaled_size;
+    row = iMCU_row * (LJPEG_JDIMENSION) rows_per;
+    for (r = 0; r < rows_per && row < compptr->downsampled_height;
+	 r++, row++) {
+      inptr = master->plane_scratch[ci][r];
+      outptr = plane->base + (size_t) row * plane->row_stride;
+      for (count = compptr->downsampled_width; count > 0; count--) {
+	*outptr = *inptr++;
+	outptr += step;
+      }
+    }
+  }
+}
+
+
 /*
  * Alternate entry point to read raw data.
  * Processes exactly one iMCU row per call, unless suspended.
+ * If data is NULL, the row goes straight into cinfo->raw_planes.
  */
 GLOBAL(LJPEG_JDIMENSION)
 LJPEG_jpeg_read_raw_data (LJPEG_j_decompress_ptr cinfo, LJPEG_JSAMPIMAGE data,
 		    LJPEG_JDIMENSION max_lines)
 {
-  LJPEG_JDIMENSION lines_per_iMCU_row;
+  LJPEG_JDIMENSION lines_per_iMCU_row, iMCU_row;
 
   if (cinfo->global_state != DSTATE_RAW_OK)
     ERREXIT1(cinfo, JERR_BAD_STATE, cinfo->global_state);
@@ -204,8 +382,16 @@ LJPEG_jpeg_read_raw_data (LJPEG_j_decompress_ptr cinfo, LJPEG_JSAMPIMAGE data,
     ERREXIT(cinfo, JERR_BUFFER_SIZE);
 
   /* Decompress directly into user's buffer. */
-  if (! (*cinfo->coef->LJPEG_decompress_data) (cinfo, data))
-    return 0;			/* suspension forced, can do nothing more */
+  if (data == NULL) {
+    iMCU_row = cinfo->output_scanline / lines_per_iMCU_row;
+    if (! (*cinfo->coef->LJPEG_decompress_data) (cinfo,
+				LJPEG_set_plane_rows(cinfo, iMCU_row)))
+      return 0;			/* suspension forced, can do nothing more */
+    LJPEG_copy_plane_rows(cinfo, iMCU_row);
+  } else {
+    if (! (*cinfo->coef->LJPEG_decompress_data) (cinfo, data))
+      return 0;			/* suspension forced, can do nothing more */
+  }
 
   /* OK, we processed one iMCU row. */
   cinfo->output_scanline += lines_per_iMCU_row;
@@ -268,3 +454,689 @@ LJPEG_jpeg_finish_output (LJPEG_j_decompress_ptr cinfo)
 }
 
 #endif /* D_MULTISCAN_FILES_SUPPORTED */
+
+
+/*
+ * Push-style decoding.
+ *
+ * Instead of the library pulling data from a source manager, the
+ * application hands it data as it arrives with LJPEG_jpeg_feed, and the library
+ * decodes as far as that data allows.  Underneath this is the ordinary
+ * suspension mechanism: a private source manager suspends whenever its data
+ * runs out, and keeps the bytes from the last restart point on for the next
+ * call.  New data is read in place where possible; it is copied only while
+ * a unit (an MCU or a marker segment) straddles the end of the held bytes.
+ *
+ * The arithmetic decoder cannot suspend within a scan, so for arithmetic-coded
+ * images all data is held, and the decoder is shown only as much of it as
+ * ends with a complete scan.  Output therefore advances a scan at a time.
+ */
+
+#define PUSH_MIN_SLICE  4096	/* least new data appended to held bytes */
+
+typedef enum {			/* where the push decoder is */
+	PUSH_HEADER,		/* reading the header */
+	PUSH_WAIT,		/* header read; waiting for LJPEG_jpeg_push_start */
+	PUSH_START,		/* in LJPEG_jpeg_start_decompress */
+	PUSH_ROWS,		/* reading scanlines (single-scan mode) */
+	PUSH_SCANS,		/* absorbing input (buffered-image mode) */
+	PUSH_BEGIN_OUTPUT,	/* in LJPEG_jpeg_start_output */
+	PUSH_OUTPUT,		/* emitting a scan's rows */
+	PUSH_END_OUTPUT,	/* in LJPEG_jpeg_finish_output */
+	PUSH_FINISH		/* in LJPEG_jpeg_finish_decompress */
+} LJPEG_J_PUSH_STAGE;
+
+typedef enum {			/* what the scan gate is looking at */
+	GATE_ENTROPY,		/* entropy-coded data */
+	GATE_MARKER,		/* start of a marker */
+	GATE_LENGTH,		/* length of a marker segment */
+	GATE_SEGMENT,		/* marker segment, followed by a marker */
+	GATE_SOS_SEGMENT,	/* SOS segment, followed by entropy data */
+	GATE_DONE		/* past the EOI marker */
+} LJPEG_J_GATE_STATE;
+
+typedef struct {
+  struct LJPEG_jpeg_source_mgr pub; /* public fields */
+
+  LJPEG_J_PUSH_STAGE stage;
+  LJPEG_JSAMPARRAY image;		/* application's output rows */
+  int scans_done;		/* last complete input scan */
+  int scans_shown;		/* last scan output to image */
+  boolean end_of_data;		/* application has signaled end of input */
+
+  JOCTET * buffer;		/* held data, not yet consumed */
+  size_t bufsize;		/* allocated size of buffer */
+  size_t held;			/* # of bytes held */
+  long skip_pending;		/* bytes still to be skipped */
+
+  const JOCTET * data;		/* data passed to the current call */
+  size_t datalen;
+  size_t datapos;		/* # of bytes of it given to the decoder */
+  const JOCTET * base;		/* start of what the decoder was given */
+  size_t baselen;		/* and its length */
+  size_t slice_start;		/* where appended data begins in buffer */
+
+  boolean gated;		/* show the decoder complete scans only */
+  LJPEG_J_GATE_STATE gate_state;
+  size_t gate_pos;		/* how far the held data has been parsed */
+  size_t gate_seg_end;		/* end of the marker segment being skipped */
+  boolean gate_sos;		/* that segment is an SOS */
+  size_t gate_safe;		/* held data up to here may be decoded */
+} LJPEG_my_push_source_mgr;
+
+typedef LJPEG_my_push_source_mgr * LJPEG_my_push_src_ptr;
+
+
+LJPEG_METHODDEF(void)
+LJPEG_init_push_source (LJPEG_j_decompress_ptr cinfo)
+{
+  /* no work necessary here */
+}
+
+LJPEG_METHODDEF(boolean)
+LJPEG_fill_push_input_buffer (LJPEG_j_decompress_ptr cinfo)
+{
+  static const JOCTET mybuffer[4] = {
+    (JOCTET) 0xFF, (JOCTET) JPEG_EOI, 0, 0
+  };
+  LJPEG_my_push_src_ptr src = (LJPEG_my_push_src_ptr) cinfo->src;
+
+  if (! src->end_of_data)
+    return FALSE;		/* suspend until more data is fed */
+
+  /* The application says there is no more: insert a fake EOI marker */
+  WARNMS(cinfo, JWRN_JPEG_EOF);
+  src->pub.next_input_byte = mybuffer;
+  src->pub.bytes_in_buffer = 2;
+  return TRUE;
+}
+
+LJPEG_METHODDEF(void)
+LJPEG_skip_push_input_data (LJPEG_j_decompress_ptr cinfo, long num_bytes)
+{
+  LJPEG_my_push_src_ptr src = (LJPEG_my_push_src_ptr) cinfo->src;
+
+  if (num_bytes > (long) src->pub.bytes_in_buffer) {
+    /* Discard the rest from data fed later */
+    src->skip_pending = num_bytes - (long) src->pub.bytes_in_buffer;
+    num_bytes = (long) src->pub.bytes_in_buffer;
+  }
+  if (num_bytes > 0) {
+    src->pub.next_input_byte += (size_t) num_bytes;
+    src->pub.bytes_in_buffer -= (size_t) num_bytes;
+  }
+}
+
+LJPEG_METHODDEF(void)
+LJPEG_term_push_source (LJPEG_j_decompress_ptr cinfo)
+{
+  /* no work necessary here */
+}
+
+
+/*
+ * Append count bytes to the held data, enlarging the buffer if need be.
+ * Buffers come from the permanent pool and are doubled, so the space
+ * wasted on outgrown ones is at most the size of the current one.
+ */
+
+LOCAL(void)
+LJPEG_push_hold (LJPEG_j_decompress_ptr cinfo, const JOCTET * bytes, size_t count)
+{
+  LJPEG_my_push_src_ptr src = (LJPEG_my_push_src_ptr) cinfo->src;
+  size_t newsize;
+  JOCTET * newbuffer;
+
+  if (src->held + count > src->bufsize) {
+    newsize = src->bufsize * 2;
+    if (newsize < PUSH_MIN_SLICE)
+      newsize = PUSH_MIN_SLICE;
+    while (newsize < src->held + count)
+      newsize *= 2;
+    newbuffer = (JOCTET *) (*cinfo->mem->LJPEG_alloc_large)
+      ((LJPEG_j_common_ptr) cinfo, JPOOL_PERMANENT, newsize * SIZEOF(JOCTET));
+    if (src->held > 0)
+      MEMCOPY(newbuffer, src->buffer, src->held * SIZEOF(JOCTET));
+    src->buffer = newbuffer;
+    src->bufsize = newsize;
+  }
+  if (count > 0)
+    MEMCOPY(src->buffer + src->held, bytes, count * SIZEOF(JOCTET));
+  src->held += count;
+}
+
+
+/*
+ * Give the decoder the next stretch of input.  If nothing is held, that is
+ * the rest of the caller's data, in place.  Otherwise it is the held bytes
+ * with a slice of the caller's data appended, in the hope that this will
+ * complete the unit that the held bytes begin.
+ */
+
+LOCAL(void)
+LJPEG_push_present (LJPEG_j_decompress_ptr cinfo)
+{
+  LJPEG_my_push_src_ptr src = (LJPEG_my_push_src_ptr) cinfo->src;
+  size_t count;
+
+  if (src->skip_pending > 0) {
+    count = src->datalen - src->datapos;
+    if ((long) count > src->skip_pending)
+      count = (size_t) src->skip_pending;
+    src->datapos += count;
+    src->skip_pending -= (long) count;
+  }
+
+  if (src->held == 0) {
+    src->base = src->data + src->datapos;
+    src->baselen = src->datalen - src->datapos;
+    src->datapos = src->datalen;
+    src->slice_start = 0;
+  } else {
+    count = src->datalen - src->datapos;
+    if (count > src->held && count > PUSH_MIN_SLICE)
+      count = MAX(src->held, PUSH_MIN_SLICE);
+    src->slice_start = src->held;
+    LJPEG_push_hold(cinfo, src->data + src->datapos, count);
+    src->datapos += count;
+    src->base = src->buffer;
+    src->baselen = src->held;
+  }
+  src->pub.next_input_byte = src->base;
+  src->pub.bytes_in_buffer = src->baselen;
+}
+
+
+/*
+ * Take back what the decoder did not consume.  Its restart point is at
+ * next_input_byte; everything from there on must be read again.
+ */
+
+LOCAL(void)
+LJPEG_push_absorb (LJPEG_j_decompress_ptr cinfo)
+{
+  LJPEG_my_push_src_ptr src = (LJPEG_my_push_src_ptr) cinfo->src;
+  size_t consumed, left;
+
+  if (src->pub.next_input_byte < src->base ||
+      src->pub.next_input_byte > src->base + src->baselen) {
+    consumed = src->baselen;	/* reading the fake EOI */
+  } else {
+    consumed = (size_t) (src->pub.next_input_byte - src->base);
+  }
+  left = src->baselen - consumed;
+
+  if (src->gated) {		/* held data is all there is */
+    src->gate_pos -= consumed;
+    src->gate_seg_end -= consumed;
+    src->gate_safe -= consumed;
+  }
+  if (src->base != src->buffer || src->held == 0) {
+    /* Caller's data: the unconsumed part must be held, as it can make
+     * no progress on its own
+     */
+    src->held = 0;
+    LJPEG_push_hold(cinfo, src->base + consumed, left);
+  } else if (consumed >= src->slice_start) {
+    /* Past the held bytes: resume in place in the caller's data */
+    src->datapos -= left;
+    src->held = 0;
+  } else {
+    /* Still within the held bytes: drop only what was consumed */
+    left = src->held - consumed;
+    if (consumed > 0) {
+      JOCTET * ptr = src->buffer;
+      const JOCTET * from = src->buffer + consumed;
+      size_t count;
+
+      for (count = left; count > 0; count--) /* regions may overlap */
+	*ptr++ = *from++;
+    }
+    src->held = left;
+  }
+  src->pub.next_input_byte = src->buffer;
+  src->pub.bytes_in_buffer = src->held;
+}
+
+
+/*
+ * Parse the held data of an arithmetic-coded image, to find how much of it
+ * the decoder can take without running out in the middle of a scan.
+ * This is everything up to the last marker that is not within a scan.
+ */
+
+LOCAL(void)
+LJPEG_push_gate (LJPEG_my_push_src_ptr src)
+{
+  const JOCTET * buffer = src->buffer;
+  size_t pos = src->gate_pos;
+  int c;
+
+  for (;;) {
+    switch (src->gate_state) {
+    case GATE_ENTROPY:
+      /* Look for a marker other than RSTn; stuffed zeroes hide data FFs */
+      for (;;) {
+	while (pos < src->held && GETJOCTET(buffer[pos]) != 0xFF)
+	  pos++;
+	if (pos + 1 >= src->held)
+	  goto done;
+	c = GETJOCTET(buffer[pos + 1]);
+	if (c == 0 || (c >= JPEG_RST0 && c <= JPEG_RST0 + 7))
+	  pos += 2;
+	else if (c == 0xFF)
+	  pos++;		/* fill byte */
+	else
+	  break;
+      }
+      /* The scan is complete, and the decoder reads its ending marker */
+      src->gate_safe = pos + 2;
+      src->gate_state = GATE_MARKER;
+      break;
+    case GATE_MARKER:
+      if (pos + 1 >= src->held)
+	goto done;
+      if (GETJOCTET(buffer[pos]) != 0xFF ||
+	  GETJOCTET(buffer[pos + 1]) == 0xFF) {
+	pos++;			/* garbage or fill byte; the decoder warns */
+	break;
+      }
+      c = GETJOCTET(buffer[pos + 1]);
+      if (c == JPEG_EOI) {
+	src->gate_state = GATE_DONE;
+	break;
+      }
+      pos += 2;
+      if (c == 0xD8 || c == 0x01 || (c >= JPEG_RST0 && c <= JPEG_RST0 + 7)) {
+	src->gate_safe = pos;	/* SOI, TEM or RSTn: no parameters */
+	break;
+      }
+      src->gate_sos = (c == 0xDA);
+      src->gate_state = GATE_LENGTH;
+      break;
+    case GATE_LENGTH:
+      if (pos + 1 >= src->held)
+	goto done;
+      src->gate_seg_end = pos + (((size_t) GETJOCTET(buffer[pos])) << 8)
+			  + (size_t) GETJOCTET(buffer[pos + 1]);
+      src->gate_state = src->gate_sos ? GATE_SOS_SEGMENT : GATE_SEGMENT;
+      break;
+    case GATE_SEGMENT:
+    case GATE_SOS_SEGMENT:
+      if (src->gate_seg_end > src->held)
+	goto done;
+      pos = src->gate_seg_end;
+      if (src->gate_state == GATE_SEGMENT) {
+	src->gate_safe = pos;
+	src->gate_state = GATE_MARKER;
+      } else
+	src->gate_state = GATE_ENTROPY;
+      break;
+    case GATE_DONE:
+      src->gate_safe = pos = src->held;
+      goto done;
+    }
+  }
+
+done:
+  src->gate_pos = pos;
+}
+
+
+/* Where the next output rows go; with no image, a row listener takes them */
+#define NEXT_OUTPUT_ROWS(src,cinfo)  \
+  ((src)->image == NULL ? (LJPEG_JSAMPARRAY) NULL : \
+   (src)->image + (cinfo)->output_scanline)
+
+
+/*
+ * Advance the decompression as far as the input allows.
+ * Returns JPEG_SUSPENDED, or the most significant event that occurred.
+ */
+
+LOCAL(int)
+LJPEG_push_decode (LJPEG_j_decompress_ptr cinfo)
+{
+  LJPEG_my_push_src_ptr src = (LJPEG_my_push_src_ptr) cinfo->src;
+  int event = JPEG_SUSPENDED;
+  int retcode;
+
+  for (;;) {
+    switch (src->stage) {
+    case PUSH_HEADER:
+      /* An earlier call may have begun the header and suspended at once */
+      if (src->end_of_data && src->pub.bytes_in_buffer == 0 &&
+	  (cinfo->global_state == DSTATE_START || ! cinfo->marker->saw_SOI))
+	return event;		/* no further image */
+      if (LJPEG_jpeg_read_header(cinfo, TRUE) == JPEG_SUSPENDED)
+	return event;
+      src->stage = PUSH_WAIT;
+      return JPEG_REACHED_SOS;
+    case PUSH_WAIT:
+      return event;
+    case PUSH_START:
+      if (! LJPEG_jpeg_start_decompress(cinfo))
+	return event;
+      src->stage = cinfo->buffered_image ? PUSH_SCANS : PUSH_ROWS;
+      break;
+    case PUSH_ROWS:
+      while (cinfo->output_scanline < cinfo->output_height) {
+	if (LJPEG_jpeg_read_scanlines(cinfo, NEXT_OUTPUT_ROWS(src, cinfo),
+				cinfo->output_height - cinfo->output_scanline)
+	    == 0)
+	  return event;
+	event = JPEG_ROW_COMPLETED;
+      }
+      src->stage = PUSH_FINISH;
+      break;
+#ifdef D_MULTISCAN_FILES_SUPPORTED
+    case PUSH_SCANS:
+      /* Absorb all the input there is, then show the latest complete scan */
+      while (! LJPEG_jpeg_input_complete(cinfo)) {
+	retcode = LJPEG_jpeg_consume_input(cinfo);
+	if (retcode == JPEG_SUSPENDED)
+	  break;
+	if (retcode == JPEG_SCAN_COMPLETED)
+	  src->scans_done = cinfo->input_scan_number;
+      }
+      if (LJPEG_jpeg_input_complete(cinfo))
+	src->scans_done = cinfo->input_scan_number;
+      if (src->scans_done <= src->scans_shown) {
+	if (! LJPEG_jpeg_input_complete(cinfo))
+	  return event;
+	src->stage = PUSH_FINISH;
+	break;
+      }
+      src->stage = PUSH_BEGIN_OUTPUT;
+      /*FALLTHROUGH*/
+    case PUSH_BEGIN_OUTPUT:
+      if (! LJPEG_jpeg_start_output(cinfo, src->scans_done))
+	return event;
+      src->scans_shown = src->scans_done;
+      src->stage = PUSH_OUTPUT;
+      /*FALLTHROUGH*/
+    case PUSH_OUTPUT:
+      while (cinfo->output_scanline < cinfo->output_height) {
+	if (LJPEG_jpeg_read_scanlines(cinfo, NEXT_OUTPUT_ROWS(src, cinfo),
+				cinfo->output_height - cinfo->output_scanline)
+	    == 0)
+	  return event;
+      }
+      event = JPEG_SCAN_COMPLETED;
+      src->stage = PUSH_END_OUTPUT;
+      /*FALLTHROUGH*/
+    case PUSH_END_OUTPUT:
+      if (! LJPEG_jpeg_finish_output(cinfo))
+	return event;
+      src->stage = PUSH_SCANS;
+      break;
+#endif /* D_MULTISCAN_FILES_SUPPORTED */
+    case PUSH_FINISH:
+      if (! LJPEG_jpeg_finish_decompress(cinfo))
+	return event;
+      src->stage = PUSH_HEADER;	/* ready for another image */
+      return JPEG_REACHED_EOI;
+    default:
+      ERREXIT(cinfo, JERR_NOTIMPL);
+    }
+  }
+}
+
+
+/*
+ * Feed the given data through the decoder, and keep what it leaves over.
+ */
+
+LOCAL(int)
+LJPEG_push_run (LJPEG_j_decompress_ptr cinfo, const JOCTET * data, size_t len)
+{
+  LJPEG_my_push_src_ptr src = (LJPEG_my_push_src_ptr) cinfo->src;
+  int event = JPEG_SUSPENDED;
+  int retcode;
+
+  src->data = data;
+  src->datalen = len;
+  src->datapos = 0;
+
+  if (src->gated) {
+    /* Hold everything, and decode only up to the end of a complete scan */
+    LJPEG_push_hold(cinfo, data, len);
+    src->datapos = len;
+    LJPEG_push_gate(src);
+    if (src->end_of_data)
+      src->gate_safe = src->held;
+    if (src->gate_safe > 0) {
+      src->base = src->buffer;
+      src->baselen = src->gate_safe;
+      src->slice_start = src->held;
+      src->pub.next_input_byte = src->base;
+      src->pub.bytes_in_buffer = src->baselen;
+      event = LJPEG_push_decode(cinfo);
+      LJPEG_push_absorb(cinfo);
+      if (src->stage == PUSH_HEADER)
+	src->gated = FALSE;	/* the image is done */
+    }
+  } else {
+    do {
+      LJPEG_push_present(cinfo);
+      retcode = LJPEG_push_decode(cinfo);
+      LJPEG_push_absorb(cinfo);
+      /* Stop where the application must act, or at the end of the image */
+      if (retcode == JPEG_REACHED_SOS || retcode == JPEG_REACHED_EOI) {
+	event = retcode;
+	break;
+      }
+      if (retcode > event)
+	event = retcode;
+    } while (src->datapos < src->datalen);
+  }
+
+  /* Hold on to whatever is left of the caller's data */
+  if (src->datapos < src->datalen)
+    LJPEG_push_hold(cinfo, data + src->datapos, src->datalen - src->datapos);
+  src->data = NULL;
+  src->datalen = src->datapos = 0;
+  src->pub.next_input_byte = src->buffer;
+  src->pub.bytes_in_buffer = src->held;
+
+  return event;
+}
+
+
+/*
+ * Prepare for push-style decoding.
+ * Call this in place of choosing a data source, before the first LJPEG_jpeg_feed.
+ */
+
+GLOBAL(void)
+LJPEG_jpeg_push_src (LJPEG_j_decompress_ptr cinfo)
+{
+  LJPEG_my_push_src_ptr src;
+
+  if (cinfo->global_state != DSTATE_START)
+    ERREXIT1(cinfo, JERR_BAD_STATE, cinfo->global_state);
+
+  /* The source object is made permanent, like those in jdatasrc.c, and
+   * the same caveat applies to mixing it with other source managers.
+   */
+  if (cinfo->src == NULL) {	/* first time for this JPEG object? */
+    cinfo->src = (struct LJPEG_jpeg_source_mgr *)
+      (*cinfo->mem->LJPEG_alloc_small) ((LJPEG_j_common_ptr) cinfo, JPOOL_PERMANENT,
+				  SIZEOF(LJPEG_my_push_source_mgr));
+    src = (LJPEG_my_push_src_ptr) cinfo->src;
+    src->buffer = NULL;
+    src->bufsize = 0;
+  }
+
+  src = (LJPEG_my_push_src_ptr) cinfo->src;
+  src->pub.LJPEG_init_source = LJPEG_init_push_source;
+  src->pub.LJPEG_fill_input_buffer = LJPEG_fill_push_input_buffer;
+  src->pub.LJPEG_skip_input_data = LJPEG_skip_push_input_data;
+  src->pub.resync_to_restart = LJPEG_jpeg_resync_to_restart; /* use default */
+  src->pub.LJPEG_term_source = LJPEG_term_push_source;
+  src->stage = PUSH_HEADER;
+  src->gated = FALSE;
+  src->image = NULL;
+  src->end_of_data = FALSE;
+  src->held = 0;
+  src->skip_pending = 0;
+  src->data = NULL;
+  src->datalen = src->datapos = 0;
+  src->pub.next_input_byte = src->buffer;
+  src->pub.bytes_in_buffer = 0;
+}
+
+
+/*
+ * Supply the next len bytes of the datastream.
+ * The data need not remain valid after the call returns.  len may be 0:
+ * that decodes the data already held as far as it goes, and then suspends
+ * as usual, since more data may yet come.
+ *
+ * Returns JPEG_SUSPENDED if there is nothing new to report;
+ * JPEG_REACHED_SOS when the header has been read (call LJPEG_jpeg_push_start);
+ * JPEG_ROW_COMPLETED when more rows have been decoded (output_scanline
+ * counts the rows now complete);
+ * JPEG_SCAN_COMPLETED when the whole image has been output again, from
+ * a later scan of a multiscan file (output_scan_number tells which);
+ * JPEG_REACHED_EOI when the image is finished.  The decompression object
+ * is then ready for another image, and data fed after the EOI is kept
+ * for it.  A call never goes past the end of an image, so if a piece may
+ * hold more than one, call again with len = 0 after each JPEG_REACHED_EOI
+ * to decode the rest; otherwise the held data grows with every piece.
+ */
+
+GLOBAL(int)
+LJPEG_jpeg_feed (LJPEG_j_decompress_ptr cinfo, const JOCTET * data, size_t len)
+{
+  LJPEG_my_push_src_ptr src = (LJPEG_my_push_src_ptr) cinfo->src;
+
+  if (src == NULL || src->pub.LJPEG_fill_input_buffer != LJPEG_fill_push_input_buffer)
+    ERREXIT1(cinfo, JERR_BAD_STATE, cinfo->global_state);
+
+  src->end_of_data = FALSE;
+  return LJPEG_push_run(cinfo, data, len);
+}
+
+
+/*
+ * Signal the end of the datastream, and decode whatever is held.
+ * An image that is not complete by then is finished as the stdio source
+ * would finish it, with a warning of premature end of file.
+ * The return value is as for LJPEG_jpeg_feed; JPEG_SUSPENDED here means
+ * that no further image was held.
+ */
+
+GLOBAL(int)
+LJPEG_jpeg_feed_end (LJPEG_j_decompress_ptr cinfo)
+{
+  LJPEG_my_push_src_ptr src = (LJPEG_my_push_src_ptr) cinfo->src;
+
+  if (src == NULL || src->pub.LJPEG_fill_input_buffer != LJPEG_fill_push_input_buffer)
+    ERREXIT1(cinfo, JERR_BAD_STATE, cinfo->global_state);
+
+  src->end_of_data = TRUE;
+  return LJPEG_push_run(cinfo, (const JOCTET *) NULL, (size_t) 0);
+}
+
+
+/*
+ * Begin decompression once the header has been read and the application
+ * has set the decompression parameters.  image must point to output_height
+ * rows of output_width * output_components samples each; call
+ * LJPEG_jpeg_calc_output_dimensions first to learn them.  image may be NULL
+ * if a row listener takes the rows instead.  Multiscan files are
+ * decoded in buffered-image mode, so that image can show each scan as it
+ * is completed.  Data already fed is decoded at once; the return value is
+ * as for LJPEG_jpeg_feed.
+ */
+
+GLOBAL(int)
+LJPEG_jpeg_push_start (LJPEG_j_decompress_ptr cinfo, LJPEG_JSAMPARRAY image)
+{
+  LJPEG_my_push_src_ptr src = (LJPEG_my_push_src_ptr) cinfo->src;
+
+  if (src == NULL || src->pub.LJPEG_fill_input_buffer != LJPEG_fill_push_input_buffer ||
+      src->stage != PUSH_WAIT)
+    ERREXIT1(cinfo, JERR_BAD_STATE, cinfo->global_state);
+
+  src->image = image;
+  src->scans_done = src->scans_shown = 0;
+  /* The decoder stands at the start of the first scan's entropy data */
+  src->gated = cinfo->arith_code;
+  src->gate_state = GATE_ENTROPY;
+  src->gate_pos = src->gate_seg_end = src->gate_safe = 0;
+#ifdef D_MULTISCAN_FILES_SUPPORTED
+  cinfo->buffered_image = LJPEG_jpeg_has_multiple_scans(cinfo);
+#endif
+  src->stage = PUSH_START;
+  return LJPEG_push_run(cinfo, (const JOCTET *) NULL, (size_t) 0);
+}
+
+
+/*
+ * Batch decoding.
+ * Each item's image is read from memory into the item's buffer, one after
+ * another on the same object.  The object is switched to recycling its
+ * IMAGE pool (see jmemmgr.c), so that the images share the memory set up
+ * for the first of them, and the derived Huffman tables and IDCT multiplier
+ * tables are rebuilt only when the tables in the data change.  (The
+ * range-limit table is a shared constant, so it needs no rebuilding.)
+ * Tables loaded before the call, or by an earlier image, carry over as
+ * usual, so abbreviated images may be decoded too.
+ * setup, if not NULL, is called after each header is read to set the
+ * decompression parameters.  Items already marked done are skipped, so
+ * after recovering from an error the same call can simply be repeated.
+ * Returns the number of images decoded.
+ */
+
+GLOBAL(int)
+LJPEG_jpeg_decode_batch (LJPEG_j_decompress_ptr cinfo, LJPEG_jpeg_batch_item * items,
+		   int num_items, LJPEG_jpeg_batch_setup_method setup)
+{
+  LJPEG_jpeg_batch_item * item;
+  LJPEG_JSAMPARRAY rows;
+  size_t row_size, stride;
+  int i, n, num_done = 0;
+
+  cinfo->mem->recycle_image_pool = TRUE;
+  for (i = 0, item = items; i < num_items; i++, item++) {
+    if (item->done)
+      continue;
+    LJPEG_jpeg_mem_src(cinfo, (unsigned char *) item->data, (unsigned long) item->size);
+    cinfo->err->num_warnings = 0;
+    (void) LJPEG_jpeg_read_header(cinfo, TRUE);
+    if (setup != NULL)
+      (*setup) (cinfo, item);
+    LJPEG_jpeg_calc_output_dimensions(cinfo);
+
+    /* Check the buffer before any real work is done */
+    row_size = (size_t) cinfo->output_width * (size_t) cinfo->output_components;
+    stride = item->row_stride != 0 ? item->row_stride : row_size;
+    if (item->buffer == NULL || stride < row_size ||
+	item->buffer_size < row_size ||
+	(item->buffer_size - row_size) / stride <
+	(size_t) cinfo->output_height - 1)
+      ERREXIT(cinfo, JERR_BUFFER_SIZE);
+
+    (void) LJPEG_jpeg_start_decompress(cinfo);
+    rows = (LJPEG_JSAMPARRAY) (*cinfo->mem->LJPEG_alloc_small)
+      ((LJPEG_j_common_ptr) cinfo, JPOOL_IMAGE,
+       (size_t) cinfo->rec_outbuf_height * SIZEOF(LJPEG_JSAMPROW));
+    while (cinfo->output_scanline < cinfo->output_height) {
+      for (n = 0; n < cinfo->rec_outbuf_height &&
+		  cinfo->output_scanline + n < cinfo->output_height; n++)
+	rows[n] = item->buffer + stride * (size_t) (cinfo->output_scanline + n);
+      (void) LJPEG_jpeg_read_scanlines(cinfo, rows, (LJPEG_JDIMENSION) n);
+    }
+    (void) LJPEG_jpeg_finish_decompress(cinfo);
+
+    item->width = cinfo->output_width;
+    item->height = cinfo->output_height;
+    item->components = cinfo->output_components;
+    item->num_warnings = cinfo->err->num_warnings;
+    item->done = TRUE;
+    num_done++;
+  }
+  return num_done;
+}
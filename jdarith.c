@@ -44,6 +44,18 @@ typedef struct {
 
 typedef LJPEG_arith_entropy_decoder * LJPEG_arith_entropy_ptr;
 
+/* Working copy of the decoder registers.
+ * The MCU decoding routines load the registers into a local variable of
+ * this type at the start of each MCU and store them back at its end, so
+ * that the compiler can keep them in machine registers meanwhile.
+ */
+
+typedef struct {
+  INT32 c;			/* C register */
+  INT32 a;			/* A register */
+  int ct;			/* bit shift counter */
+} LJPEG_arith_working_state;
+
 /* The following two definitions specify the allocation chunk size
  * for the statistics area.
  * According to sections F.1.4.4.1.3 and F.1.4.4.2, we need at least
@@ -75,6 +87,79 @@ LJPEG_get_byte (LJPEG_j_decompress_ptr cinfo)
 }
 
 
+LOCAL(int)
+LJPEG_get_data_byte (LJPEG_j_decompress_ptr cinfo)
+/* Read next byte of compressed data, handling stuffed zeroes & markers */
+{
+  int data;
+
+  if (cinfo->unread_marker)
+    return 0;			/* stuff zero data */
+
+  data = LJPEG_get_byte(cinfo);	/* read next input byte */
+  if (data == 0xFF) {		/* zero stuff or marker code */
+    do data = LJPEG_get_byte(cinfo);
+    while (data == 0xFF);	/* swallow extra 0xFF bytes */
+    if (data == 0)
+      data = 0xFF;		/* discard stuffed zero byte */
+    else {
+      /* Note: Different from the Huffman decoder, hitting
+       * a marker while processing the compressed data
+       * segment is legal in arithmetic coding.
+       * The convention is to supply zero data
+       * then until decoding is complete.
+       */
+      cinfo->unread_marker = data;
+      data = 0;
+    }
+  }
+  return data;
+}
+
+
+/*
+ * Load the decoder registers into a working state.
+ * After (re)initialization of the decoder, the C register is filled
+ * with 2 initial bytes here, rather than in LJPEG_arith_decode.
+ */
+
+LOCAL(void)
+LJPEG_load_state (LJPEG_j_decompress_ptr cinfo, LJPEG_arith_working_state * state)
+{
+  LJPEG_arith_entropy_ptr e = (LJPEG_arith_entropy_ptr) cinfo->entropy;
+
+  if (e->ct < 0) {
+    /* Initial data input per section D.2.6 */
+    while (e->a < 0x8000L) {
+      if (--e->ct < 0) {
+	e->c = (e->c << 8) | LJPEG_get_data_byte(cinfo);
+	if ((e->ct += 8) < 0)	 /* update bit shift counter */
+	  /* Need more initial bytes */
+	  if (++e->ct == 0)
+	    /* Got 2 initial bytes -> re-init A and exit loop */
+	    e->a = 0x8000L; /* => e->a = 0x10000L after loop exit */
+      }
+      e->a <<= 1;
+    }
+  }
+
+  state->c = e->c;
+  state->a = e->a;
+  state->ct = e->ct;
+}
+
+
+LOCAL(void)
+LJPEG_save_state (LJPEG_j_decompress_ptr cinfo, LJPEG_arith_working_state * state)
+{
+  LJPEG_arith_entropy_ptr e = (LJPEG_arith_entropy_ptr) cinfo->entropy;
+
+  e->c = state->c;
+  e->a = state->a;
+  e->ct = state->ct;
+}
+
+
 /*
  * The core arithmetic decoding routine (common in JPEG and JBIG).
  * This needs to go as fast as possible.
@@ -97,52 +182,44 @@ LJPEG_get_byte (LJPEG_j_decompress_ptr cinfo)
  * we can get away with any renormalization update
  * of C (except for new data insertion, of course).
  *
+ * For the same reason, data input need not be tested
+ * at each bit of renormalization: we shift A up in a
+ * tight loop, counting the bits, and then fetch as
+ * many data bytes as that count needs.  The byte input, with its 0xFF and marker
+ * handling, is kept out of line, so that this routine
+ * is small enough to be inlined in the MCU decoders
+ * and the registers can be held in a local working
+ * state there instead of in the entropy decoder object.
+ *
  * I've also introduced a new scheme for accessing
  * the probability estimation state machine table,
  * derived from Markus Kuhn's JBIG implementation.
  */
 
+INLINE
 LOCAL(int)
-LJPEG_arith_decode (LJPEG_j_decompress_ptr cinfo, unsigned char *st)
+LJPEG_arith_decode (LJPEG_j_decompress_ptr cinfo,
+		    LJPEG_arith_working_state * e, unsigned char *st)
 {
-  register LJPEG_arith_entropy_ptr e = (LJPEG_arith_entropy_ptr) cinfo->entropy;
   register unsigned char nl, nm;
   register INT32 qe, temp;
-  register int sv, data;
+  register int sv, shift;
 
   /* Renormalization & data input per section D.2.6 */
-  while (e->a < 0x8000L) {
-    if (--e->ct < 0) {
+  if (e->a < 0x8000L) {
+    temp = e->a;
+    shift = 0;
+    do {
+      temp <<= 1;
+      shift++;
+    } while (temp < 0x8000L);
+    e->a = temp;
+    while (e->ct < shift) {
       /* Need to fetch next data byte */
-      if (cinfo->unread_marker)
-	data = 0;		/* stuff zero data */
-      else {
-	data = LJPEG_get_byte(cinfo);	/* read next input byte */
-	if (data == 0xFF) {	/* zero stuff or marker code */
-	  do data = LJPEG_get_byte(cinfo);
-	  while (data == 0xFF);	/* swallow extra 0xFF bytes */
-	  if (data == 0)
-	    data = 0xFF;	/* discard stuffed zero byte */
-	  else {
-	    /* Note: Different from the Huffman decoder, hitting
-	     * a marker while processing the compressed data
-	     * segment is legal in arithmetic coding.
-	     * The convention is to supply zero data
-	     * then until decoding is complete.
-	     */
-	    cinfo->unread_marker = data;
-	    data = 0;
-	  }
-	}
-      }
-      e->c = (e->c << 8) | data; /* insert data into C register */
-      if ((e->ct += 8) < 0)	 /* update bit shift counter */
-	/* Need more initial bytes */
-	if (++e->ct == 0)
-	  /* Got 2 initial bytes -> re-init A and exit loop */
-	  e->a = 0x8000L; /* => e->a = 0x10000L after loop exit */
+      e->c = (e->c << 8) | LJPEG_get_data_byte(cinfo);
+      e->ct += 8;		/* update bit shift counter */
     }
-    e->a <<= 1;
+    e->ct -= shift;
   }
 
   /* Fetch values from our compact representation of Table D.3(D.2):
@@ -187,16 +264,13 @@ LJPEG_arith_decode (LJPEG_j_decompress_ptr cinfo, unsigned char *st)
  */
 
 LOCAL(void)
-LJPEG_process_restart (LJPEG_j_decompress_ptr cinfo)
+LJPEG_reset_decoder (LJPEG_j_decompress_ptr cinfo)
+/* Reset statistics and decoder state for a new restart interval */
 {
   LJPEG_arith_entropy_ptr entropy = (LJPEG_arith_entropy_ptr) cinfo->entropy;
   int ci;
   LJPEG_jpeg_component_info * compptr;
 
-  /* Advance past the RSTn marker */
-  if (! (*cinfo->marker->LJPEG_read_restart_marker) (cinfo))
-    ERREXIT(cinfo, JERR_CANT_SUSPEND);
-
   /* Re-initialize statistics areas */
   for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
     compptr = cinfo->cur_comp_info[ci];
@@ -222,6 +296,17 @@ LJPEG_process_restart (LJPEG_j_decompress_ptr cinfo)
 }
 
 
+LOCAL(void)
+LJPEG_process_restart (LJPEG_j_decompress_ptr cinfo)
+{
+  /* Advance past the RSTn marker */
+  if (! (*cinfo->marker->LJPEG_read_restart_marker) (cinfo))
+    ERREXIT(cinfo, JERR_CANT_SUSPEND);
+
+  LJPEG_reset_decoder(cinfo);
+}
+
+
 /*
  * Arithmetic MCU decoding.
  * Each of these routines decodes and returns one MCU's worth of
@@ -242,6 +327,7 @@ LJPEG_METHODDEF(boolean)
 LJPEG_decode_mcu_DC_first (LJPEG_j_decompress_ptr cinfo, LJPEG_JBLOCKROW *MCU_data)
 {
   LJPEG_arith_entropy_ptr entropy = (LJPEG_arith_entropy_ptr) cinfo->entropy;
+  LJPEG_arith_working_state state;
   LJPEG_JBLOCKROW block;
   unsigned char *st;
   int blkn, ci, tbl, sign;
@@ -256,6 +342,8 @@ LJPEG_decode_mcu_DC_first (LJPEG_j_decompress_ptr cinfo, LJPEG_JBLOCKROW *MCU_da
 
   if (entropy->ct == -1) return TRUE;	/* if error do nothing */
 
+  LJPEG_load_state(cinfo, &state);
+
   /* Outer loop handles each block in the MCU */
 
   for (blkn = 0; blkn < cinfo->blocks_in_MCU; blkn++) {
@@ -269,20 +357,21 @@ LJPEG_decode_mcu_DC_first (LJPEG_j_decompress_ptr cinfo, LJPEG_JBLOCKROW *MCU_da
     st = entropy->dc_stats[tbl] + entropy->dc_context[ci];
 
     /* Figure F.19: Decode_DC_DIFF */
-    if (LJPEG_arith_decode(cinfo, st) == 0)
+    if (LJPEG_arith_decode(cinfo, &state, st) == 0)
       entropy->dc_context[ci] = 0;
     else {
       /* Figure F.21: Decoding nonzero value v */
       /* Figure F.22: Decoding the sign of v */
-      sign = LJPEG_arith_decode(cinfo, st + 1);
+      sign = LJPEG_arith_decode(cinfo, &state, st + 1);
       st += 2; st += sign;
       /* Figure F.23: Decoding the magnitude category of v */
-      if ((m = LJPEG_arith_decode(cinfo, st)) != 0) {
+      if ((m = LJPEG_arith_decode(cinfo, &state, st)) != 0) {
 	st = entropy->dc_stats[tbl] + 20;	/* Table F.4: X1 = 20 */
-	while (LJPEG_arith_decode(cinfo, st)) {
+	while (LJPEG_arith_decode(cinfo, &state, st)) {
 	  if ((m <<= 1) == 0x8000) {
 	    WARNMS(cinfo, JWRN_ARITH_BAD_CODE);
-	    entropy->ct = -1;			/* magnitude overflow */
+	    state.ct = -1;			/* magnitude overflow */
+	    LJPEG_save_state(cinfo, &state);
 	    return TRUE;
 	  }
 	  st += 1;
@@ -299,7 +388,7 @@ LJPEG_decode_mcu_DC_first (LJPEG_j_decompress_ptr cinfo, LJPEG_JBLOCKROW *MCU_da
       /* Figure F.24: Decoding the magnitude bit pattern of v */
       st += 14;
       while (m >>= 1)
-	if (LJPEG_arith_decode(cinfo, st)) v |= m;
+	if (LJPEG_arith_decode(cinfo, &state, st)) v |= m;
       v += 1; if (sign) v = -v;
       entropy->last_dc_val[ci] += v;
     }
@@ -308,6 +397,7 @@ LJPEG_decode_mcu_DC_first (LJPEG_j_decompress_ptr cinfo, LJPEG_JBLOCKROW *MCU_da
     (*block)[0] = (LJPEG_JCOEF) (entropy->last_dc_val[ci] << cinfo->Al);
   }
 
+  LJPEG_save_state(cinfo, &state);
   return TRUE;
 }
 
@@ -321,6 +411,7 @@ LJPEG_METHODDEF(boolean)
 LJPEG_decode_mcu_AC_first (LJPEG_j_decompress_ptr cinfo, LJPEG_JBLOCKROW *MCU_data)
 {
   LJPEG_arith_entropy_ptr entropy = (LJPEG_arith_entropy_ptr) cinfo->entropy;
+  LJPEG_arith_working_state state;
   LJPEG_JBLOCKROW block;
   unsigned char *st;
   int tbl, sign, k;
@@ -336,6 +427,8 @@ LJPEG_decode_mcu_AC_first (LJPEG_j_decompress_ptr cinfo, LJPEG_JBLOCKROW *MCU_da
 
   if (entropy->ct == -1) return TRUE;	/* if error do nothing */
 
+  LJPEG_load_state(cinfo, &state);
+
   natural_order = cinfo->natural_order;
 
   /* There is always only one block per MCU */
@@ -348,31 +441,33 @@ LJPEG_decode_mcu_AC_first (LJPEG_j_decompress_ptr cinfo, LJPEG_JBLOCKROW *MCU_da
   k = cinfo->Ss - 1;
   do {
     st = entropy->ac_stats[tbl] + 3 * k;
-    if (LJPEG_arith_decode(cinfo, st)) break;		/* EOB flag */
+    if (LJPEG_arith_decode(cinfo, &state, st)) break;		/* EOB flag */
     for (;;) {
       k++;
-      if (LJPEG_arith_decode(cinfo, st + 1)) break;
+      if (LJPEG_arith_decode(cinfo, &state, st + 1)) break;
       st += 3;
       if (k >= cinfo->Se) {
 	WARNMS(cinfo, JWRN_ARITH_BAD_CODE);
-	entropy->ct = -1;			/* spectral overflow */
+	state.ct = -1;				/* spectral overflow */
+	LJPEG_save_state(cinfo, &state);
 	return TRUE;
       }
     }
     /* Figure F.21: Decoding nonzero value v */
     /* Figure F.22: Decoding the sign of v */
-    sign = LJPEG_arith_decode(cinfo, entropy->fixed_bin);
+    sign = LJPEG_arith_decode(cinfo, &state, entropy->fixed_bin);
     st += 2;
     /* Figure F.23: Decoding the magnitude category of v */
-    if ((m = LJPEG_arith_decode(cinfo, st)) != 0) {
-      if (LJPEG_arith_decode(cinfo, st)) {
+    if ((m = LJPEG_arith_decode(cinfo, &state, st)) != 0) {
+      if (LJPEG_arith_decode(cinfo, &state, st)) {
 	m <<= 1;
 	st = entropy->ac_stats[tbl] +
 	     (k <= cinfo->arith_ac_K[tbl] ? 189 : 217);
-	while (LJPEG_arith_decode(cinfo, st)) {
+	while (LJPEG_arith_decode(cinfo, &state, st)) {
 	  if ((m <<= 1) == 0x8000) {
 	    WARNMS(cinfo, JWRN_ARITH_BAD_CODE);
-	    entropy->ct = -1;			/* magnitude overflow */
+	    state.ct = -1;			/* magnitude overflow */
+	    LJPEG_save_state(cinfo, &state);
 	    return TRUE;
 	  }
 	  st += 1;
@@ -383,12 +478,13 @@ LJPEG_decode_mcu_AC_first (LJPEG_j_decompress_ptr cinfo, LJPEG_JBLOCKROW *MCU_da
     /* Figure F.24: Decoding the magnitude bit pattern of v */
     st += 14;
     while (m >>= 1)
-      if (LJPEG_arith_decode(cinfo, st)) v |= m;
+      if (LJPEG_arith_decode(cinfo, &state, st)) v |= m;
     v += 1; if (sign) v = -v;
     /* Scale and output coefficient in natural (dezigzagged) order */
     (*block)[natural_order[k]] = (LJPEG_JCOEF) (v << cinfo->Al);
   } while (k < cinfo->Se);
 
+  LJPEG_save_state(cinfo, &state);
   return TRUE;
 }
 
@@ -401,6 +497,7 @@ LJPEG_METHODDEF(boolean)
 LJPEG_decode_mcu_DC_refine (LJPEG_j_decompress_ptr cinfo, LJPEG_JBLOCKROW *MCU_data)
 {
   LJPEG_arith_entropy_ptr entropy = (LJPEG_arith_entropy_ptr) cinfo->entropy;
+  LJPEG_arith_working_state state;
   unsigned char *st;
   int p1, blkn;
 
@@ -411,6 +508,10 @@ LJPEG_decode_mcu_DC_refine (LJPEG_j_decompress_ptr cinfo, LJPEG_JBLOCKROW *MCU_d
     entropy->restarts_to_go--;
   }
 
+  if (entropy->ct == -1) return TRUE;	/* if error do nothing */
+
+  LJPEG_load_state(cinfo, &state);
+
   st = entropy->fixed_bin;	/* use fixed probability estimation */
   p1 = 1 << cinfo->Al;		/* 1 in the bit position being coded */
 
@@ -418,10 +519,11 @@ LJPEG_decode_mcu_DC_refine (LJPEG_j_decompress_ptr cinfo, LJPEG_JBLOCKROW *MCU_d
 
   for (blkn = 0; blkn < cinfo->blocks_in_MCU; blkn++) {
     /* Encoded data is simply the next bit of the two's-complement DC value */
-    if (LJPEG_arith_decode(cinfo, st))
+    if (LJPEG_arith_decode(cinfo, &state, st))
       MCU_data[blkn][0][0] |= p1;
   }
 
+  LJPEG_save_state(cinfo, &state);
   return TRUE;
 }
 
@@ -434,6 +536,7 @@ LJPEG_METHODDEF(boolean)
 LJPEG_decode_mcu_AC_refine (LJPEG_j_decompress_ptr cinfo, LJPEG_JBLOCKROW *MCU_data)
 {
   LJPEG_arith_entropy_ptr entropy = (LJPEG_arith_entropy_ptr) cinfo->entropy;
+  LJPEG_arith_working_state state;
   LJPEG_JBLOCKROW block;
   LJPEG_JCOEFPTR thiscoef;
   unsigned char *st;
@@ -450,6 +553,8 @@ LJPEG_decode_mcu_AC_refine (LJPEG_j_decompress_ptr cinfo, LJPEG_JBLOCKROW *MCU_d
 
   if (entropy->ct == -1) return TRUE;	/* if error do nothing */
 
+  LJPEG_load_state(cinfo, &state);
+
   natural_order = cinfo->natural_order;
 
   /* There is always only one block per MCU */
@@ -469,11 +574,11 @@ LJPEG_decode_mcu_AC_refine (LJPEG_j_decompress_ptr cinfo, LJPEG_JBLOCKROW *MCU_d
   do {
     st = entropy->ac_stats[tbl] + 3 * k;
     if (k >= kex)
-      if (LJPEG_arith_decode(cinfo, st)) break;	/* EOB flag */
+      if (LJPEG_arith_decode(cinfo, &state, st)) break;	/* EOB flag */
     for (;;) {
       thiscoef = *block + natural_order[++k];
       if (*thiscoef) {				/* previously nonzero coef */
-	if (LJPEG_arith_decode(cinfo, st + 2)) {
+	if (LJPEG_arith_decode(cinfo, &state, st + 2)) {
 	  if (*thiscoef < 0)
 	    *thiscoef += m1;
 	  else
@@ -481,8 +586,8 @@ LJPEG_decode_mcu_AC_refine (LJPEG_j_decompress_ptr cinfo, LJPEG_JBLOCKROW *MCU_d
 	}
 	break;
       }
-      if (LJPEG_arith_decode(cinfo, st + 1)) {	/* newly nonzero coef */
-	if (LJPEG_arith_decode(cinfo, entropy->fixed_bin))
+      if (LJPEG_arith_decode(cinfo, &state, st + 1)) {	/* newly nonzero coef */
+	if (LJPEG_arith_decode(cinfo, &state, entropy->fixed_bin))
 	  *thiscoef = m1;
 	else
 	  *thiscoef = p1;
@@ -491,12 +596,14 @@ LJPEG_decode_mcu_AC_refine (LJPEG_j_decompress_ptr cinfo, LJPEG_JBLOCKROW *MCU_d
       st += 3;
       if (k >= cinfo->Se) {
 	WARNMS(cinfo, JWRN_ARITH_BAD_CODE);
-	entropy->ct = -1;			/* spectral overflow */
+	state.ct = -1;				/* spectral overflow */
+	LJPEG_save_state(cinfo, &state);
 	return TRUE;
       }
     }
   } while (k < cinfo->Se);
 
+  LJPEG_save_state(cinfo, &state);
   return TRUE;
 }
 
@@ -509,6 +616,7 @@ LJPEG_METHODDEF(boolean)
 LJPEG_decode_mcu (LJPEG_j_decompress_ptr cinfo, LJPEG_JBLOCKROW *MCU_data)
 {
   LJPEG_arith_entropy_ptr entropy = (LJPEG_arith_entropy_ptr) cinfo->entropy;
+  LJPEG_arith_working_state state;
   LJPEG_jpeg_component_info * compptr;
   LJPEG_JBLOCKROW block;
   unsigned char *st;
@@ -525,6 +633,8 @@ LJPEG_decode_mcu (LJPEG_j_decompress_ptr cinfo, LJPEG_JBLOCKROW *MCU_data)
 
   if (entropy->ct == -1) return TRUE;	/* if error do nothing */
 
+  LJPEG_load_state(cinfo, &state);
+
   natural_order = cinfo->natural_order;
 
   /* Outer loop handles each block in the MCU */
@@ -542,20 +652,21 @@ LJPEG_decode_mcu (LJPEG_j_decompress_ptr cinfo, LJPEG_JBLOCKROW *MCU_data)
     st = entropy->dc_stats[tbl] + entropy->dc_context[ci];
 
     /* Figure F.19: Decode_DC_DIFF */
-    if (LJPEG_arith_decode(cinfo, st) == 0)
+    if (LJPEG_arith_decode(cinfo, &state, st) == 0)
       entropy->dc_context[ci] = 0;
     else {
       /* Figure F.21: Decoding nonzero value v */
       /* Figure F.22: Decoding the sign of v */
-      sign = LJPEG_arith_decode(cinfo, st + 1);
+      sign = LJPEG_arith_decode(cinfo, &state, st + 1);
       st += 2; st += sign;
       /* Figure F.23: Decoding the magnitude category of v */
-      if ((m = LJPEG_arith_decode(cinfo, st)) != 0) {
+      if ((m = LJPEG_arith_decode(cinfo, &state, st)) != 0) {
 	st = entropy->dc_stats[tbl] + 20;	/* Table F.4: X1 = 20 */
-	while (LJPEG_arith_decode(cinfo, st)) {
+	while (LJPEG_arith_decode(cinfo, &state, st)) {
 	  if ((m <<= 1) == 0x8000) {
 	    WARNMS(cinfo, JWRN_ARITH_BAD_CODE);
-	    entropy->ct = -1;			/* magnitude overflow */
+	    state.ct = -1;			/* magnitude overflow */
+	    LJPEG_save_state(cinfo, &state);
 	    return TRUE;
 	  }
 	  st += 1;
@@ -572,7 +683,7 @@ LJPEG_decode_mcu (LJPEG_j_decompress_ptr cinfo, LJPEG_JBLOCKROW *MCU_data)
       /* Figure F.24: Decoding the magnitude bit pattern of v */
       st += 14;
       while (m >>= 1)
-	if (LJPEG_arith_decode(cinfo, st)) v |= m;
+	if (LJPEG_arith_decode(cinfo, &state, st)) v |= m;
       v += 1; if (sign) v = -v;
       entropy->last_dc_val[ci] += v;
     }
@@ -588,31 +699,33 @@ LJPEG_decode_mcu (LJPEG_j_decompress_ptr cinfo, LJPEG_JBLOCKROW *MCU_data)
     /* Figure F.20: Decode_AC_coefficients */
     do {
       st = entropy->ac_stats[tbl] + 3 * k;
-      if (LJPEG_arith_decode(cinfo, st)) break;	/* EOB flag */
+      if (LJPEG_arith_decode(cinfo, &state, st)) break;	/* EOB flag */
       for (;;) {
 	k++;
-	if (LJPEG_arith_decode(cinfo, st + 1)) break;
+	if (LJPEG_arith_decode(cinfo, &state, st + 1)) break;
 	st += 3;
 	if (k >= cinfo->lim_Se) {
 	  WARNMS(cinfo, JWRN_ARITH_BAD_CODE);
-	  entropy->ct = -1;			/* spectral overflow */
+	  state.ct = -1;			/* spectral overflow */
+	  LJPEG_save_state(cinfo, &state);
 	  return TRUE;
 	}
       }
       /* Figure F.21: Decoding nonzero value v */
       /* Figure F.22: Decoding the sign of v */
-      sign = LJPEG_arith_decode(cinfo, entropy->fixed_bin);
+      sign = LJPEG_arith_decode(cinfo, &state, entropy->fixed_bin);
       st += 2;
       /* Figure F.23: Decoding the magnitude category of v */
-      if ((m = LJPEG_arith_decode(cinfo, st)) != 0) {
-	if (LJPEG_arith_decode(cinfo, st)) {
+      if ((m = LJPEG_arith_decode(cinfo, &state, st)) != 0) {
+	if (LJPEG_arith_decode(cinfo, &state, st)) {
 	  m <<= 1;
 	  st = entropy->ac_stats[tbl] +
 	       (k <= cinfo->arith_ac_K[tbl] ? 189 : 217);
-	  while (LJPEG_arith_decode(cinfo, st)) {
+	  while (LJPEG_arith_decode(cinfo, &state, st)) {
 	    if ((m <<= 1) == 0x8000) {
 	      WARNMS(cinfo, JWRN_ARITH_BAD_CODE);
-	      entropy->ct = -1;			/* magnitude overflow */
+	      state.ct = -1;			/* magnitude overflow */
+	      LJPEG_save_state(cinfo, &state);
 	      return TRUE;
 	    }
 	    st += 1;
@@ -623,12 +736,13 @@ LJPEG_decode_mcu (LJPEG_j_decompress_ptr cinfo, LJPEG_JBLOCKROW *MCU_data)
       /* Figure F.24: Decoding the magnitude bit pattern of v */
       st += 14;
       while (m >>= 1)
-	if (LJPEG_arith_decode(cinfo, st)) v |= m;
+	if (LJPEG_arith_decode(cinfo, &state, st)) v |= m;
       v += 1; if (sign) v = -v;
       (*block)[natural_order[k]] = (LJPEG_JCOEF) v;
     } while (k < cinfo->lim_Se);
   }
 
+  LJPEG_save_state(cinfo, &state);
   return TRUE;
 }
 
@@ -743,6 +857,74 @@ LJPEG_start_pass (LJPEG_j_decompress_ptr cinfo)
 }
 
 
+/*
+ * Start-of-interval setup for an interval decoder (see below).
+ * The scan parameters were already validated by the master decoder's
+ * start_pass, so we just select the MCU decoding routine and reset
+ * the decoder state, as at a restart marker.
+ */
+
+LJPEG_METHODDEF(void)
+LJPEG_start_interval (LJPEG_j_decompress_ptr cinfo)
+{
+  LJPEG_arith_entropy_ptr entropy = (LJPEG_arith_entropy_ptr) cinfo->entropy;
+
+  if (cinfo->progressive_mode) {
+    if (cinfo->Ah == 0) {
+      if (cinfo->Ss == 0)
+	entropy->pub.LJPEG_decode_mcu = LJPEG_decode_mcu_DC_first;
+      else
+	entropy->pub.LJPEG_decode_mcu = LJPEG_decode_mcu_AC_first;
+    } else {
+      if (cinfo->Ss == 0)
+	entropy->pub.LJPEG_decode_mcu = LJPEG_decode_mcu_DC_refine;
+      else
+	entropy->pub.LJPEG_decode_mcu = LJPEG_decode_mcu_AC_refine;
+    }
+  } else
+    entropy->pub.LJPEG_decode_mcu = LJPEG_decode_mcu;
+
+  LJPEG_reset_decoder(cinfo);
+}
+
+
+/*
+ * Module initialization routine for an interval decoder.
+ *
+ * Since the statistics are reset at each restart marker, the restart
+ * intervals of a scan can be decoded independently.  The coefficient
+ * controller does this with private copies of the decompression object,
+ * each of which gets its own arithmetic decoder from this routine.
+ * Its start_pass method begins a new interval of the current scan;
+ * the decoder never sees the restart markers themselves.
+ * All statistics areas are allocated here, so that start_pass need not
+ * call the memory manager.
+ */
+
+GLOBAL(void)
+LJPEG_jinit_arith_interval_decoder (LJPEG_j_decompress_ptr cinfo)
+{
+  LJPEG_arith_entropy_ptr entropy;
+  int i;
+
+  entropy = (LJPEG_arith_entropy_ptr)
+    (*cinfo->mem->LJPEG_alloc_small) ((LJPEG_j_common_ptr) cinfo, JPOOL_IMAGE,
+				SIZEOF(LJPEG_arith_entropy_decoder));
+  cinfo->entropy = &entropy->pub;
+  entropy->pub.LJPEG_start_pass = LJPEG_start_interval;
+
+  for (i = 0; i < NUM_ARITH_TBLS; i++) {
+    entropy->dc_stats[i] = (unsigned char *) (*cinfo->mem->LJPEG_alloc_small)
+      ((LJPEG_j_common_ptr) cinfo, JPOOL_IMAGE, DC_STAT_BINS);
+    entropy->ac_stats[i] = (unsigned char *) (*cinfo->mem->LJPEG_alloc_small)
+      ((LJPEG_j_common_ptr) cinfo, JPOOL_IMAGE, AC_STAT_BINS);
+  }
+
+  /* Initialize index for fixed probability estimation */
+  entropy->fixed_bin[0] = 113;
+}
+
+
 /*
  * Module initialization routine for arithmetic entropy decoding.
  */
@@ -7,7 +7,8 @@
  * For conditions of distribution and use, see the accompanying README file.
  *
  * This file contains compression data destination routines for the case of
- * emitting JPEG data to memory or to a file (or any stdio stream).
+ * emitting JPEG data to memory or to a file (or any stdio stream), and for
+ * scattering it over a list of fixed-size buffers supplied by the caller.
  * While these routines are sufficient for most applications,
  * some will want to use a different destination manager.
  * IMPORTANT: we assume that fwrite() will correctly transcribe an array of
@@ -22,6 +23,7 @@
 
 #ifndef HAVE_STDLIB_H		/* <stdlib.h> should declare malloc(),free() */
 extern void * malloc LJPEG_JPP((size_t size));
+extern void * realloc LJPEG_JPP((void *ptr, size_t size));
 extern void free LJPEG_JPP((void *ptr));
 #endif
 
@@ -50,11 +52,28 @@ typedef struct {
   unsigned char * newbuffer;	/* newly allocated buffer */
   JOCTET * buffer;		/* start of buffer */
   size_t bufsize;
+  /* Used only by LJPEG_jpeg_mem_dest_alloc: */
+  struct LJPEG_jpeg_buffer_allocator * allocator; /* NULL to use realloc() */
+  size_t size_hint;		/* initial buffer size, or 0 to estimate */
 } LJPEG_my_mem_destination_mgr;
 
 typedef LJPEG_my_mem_destination_mgr * LJPEG_my_mem_dest_ptr;
 
 
+/* Expanded data destination object for scatter output */
+
+typedef struct {
+  struct LJPEG_jpeg_destination_mgr pub; /* public fields */
+
+  LJPEG_jpeg_output_chunk * chunks;	/* caller's list of buffers */
+  int num_chunks;
+  int cur_chunk;		/* index of the chunk being filled */
+  JOCTET spare;			/* stand-in once the last chunk is full */
+} LJPEG_my_scatter_destination_mgr;
+
+typedef LJPEG_my_scatter_destination_mgr * LJPEG_my_scatter_dest_ptr;
+
+
 /*
  * Initialize destination --- called by LJPEG_jpeg_start_compress
  * before any data is actually written.
@@ -81,6 +100,101 @@ LJPEG_init_mem_destination (LJPEG_j_compress_ptr cinfo)
 }
 
 
+/* Point the destination at the first nonempty chunk from index start on.
+ * If there is none, point it at the spare byte: it is an error to write
+ * into that, but not to fill the last chunk exactly.
+ */
+
+LOCAL(void)
+LJPEG_next_scatter_chunk (LJPEG_my_scatter_dest_ptr dest, int start)
+{
+  for (dest->cur_chunk = start; dest->cur_chunk < dest->num_chunks;
+       dest->cur_chunk++) {
+    if (dest->chunks[dest->cur_chunk].size > 0) {
+      dest->pub.next_output_byte = dest->chunks[dest->cur_chunk].buffer;
+      dest->pub.free_in_buffer = dest->chunks[dest->cur_chunk].size;
+      return;
+    }
+  }
+  dest->pub.next_output_byte = &dest->spare;
+  dest->pub.free_in_buffer = 1;
+}
+
+
+/*
+ * Guess the size of the compressed image, for LJPEG_jpeg_mem_dest_alloc.
+ * The ratio of raw to compressed size is taken as 4 plus a quarter of the
+ * mean luminance quantizer, which is about right for photographic images
+ * from quality 10 to 100.  A bad guess costs at most a few reallocations.
+ */
+
+LOCAL(size_t)
+LJPEG_estimate_output_size (LJPEG_j_compress_ptr cinfo)
+{
+  LJPEG_JQUANT_TBL * qtbl = cinfo->quant_tbl_ptrs[0];
+  double raw, ratio;
+  long qsum;
+  int i;
+
+  raw = (double) cinfo->image_width * (double) cinfo->image_height *
+	(double) cinfo->num_components;
+  ratio = 8.0;			/* if no table yet, assume quality 75 */
+  if (qtbl != NULL) {
+    qsum = 0;
+    for (i = 0; i < DCTSIZE2; i++)
+      qsum += qtbl->quantval[i];
+    ratio = 4.0 + (double) qsum / (4.0 * DCTSIZE2);
+  }
+  raw = raw / ratio + 1024.0;	/* allow for the headers and tables */
+  if (raw > (double) (((size_t) -1) >> 2))
+    return ((size_t) -1) >> 2;
+  return (size_t) raw;
+}
+
+LJPEG_METHODDEF(void)
+LJPEG_init_alloc_mem_destination (LJPEG_j_compress_ptr cinfo)
+{
+  LJPEG_my_mem_dest_ptr dest = (LJPEG_my_mem_dest_ptr) cinfo->dest;
+  size_t size;
+  void * buffer;
+
+  if (*dest->outbuffer != NULL && *dest->outsize != 0) {
+    /* Use (and later resize) the caller's buffer */
+    dest->buffer = *dest->outbuffer;
+    dest->bufsize = (size_t) *dest->outsize;
+  } else {
+    size = dest->size_hint;
+    if (size == 0)
+      size = LJPEG_estimate_output_size(cinfo);
+    if (size < OUTPUT_BUF_SIZE)
+      size = OUTPUT_BUF_SIZE;
+    if (dest->allocator != NULL)
+      buffer = (*dest->allocator->realloc_buffer) (dest->allocator,
+						   (void *) NULL, size);
+    else
+      buffer = malloc(size);
+    if (buffer == NULL)
+      ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 10);
+    *dest->outbuffer = dest->buffer = (JOCTET *) buffer;
+    dest->bufsize = size;
+  }
+
+  dest->pub.next_output_byte = dest->buffer;
+  dest->pub.free_in_buffer = dest->bufsize;
+}
+
+LJPEG_METHODDEF(void)
+LJPEG_init_scatter_destination (LJPEG_j_compress_ptr cinfo)
+{
+  LJPEG_my_scatter_dest_ptr dest = (LJPEG_my_scatter_dest_ptr) cinfo->dest;
+  int i;
+
+  for (i = 0; i < dest->num_chunks; i++)
+    dest->chunks[i].used = 0;
+  LJPEG_next_scatter_chunk(dest, 0);
+}
+
+
 /*
  * Empty the output buffer --- called whenever buffer fills up.
  *
@@ -128,15 +242,17 @@ LJPEG_empty_mem_output_buffer (LJPEG_j_compress_ptr cinfo)
 
   /* Try to allocate new buffer with double size */
   nextsize = dest->bufsize * 2;
-  nextbuffer = (JOCTET *) malloc(nextsize);
-
-  if (nextbuffer == NULL)
-    ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 10);
-
-  MEMCOPY(nextbuffer, dest->buffer, dest->bufsize);
-
-  if (dest->newbuffer != NULL)
-    free(dest->newbuffer);
+  if (dest->newbuffer != NULL) {
+    /* Our own buffer: realloc() may be able to extend it in place */
+    nextbuffer = (JOCTET *) realloc(dest->newbuffer, nextsize);
+    if (nextbuffer == NULL)
+      ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 10);
+  } else {
+    nextbuffer = (JOCTET *) malloc(nextsize);
+    if (nextbuffer == NULL)
+      ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 10);
+    MEMCOPY(nextbuffer, dest->buffer, dest->bufsize);
+  }
 
   dest->newbuffer = nextbuffer;
 
@@ -149,6 +265,52 @@ LJPEG_empty_mem_output_buffer (LJPEG_j_compress_ptr cinfo)
   return TRUE;
 }
 
+LJPEG_METHODDEF(boolean)
+LJPEG_empty_alloc_mem_output_buffer (LJPEG_j_compress_ptr cinfo)
+{
+  size_t nextsize;
+  void * nextbuffer;
+  LJPEG_my_mem_dest_ptr dest = (LJPEG_my_mem_dest_ptr) cinfo->dest;
+
+  /* Double the buffer; the allocator copies the data if it has to move it */
+  nextsize = dest->bufsize * 2;
+  if (dest->allocator != NULL)
+    nextbuffer = (*dest->allocator->realloc_buffer) (dest->allocator,
+						     (void *) dest->buffer,
+						     nextsize);
+  else
+    nextbuffer = realloc((void *) dest->buffer, nextsize);
+
+  if (nextbuffer == NULL)
+    ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 10);
+
+  /* Keep the caller's pointer valid, so the buffer can be freed on error */
+  *dest->outbuffer = dest->buffer = (JOCTET *) nextbuffer;
+
+  dest->pub.next_output_byte = dest->buffer + dest->bufsize;
+  dest->pub.free_in_buffer = nextsize - dest->bufsize;
+
+  dest->bufsize = nextsize;
+
+  return TRUE;
+}
+
+LJPEG_METHODDEF(boolean)
+LJPEG_empty_scatter_output_buffer (LJPEG_j_compress_ptr cinfo)
+{
+  LJPEG_my_scatter_dest_ptr dest = (LJPEG_my_scatter_dest_ptr) cinfo->dest;
+
+  /* Data written to the spare byte means the chunks were too small */
+  if (dest->cur_chunk >= dest->num_chunks)
+    ERREXIT(cinfo, JERR_BUFFER_SIZE);
+
+  /* The current chunk is full; move on to the next nonempty one */
+  dest->chunks[dest->cur_chunk].used = dest->chunks[dest->cur_chunk].size;
+  LJPEG_next_scatter_chunk(dest, dest->cur_chunk + 1);
+
+  return TRUE;
+}
+
 
 /*
  * Terminate destination --- called by LJPEG_jpeg_finish_compress
@@ -185,6 +347,16 @@ LJPEG_term_mem_destination (LJPEG_j_compress_ptr cinfo)
   *dest->outsize = dest->bufsize - dest->pub.free_in_buffer;
 }
 
+LJPEG_METHODDEF(void)
+LJPEG_term_scatter_destination (LJPEG_j_compress_ptr cinfo)
+{
+  LJPEG_my_scatter_dest_ptr dest = (LJPEG_my_scatter_dest_ptr) cinfo->dest;
+
+  if (dest->cur_chunk < dest->num_chunks)
+    dest->chunks[dest->cur_chunk].used =
+      dest->chunks[dest->cur_chunk].size - dest->pub.free_in_buffer;
+}
+
 
 /*
  * Prepare for output to a stdio stream.
@@ -268,3 +440,81 @@ LJPEG_jpeg_mem_dest (LJPEG_j_compress_ptr cinfo,
   dest->pub.next_output_byte = dest->buffer = *outbuffer;
   dest->pub.free_in_buffer = dest->bufsize = *outsize;
 }
+
+
+/*
+ * Prepare for output to a memory buffer that can be sized in advance.
+ * This is like LJPEG_jpeg_mem_dest, but the buffer is obtained from the
+ * given allocator (or malloc/realloc if allocator is NULL), and enlarged by
+ * resizing it rather than by copying it to a new buffer.  If the caller
+ * passes in a buffer, it must have come from the same allocator, since it
+ * may be resized.  Otherwise the first buffer is allocated at the start of
+ * compression, with size_hint bytes or, if that is 0, an estimate based on
+ * the image size and quantization tables.  *outbuffer always points to the
+ * current buffer, which the application must free even after an error.
+ */
+
+GLOBAL(void)
+LJPEG_jpeg_mem_dest_alloc (LJPEG_j_compress_ptr cinfo,
+		     unsigned char ** outbuffer, unsigned long * outsize,
+		     size_t size_hint,
+		     struct LJPEG_jpeg_buffer_allocator * allocator)
+{
+  LJPEG_my_mem_dest_ptr dest;
+
+  if (outbuffer == NULL || outsize == NULL)	/* sanity check */
+    ERREXIT(cinfo, JERR_BUFFER_SIZE);
+
+  /* The destination object is the same size as LJPEG_jpeg_mem_dest's,
+   * so the two can be used with the same JPEG object in any order.
+   */
+  if (cinfo->dest == NULL) {	/* first time for this JPEG object? */
+    cinfo->dest = (struct LJPEG_jpeg_destination_mgr *)
+      (*cinfo->mem->LJPEG_alloc_small) ((LJPEG_j_common_ptr) cinfo, JPOOL_PERMANENT,
+				  SIZEOF(LJPEG_my_mem_destination_mgr));
+  }
+
+  dest = (LJPEG_my_mem_dest_ptr) cinfo->dest;
+  dest->pub.LJPEG_init_destination = LJPEG_init_alloc_mem_destination;
+  dest->pub.LJPEG_empty_output_buffer = LJPEG_empty_alloc_mem_output_buffer;
+  dest->pub.LJPEG_term_destination = LJPEG_term_mem_destination;
+  dest->outbuffer = outbuffer;
+  dest->outsize = outsize;
+  dest->newbuffer = NULL;
+  dest->allocator = allocator;
+  dest->size_hint = size_hint;
+}
+
+
+/*
+ * Prepare for output to a list of fixed-size buffers.
+ * The compressed data fills the buffers in order; at the end of
+ * compression each buffer's "used" field tells how much of it was filled.
+ * The library never allocates or frees the buffers.  If they fill up
+ * before the image is complete, compression fails with JERR_BUFFER_SIZE.
+ * The list must remain valid until LJPEG_jpeg_finish_compress has returned.
+ */
+
+GLOBAL(void)
+LJPEG_jpeg_scatter_dest (LJPEG_j_compress_ptr cinfo,
+		   LJPEG_jpeg_output_chunk * chunks, int num_chunks)
+{
+  LJPEG_my_scatter_dest_ptr dest;
+
+  if (chunks == NULL || num_chunks <= 0)	/* sanity check */
+    ERREXIT(cinfo, JERR_BUFFER_SIZE);
+
+  /* The same caveat applies as for LJPEG_jpeg_stdio_dest. */
+  if (cinfo->dest == NULL) {	/* first time for this JPEG object? */
+    cinfo->dest = (struct LJPEG_jpeg_destination_mgr *)
+      (*cinfo->mem->LJPEG_alloc_small) ((LJPEG_j_common_ptr) cinfo, JPOOL_PERMANENT,
+				  SIZEOF(LJPEG_my_scatter_destination_mgr));
+  }
+
+  dest = (LJPEG_my_scatter_dest_ptr) cinfo->dest;
+  dest->pub.LJPEG_init_destination = LJPEG_init_scatter_destination;
+  dest->pub.LJPEG_empty_output_buffer = LJPEG_empty_scatter_output_buffer;
+  dest->pub.LJPEG_term_destination = LJPEG_term_scatter_destination;
+  dest->chunks = chunks;
+  dest->num_chunks = num_chunks;
+}
@@ -8,6 +8,9 @@
  *
  * This file contains decompression data source routines for the case of
  * reading JPEG data from memory or from a file (or any stdio stream).
+ * A file can also be read through a memory mapping, where the system
+ * supports mmap() (define HAVE_MMAP), and data in memory need not be
+ * contiguous: it can be gathered from a list of separate buffers.
  * While these routines are sufficient for most applications,
  * some will want to use a different source manager.
  * IMPORTANT: we assume that fread() will correctly transcribe an array of
@@ -20,6 +23,12 @@
 #include "jpeglib.h"
 #include "jerror.h"
 
+#ifdef HAVE_MMAP
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
 
 /* Expanded data source object for stdio input */
 
@@ -29,6 +38,9 @@ typedef struct {
   FILE * infile;		/* source stream */
   JOCTET * buffer;		/* start of buffer */
   boolean start_of_file;	/* have we gotten any data yet? */
+
+  void * mapped_address;	/* mapping made by LJPEG_jpeg_mmap_src, or NULL */
+  size_t mapped_size;		/* length of the mapping */
 } LJPEG_my_source_mgr;
 
 typedef LJPEG_my_source_mgr * LJPEG_my_src_ptr;
@@ -36,6 +48,19 @@ typedef LJPEG_my_source_mgr * LJPEG_my_src_ptr;
 #define INPUT_BUF_SIZE  4096	/* choose an efficiently fread'able size */
 
 
+/* Expanded data source object for input from a list of buffers */
+
+typedef struct {
+  struct LJPEG_jpeg_source_mgr pub;	/* public fields */
+
+  const LJPEG_jpeg_input_chunk * chunks; /* caller's list of buffers */
+  int num_chunks;
+  int next_chunk;		/* index of the next chunk to hand over */
+} LJPEG_my_gather_source_mgr;
+
+typedef LJPEG_my_gather_source_mgr * LJPEG_my_gather_src_ptr;
+
+
 /*
  * Initialize source --- called by LJPEG_jpeg_read_header
  * before any data is actually read.
@@ -56,7 +81,16 @@ LJPEG_init_source (LJPEG_j_decompress_ptr cinfo)
 LJPEG_METHODDEF(void)
 LJPEG_init_mem_source (LJPEG_j_decompress_ptr cinfo)
 {
-  /* no work necessary here */
+  /* The buffer is the whole rest of the stream; the library may read it
+   * without watching for suspension.
+   */
+  cinfo->src->resident = TRUE;
+}
+
+LJPEG_METHODDEF(void)
+LJPEG_init_gather_source (LJPEG_j_decompress_ptr cinfo)
+{
+  /* no work necessary here; the buffer holds only part of the data */
 }
 
 
@@ -139,6 +173,29 @@ LJPEG_fill_mem_input_buffer (LJPEG_j_decompress_ptr cinfo)
   return TRUE;
 }
 
+LJPEG_METHODDEF(boolean)
+LJPEG_fill_gather_input_buffer (LJPEG_j_decompress_ptr cinfo)
+{
+  LJPEG_my_gather_src_ptr src = (LJPEG_my_gather_src_ptr) cinfo->src;
+  const LJPEG_jpeg_input_chunk * chunk;
+
+  /* Hand over the next nonempty chunk as it stands, without copying.
+   * Markers and stuffed bytes that straddle two chunks are no problem:
+   * the library reads them a byte at a time across refills.
+   */
+  while (src->next_chunk < src->num_chunks) {
+    chunk = &src->chunks[src->next_chunk++];
+    if (chunk->size > 0) {
+      src->pub.next_input_byte = chunk->buffer;
+      src->pub.bytes_in_buffer = chunk->size;
+      return TRUE;
+    }
+  }
+
+  /* Out of chunks: same treatment as the end of a memory buffer */
+  return LJPEG_fill_mem_input_buffer(cinfo);
+}
+
 
 /*
  * Skip data --- used to skip over a potentially large amount of
@@ -199,6 +256,22 @@ LJPEG_term_source (LJPEG_j_decompress_ptr cinfo)
   /* no work necessary here */
 }
 
+#ifdef HAVE_MMAP
+
+LJPEG_METHODDEF(void)
+LJPEG_term_mmap_source (LJPEG_j_decompress_ptr cinfo)
+{
+  LJPEG_my_src_ptr src = (LJPEG_my_src_ptr) cinfo->src;
+
+  if (src->mapped_address != NULL) {
+    (void) munmap(src->mapped_address, src->mapped_size);
+    src->mapped_address = NULL;
+  }
+  src->pub.bytes_in_buffer = 0;
+}
+
+#endif /* HAVE_MMAP */
+
 
 /*
  * Prepare for input from a stdio stream.
@@ -226,6 +299,7 @@ LJPEG_jpeg_stdio_src (LJPEG_j_decompress_ptr cinfo, FILE * infile)
     src->buffer = (JOCTET *)
       (*cinfo->mem->LJPEG_alloc_small) ((LJPEG_j_common_ptr) cinfo, JPOOL_PERMANENT,
 				  INPUT_BUF_SIZE * SIZEOF(JOCTET));
+    src->mapped_address = NULL;
   }
 
   src = (LJPEG_my_src_ptr) cinfo->src;
@@ -240,6 +314,72 @@ LJPEG_jpeg_stdio_src (LJPEG_j_decompress_ptr cinfo, FILE * infile)
 }
 
 
+/*
+ * Prepare for input from a file through a memory mapping.
+ * The rest of the file from the stream's current position is mapped and
+ * handed to the decompressor as a single buffer, as LJPEG_jpeg_mem_src does,
+ * so the data is neither read in pieces nor copied.  The kernel is told
+ * that the mapping will be read sequentially, and soon.  The stream's
+ * position is not moved.  If the stream cannot be mapped (for instance,
+ * it is a pipe, or mmap() is not available), this is the same as
+ * LJPEG_jpeg_stdio_src.
+ * The mapping is released by LJPEG_term_source, that is by
+ * LJPEG_jpeg_finish_decompress; an application that abandons an image must
+ * call (*cinfo->src->LJPEG_term_source) itself.  The caller must have opened
+ * the stream and still closes it afterwards; the mapping does not need it
+ * to stay open.
+ */
+
+GLOBAL(void)
+LJPEG_jpeg_mmap_src (LJPEG_j_decompress_ptr cinfo, FILE * infile)
+{
+#ifdef HAVE_MMAP
+  LJPEG_my_src_ptr src;
+  struct stat st;
+  long offset;
+  void * address;
+
+  /* Give up any mapping left from an abandoned image.  The source may
+   * have been set up by another routine, in which case it is none of ours.
+   */
+  if (cinfo->src != NULL &&
+      cinfo->src->LJPEG_term_source == LJPEG_term_mmap_source)
+    LJPEG_term_mmap_source(cinfo);
+#endif
+
+  /* Set up for stdio input, which is also the fallback */
+  LJPEG_jpeg_stdio_src(cinfo, infile);
+
+#ifdef HAVE_MMAP
+  src = (LJPEG_my_src_ptr) cinfo->src;
+  if (fstat(fileno(infile), &st) != 0 || ! S_ISREG(st.st_mode))
+    return;
+  offset = ftell(infile);	/* this accounts for stdio's buffering */
+  if (offset < 0 || (long) st.st_size <= offset ||
+      (off_t) (size_t) st.st_size != st.st_size)
+    return;			/* empty is reported by the stdio code */
+  address = mmap((void *) NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE,
+		 fileno(infile), (off_t) 0);
+  if (address == MAP_FAILED)
+    return;
+#ifdef MADV_SEQUENTIAL
+  (void) madvise(address, (size_t) st.st_size, MADV_SEQUENTIAL);
+#endif
+#ifdef MADV_WILLNEED
+  (void) madvise(address, (size_t) st.st_size, MADV_WILLNEED);
+#endif
+
+  src->mapped_address = address;
+  src->mapped_size = (size_t) st.st_size;
+  src->pub.LJPEG_init_source = LJPEG_init_mem_source;
+  src->pub.LJPEG_fill_input_buffer = LJPEG_fill_mem_input_buffer;
+  src->pub.LJPEG_term_source = LJPEG_term_mmap_source;
+  src->pub.next_input_byte = (const JOCTET *) address + offset;
+  src->pub.bytes_in_buffer = (size_t) (st.st_size - offset);
+#endif /* HAVE_MMAP */
+}
+
+
 /*
  * Prepare for input from a supplied memory buffer.
  * The buffer must contain the whole JPEG data.
@@ -273,3 +413,48 @@ LJPEG_jpeg_mem_src (LJPEG_j_decompress_ptr cinfo,
   src->bytes_in_buffer = (size_t) insize;
   src->next_input_byte = (JOCTET *) inbuffer;
 }
+
+
+/*
+ * Prepare for input from a list of memory buffers, such as the receive
+ * buffers of a network connection, which together hold the JPEG data.
+ * The buffers are read in place, in order; empty ones are skipped.
+ * As with LJPEG_jpeg_mem_src, a series of images can be read by calling this
+ * only before the first one.  The list and the buffers must remain valid
+ * until the last image has been read.
+ */
+
+GLOBAL(void)
+LJPEG_jpeg_gather_src (LJPEG_j_decompress_ptr cinfo,
+		 const LJPEG_jpeg_input_chunk * chunks, int num_chunks)
+{
+  LJPEG_my_gather_src_ptr src;
+  int i;
+
+  if (chunks == NULL)		/* Treat empty input as fatal error */
+    ERREXIT(cinfo, JERR_INPUT_EMPTY);
+  for (i = 0; i < num_chunks; i++)
+    if (chunks[i].size > 0)
+      break;
+  if (i >= num_chunks)
+    ERREXIT(cinfo, JERR_INPUT_EMPTY);
+
+  /* The same caveat applies as for LJPEG_jpeg_stdio_src. */
+  if (cinfo->src == NULL) {	/* first time for this JPEG object? */
+    cinfo->src = (struct LJPEG_jpeg_source_mgr *)
+      (*cinfo->mem->LJPEG_alloc_small) ((LJPEG_j_common_ptr) cinfo, JPOOL_PERMANENT,
+				  SIZEOF(LJPEG_my_gather_source_mgr));
+  }
+
+  src = (LJPEG_my_gather_src_ptr) cinfo->src;
+  src->pub.LJPEG_init_source = LJPEG_init_gather_source;
+  src->pub.LJPEG_fill_input_buffer = LJPEG_fill_gather_input_buffer;
+  src->pub.LJPEG_skip_input_data = LJPEG_skip_input_data;
+  src->pub.resync_to_restart = LJPEG_jpeg_resync_to_restart; /* use default */
+  src->pub.LJPEG_term_source = LJPEG_term_source;
+  src->chunks = chunks;
+  src->num_chunks = num_chunks;
+  src->next_chunk = 0;
+  src->pub.bytes_in_buffer = 0;	/* forces fill_input_buffer on first read */
+  src->pub.next_input_byte = NULL;
+}
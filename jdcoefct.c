@@ -24,6 +24,55 @@
 #undef BLOCK_SMOOTHING_SUPPORTED
 #endif
 
+#ifdef D_MULTISCAN_FILES_SUPPORTED
+
+/* Parallel decoding of restart intervals (see consume_data_parallel).
+ * The entropy-coded data of a scan is kept in a list of chunks, each
+ * followed by its data bytes.  The chunks are kept for later scans, and
+ * a new one, twice the size of the last, is added only when a scan needs
+ * more room, so the data is never copied once read.
+ */
+
+typedef struct LJPEG_scan_data_chunk_struct * LJPEG_scan_data_chunk_ptr;
+
+typedef struct LJPEG_scan_data_chunk_struct {
+  LJPEG_scan_data_chunk_ptr next; /* next chunk, or NULL */
+  size_t start;			/* offset of its first byte in the scan data */
+  size_t size;			/* # of data bytes the chunk can hold */
+} LJPEG_scan_data_chunk;
+
+#define SCAN_CHUNK_DATA(chunk)  ((JOCTET *) ((chunk) + 1))
+
+/* Private source reading a span of the scan data */
+
+typedef struct {
+  struct LJPEG_jpeg_source_mgr pub; /* public fields */
+
+  LJPEG_scan_data_chunk_ptr chunk; /* chunk holding the current buffer */
+  size_t bytes_left;		/* # of bytes of the span after the buffer */
+} LJPEG_my_scan_source_mgr;
+
+/* Each task decodes a run of consecutive intervals, using a private copy
+ * of the decompression object with its own entropy decoder, source and
+ * error manager.
+ */
+
+typedef struct {
+  struct LJPEG_jpeg_decompress_struct cinfo; /* private copy for this task */
+  LJPEG_my_scan_source_mgr src;	/* private source for the intervals */
+  LJPEG_jpeg_task_error_mgr err; /* private error manager */
+  struct LJPEG_jpeg_entropy_decoder * entropy; /* private interval decoder */
+  LJPEG_JBLOCKROW MCU_buffer[D_MAX_BLOCKS_IN_MCU];
+  int first_interval;		/* intervals to decode: first, */
+  int end_interval;		/* and one past the last */
+} LJPEG_my_interval_task;
+
+#define MAX_INTERVAL_TASKS  32	/* max # of tasks per scan */
+#define SCAN_CHUNK_SIZE  65536	/* size of the first scan data chunk */
+#define SCAN_CHUNK_MAX  4194304L /* no chunk grows beyond this */
+
+#endif
+
 /* Private buffer controller object */
 
 typedef struct {
@@ -51,6 +100,19 @@ typedef struct {
 #ifdef D_MULTISCAN_FILES_SUPPORTED
   /* In multi-pass modes, we need a virtual block array for each component. */
   LJPEG_jvirt_barray_ptr whole_image[MAX_COMPONENTS];
+
+  /* State for parallel decoding of restart intervals */
+  boolean parallel_ok;		/* TRUE if parallel decoding is possible */
+  LJPEG_scan_data_chunk_ptr scan_data; /* entropy-coded data of the scan */
+  LJPEG_scan_data_chunk_ptr fill_chunk; /* chunk being filled */
+  size_t scan_data_len;		/* # of bytes read into scan_data so far */
+  boolean scan_data_ff;		/* TRUE if last byte read was 0xFF */
+  int scan_marker;		/* marker code which ended the scan */
+  size_t * interval_start;	/* offsets of the intervals in scan_data */
+  int max_intervals;		/* allocated size of interval_start, less 1 */
+  LJPEG_my_interval_task * tasks; /* task objects, or NULL if not yet made */
+  void ** task_data;		/* task_data array for run_tasks */
+  LJPEG_JBLOCKARRAY scan_buffer[MAX_COMPS_IN_SCAN]; /* whole-image arrays */
 #endif
 
 #ifdef BLOCK_SMOOTHING_SUPPORTED
@@ -66,6 +128,10 @@ typedef LJPEG_my_coef_controller * LJPEG_my_coef_ptr;
 LJPEG_METHODDEF(int) LJPEG_decompress_onepass
 	LJPEG_JPP((LJPEG_j_decompress_ptr cinfo, LJPEG_JSAMPIMAGE output_buf));
 #ifdef D_MULTISCAN_FILES_SUPPORTED
+LJPEG_METHODDEF(int) LJPEG_consume_data
+	LJPEG_JPP((LJPEG_j_decompress_ptr cinfo));
+LJPEG_METHODDEF(int) LJPEG_consume_data_parallel
+	LJPEG_JPP((LJPEG_j_decompress_ptr cinfo));
 LJPEG_METHODDEF(int) LJPEG_decompress_data
 	LJPEG_JPP((LJPEG_j_decompress_ptr cinfo, LJPEG_JSAMPIMAGE output_buf));
 #endif
@@ -107,6 +173,21 @@ LJPEG_start_iMCU_row (LJPEG_j_decompress_ptr cinfo)
 LJPEG_METHODDEF(void)
 LJPEG_start_input_pass (LJPEG_j_decompress_ptr cinfo)
 {
+#ifdef D_MULTISCAN_FILES_SUPPORTED
+  LJPEG_my_coef_ptr coef = (LJPEG_my_coef_ptr) cinfo->coef;
+
+  /* Scans with restart intervals can be decoded in parallel */
+  if (coef->pub.coef_arrays != NULL) {
+    if (coef->parallel_ok && cinfo->restart_interval) {
+      coef->pub.LJPEG_consume_data = LJPEG_consume_data_parallel;
+      coef->fill_chunk = coef->scan_data;
+      coef->scan_data_len = 0;
+      coef->scan_data_ff = FALSE;
+      coef->scan_marker = 0;
+    } else
+      coef->pub.LJPEG_consume_data = LJPEG_consume_data;
+  }
+#endif
   cinfo->input_iMCU_row = 0;
   LJPEG_start_iMCU_row(cinfo);
 }
@@ -305,6 +386,424 @@ LJPEG_consume_data (LJPEG_j_decompress_ptr cinfo)
 }
 
 
+/*
+ * Parallel decoding of restart intervals.
+ *
+ * In arithmetic-coded scans the statistics are reset at every restart
+ * marker, so the restart intervals can be decoded independently.  If the
+ * application supplied a task dispatcher and set parallel_restarts, we
+ * first read the whole entropy-coded segment of the scan into memory and
+ * locate the restart markers in it.  The intervals are then shared out
+ * among up to MAX_INTERVAL_TASKS tasks, each of which decodes its run of
+ * intervals straight into the (memory-resident) coefficient arrays.
+ * If the restart markers are not as expected, the data is presumably
+ * corrupt, and we decode the buffered data sequentially instead, so that
+ * the usual resynchronization logic applies.
+ */
+
+/*
+ * Methods for the private data source, which reads a span of scan_data.
+ * The data given to an interval decoder ends with the marker that
+ * follows the interval, so the decoder normally stops there.
+ */
+
+LJPEG_METHODDEF(void)
+LJPEG_init_scan_source (LJPEG_j_decompress_ptr cinfo)
+{
+  /* no work necessary here */
+}
+
+LJPEG_METHODDEF(boolean)
+LJPEG_fill_scan_input_buffer (LJPEG_j_decompress_ptr cinfo)
+{
+  LJPEG_my_scan_source_mgr * src = (LJPEG_my_scan_source_mgr *) cinfo->src;
+  static const JOCTET mybuffer[4] = {
+    (JOCTET) 0xFF, (JOCTET) JPEG_EOI, 0, 0
+  };
+  size_t nbytes;
+
+  if (src->bytes_left > 0) {
+    /* Continue in the next chunk */
+    src->chunk = src->chunk->next;
+    nbytes = MIN(src->bytes_left, src->chunk->size);
+    src->pub.next_input_byte = SCAN_CHUNK_DATA(src->chunk);
+    src->pub.bytes_in_buffer = nbytes;
+    src->bytes_left -= nbytes;
+    src->pub.resident = (src->bytes_left == 0);
+    return TRUE;
+  }
+
+  /* Insert a fake EOI marker, as in the memory source in jdatasrc.c.
+   * No warning here, since the real source has not run dry.
+   */
+  src->pub.next_input_byte = mybuffer;
+  src->pub.bytes_in_buffer = 2;
+
+  return TRUE;
+}
+
+LJPEG_METHODDEF(void)
+LJPEG_skip_scan_input_data (LJPEG_j_decompress_ptr cinfo, long num_bytes)
+{
+  struct LJPEG_jpeg_source_mgr * src = cinfo->src;
+
+  if (num_bytes > 0) {
+    while (num_bytes > (long) src->bytes_in_buffer) {
+      num_bytes -= (long) src->bytes_in_buffer;
+      (void) (*src->LJPEG_fill_input_buffer) (cinfo);
+    }
+    src->next_input_byte += (size_t) num_bytes;
+    src->bytes_in_buffer -= (size_t) num_bytes;
+  }
+}
+
+LJPEG_METHODDEF(void)
+LJPEG_term_scan_source (LJPEG_j_decompress_ptr cinfo)
+{
+  /* no work necessary here */
+}
+
+
+LOCAL(void)
+LJPEG_init_scan_source_mgr (LJPEG_my_scan_source_mgr * src)
+{
+  src->pub.LJPEG_init_source = LJPEG_init_scan_source;
+  src->pub.LJPEG_fill_input_buffer = LJPEG_fill_scan_input_buffer;
+  src->pub.LJPEG_skip_input_data = LJPEG_skip_scan_input_data;
+  src->pub.resync_to_restart = LJPEG_jpeg_resync_to_restart; /* use default */
+  src->pub.LJPEG_term_source = LJPEG_term_scan_source;
+  src->pub.bytes_in_buffer = 0;
+  src->pub.next_input_byte = NULL;
+  src->pub.resident = FALSE;
+  src->chunk = NULL;
+  src->bytes_left = 0;
+}
+
+
+LOCAL(void)
+LJPEG_point_scan_source (LJPEG_my_coef_ptr coef, LJPEG_my_scan_source_mgr * src,
+			 size_t start, size_t end)
+/* Point the private source at bytes start..end-1 of scan_data */
+{
+  LJPEG_scan_data_chunk_ptr chunk = coef->scan_data;
+  size_t nbytes;
+
+  while (start >= chunk->start + chunk->size)
+    chunk = chunk->next;
+  nbytes = MIN(end, chunk->start + chunk->size) - start;
+  src->chunk = chunk;
+  src->pub.next_input_byte = SCAN_CHUNK_DATA(chunk) + (start - chunk->start);
+  src->pub.bytes_in_buffer = nbytes;
+  src->bytes_left = (end - start) - nbytes;
+  /* The buffer holds all remaining data if the span ends in this chunk */
+  src->pub.resident = (src->bytes_left == 0);
+}
+
+
+LOCAL(boolean)
+LJPEG_read_scan_data (LJPEG_j_decompress_ptr cinfo)
+/* Append the entropy-coded data of the scan to scan_data, up to and
+ * including the marker which ends the scan.
+ * Returns FALSE if suspended; we can resume later where we left off.
+ */
+{
+  LJPEG_my_coef_ptr coef = (LJPEG_my_coef_ptr) cinfo->coef;
+  struct LJPEG_jpeg_source_mgr * src = cinfo->src;
+  LJPEG_scan_data_chunk_ptr chunk;
+  const JOCTET * next_input_byte;
+  size_t count, room, newsize;
+  int c;
+
+  for (;;) {
+    if (src->bytes_in_buffer == 0) {
+      if (! (*src->LJPEG_fill_input_buffer) (cinfo))
+	return FALSE;
+    }
+    next_input_byte = src->next_input_byte;
+    if (coef->scan_data_ff) {
+      /* Byte after 0xFF: end of scan unless stuffed zero,
+       * fill byte or restart marker.
+       */
+      c = GETJOCTET(*next_input_byte);
+      count = 1;
+      if (c != 0 && c != 0xFF && (c < JPEG_RST0 || c > JPEG_RST0 + 7))
+	coef->scan_marker = c;
+      coef->scan_data_ff = (c == 0xFF);
+    } else {
+      /* Take everything up to and including the next 0xFF */
+      count = 0;
+      do {
+	c = GETJOCTET(next_input_byte[count++]);
+      } while (c != 0xFF && count < src->bytes_in_buffer);
+      coef->scan_data_ff = (c == 0xFF);
+    }
+    src->next_input_byte += count;
+    src->bytes_in_buffer -= count;
+    /* Copy the bytes, moving on to the next chunk (or adding one) as needed */
+    while (count > 0) {
+      chunk = coef->fill_chunk;
+      if (chunk == NULL ||
+	  coef->scan_data_len == chunk->start + chunk->size) {
+	if (chunk == NULL || chunk->next == NULL) {
+	  if (chunk == NULL)
+	    newsize = SCAN_CHUNK_SIZE;
+	  else
+	    newsize = MIN(chunk->size * 2, (size_t) SCAN_CHUNK_MAX);
+	  coef->fill_chunk = (LJPEG_scan_data_chunk_ptr)
+	    (*cinfo->mem->LJPEG_alloc_large) ((LJPEG_j_common_ptr) cinfo,
+		JPOOL_IMAGE, SIZEOF(LJPEG_scan_data_chunk) + newsize);
+	  coef->fill_chunk->next = NULL;
+	  coef->fill_chunk->start = coef->scan_data_len;
+	  coef->fill_chunk->size = newsize;
+	  if (chunk == NULL)
+	    coef->scan_data = coef->fill_chunk;
+	  else
+	    chunk->next = coef->fill_chunk;
+	} else
+	  coef->fill_chunk = chunk->next;
+	chunk = coef->fill_chunk;
+      }
+      room = MIN(count, chunk->start + chunk->size - coef->scan_data_len);
+      MEMCOPY(SCAN_CHUNK_DATA(chunk) + (coef->scan_data_len - chunk->start),
+	      next_input_byte, room);
+      coef->scan_data_len += room;
+      next_input_byte += room;
+      count -= room;
+    }
+    if (coef->scan_marker)
+      return TRUE;
+  }
+}
+
+
+LOCAL(int)
+LJPEG_find_intervals (LJPEG_j_decompress_ptr cinfo)
+/* Locate the restart intervals in scan_data.
+ * Returns the number of intervals, or 0 if the restart markers
+ * do not match the expected sequence.
+ */
+{
+  LJPEG_my_coef_ptr coef = (LJPEG_my_coef_ptr) cinfo->coef;
+  LJPEG_scan_data_chunk_ptr chunk;
+  const JOCTET * data;
+  size_t pos, len;
+  boolean after_ff;
+  long total_MCUs;
+  int num_intervals, k, c;
+
+  total_MCUs = (long) cinfo->MCUs_per_row * (long) cinfo->MCU_rows_in_scan;
+  num_intervals = (int) LJPEG_jdiv_round_up(total_MCUs,
+					     (long) cinfo->restart_interval);
+
+  if (num_intervals > coef->max_intervals) {
+    coef->interval_start = (size_t *) (*cinfo->mem->LJPEG_alloc_large)
+      ((LJPEG_j_common_ptr) cinfo, JPOOL_IMAGE,
+       ((size_t) num_intervals + 1) * SIZEOF(size_t));
+    coef->max_intervals = num_intervals;
+  }
+
+  /* The scan data ends with a marker other than RSTn, which is the only
+   * marker in it besides the RSTn markers.  Stop on reaching it.
+   */
+  coef->interval_start[0] = 0;
+  k = 1;
+  after_ff = FALSE;
+  for (chunk = coef->scan_data; chunk != NULL; chunk = chunk->next) {
+    if (chunk->start >= coef->scan_data_len)
+      break;
+    data = SCAN_CHUNK_DATA(chunk);
+    len = MIN(chunk->size, coef->scan_data_len - chunk->start);
+    for (pos = 0; pos < len; pos++) {
+      c = GETJOCTET(data[pos]);
+      if (! after_ff) {
+	after_ff = (c == 0xFF);
+	continue;
+      }
+      if (c == 0xFF)
+	continue;		/* fill byte */
+      after_ff = FALSE;
+      if (c == 0)
+	continue;		/* stuffed zero byte */
+      if (c < JPEG_RST0 || c > JPEG_RST0 + 7)
+	break;			/* the marker which ended the scan */
+      /* RSTn marker: the next interval starts after it */
+      if (k >= num_intervals || c != JPEG_RST0 + ((k - 1) & 7))
+	return 0;
+      coef->interval_start[k++] = chunk->start + pos + 1;
+    }
+  }
+  if (k != num_intervals)
+    return 0;
+  coef->interval_start[k] = coef->scan_data_len;
+  return num_intervals;
+}
+
+
+LJPEG_METHODDEF(void)
+LJPEG_decode_intervals (void * task_data)
+/* Task routine: decode a run of restart intervals */
+{
+  LJPEG_my_interval_task * task = (LJPEG_my_interval_task *) task_data;
+  LJPEG_j_decompress_ptr cinfo = &task->cinfo;
+  LJPEG_my_coef_ptr coef = (LJPEG_my_coef_ptr) cinfo->coef;
+  LJPEG_JDIMENSION MCU_row, MCU_col, MCU_count;
+  int interval, blkn, ci, xindex, yindex;
+  LJPEG_JDIMENSION start_col;
+  LJPEG_JBLOCKARRAY buffer;
+  LJPEG_JBLOCKROW buffer_ptr;
+  LJPEG_jpeg_component_info *compptr;
+  long MCU_num;
+
+  /* An error ends the task here; consume_data_parallel re-raises it */
+  if (setjmp(task->err.setjmp_buffer))
+    return;
+
+  for (interval = task->first_interval; interval < task->end_interval;
+       interval++) {
+    /* Point the private source at the interval and reset the decoder */
+    LJPEG_point_scan_source(coef, &task->src,
+			    coef->interval_start[interval],
+			    coef->interval_start[interval+1]);
+    cinfo->unread_marker = 0;
+    (*cinfo->entropy->LJPEG_start_pass) (cinfo);
+
+    MCU_num = (long) interval * (long) cinfo->restart_interval;
+    MCU_row = (LJPEG_JDIMENSION) (MCU_num / (long) cinfo->MCUs_per_row);
+    MCU_col = (LJPEG_JDIMENSION) (MCU_num % (long) cinfo->MCUs_per_row);
+    for (MCU_count = 0; MCU_count < cinfo->restart_interval; MCU_count++) {
+      if (MCU_col == cinfo->MCUs_per_row) {
+	MCU_col = 0;
+	if (++MCU_row == cinfo->MCU_rows_in_scan)
+	  break;		/* last interval may be short */
+      }
+      /* Construct list of pointers to DCT blocks belonging to this MCU */
+      blkn = 0;			/* index of current DCT block within MCU */
+      for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+	compptr = cinfo->cur_comp_info[ci];
+	buffer = coef->scan_buffer[ci] + MCU_row * compptr->MCU_height;
+	start_col = MCU_col * compptr->MCU_width;
+	for (yindex = 0; yindex < compptr->MCU_height; yindex++) {
+	  buffer_ptr = buffer[yindex] + start_col;
+	  for (xindex = 0; xindex < compptr->MCU_width; xindex++) {
+	    task->MCU_buffer[blkn++] = buffer_ptr++;
+	  }
+	}
+      }
+      /* We don't support data suspension here */
+      if (! (*cinfo->entropy->LJPEG_decode_mcu) (cinfo, task->MCU_buffer))
+	ERREXIT(cinfo, JERR_CANT_SUSPEND);
+      MCU_col++;
+    }
+  }
+}
+
+
+/*
+ * Consume input data for a whole scan, decoding the restart intervals
+ * in parallel.  Return value is JPEG_SCAN_COMPLETED or JPEG_SUSPENDED.
+ */
+
+LJPEG_METHODDEF(int)
+LJPEG_consume_data_parallel (LJPEG_j_decompress_ptr cinfo)
+{
+  LJPEG_my_coef_ptr coef = (LJPEG_my_coef_ptr) cinfo->coef;
+  LJPEG_my_interval_task * task;
+  struct LJPEG_jpeg_source_mgr * src;
+  LJPEG_my_scan_source_mgr scan_src;
+  LJPEG_jpeg_component_info *compptr;
+  int num_intervals, per_task, num_tasks, failed, ci, i;
+
+  if (coef->scan_marker == 0) {
+    if (! LJPEG_read_scan_data(cinfo))
+      return JPEG_SUSPENDED;
+  }
+
+  num_intervals = LJPEG_find_intervals(cinfo);
+  if (num_intervals == 0) {
+    /* Unexpected restart markers: decode sequentially from scan_data */
+    src = cinfo->src;
+    LJPEG_init_scan_source_mgr(&scan_src);
+    LJPEG_point_scan_source(coef, &scan_src, (size_t) 0, coef->scan_data_len);
+    cinfo->src = &scan_src.pub;
+    while (LJPEG_consume_data(cinfo) != JPEG_SCAN_COMPLETED)
+      /* LJPEG_consume_data can't suspend with this source */ ;
+    cinfo->src = src;
+    /* The marker which ended the scan has been read from the real source */
+    if (cinfo->unread_marker == 0)
+      cinfo->unread_marker = coef->scan_marker;
+    coef->scan_marker = 0;
+    return JPEG_SCAN_COMPLETED;
+  }
+
+  /* Create the task objects the first time through */
+  if (coef->tasks == NULL) {
+    coef->tasks = (LJPEG_my_interval_task *)
+      (*cinfo->mem->LJPEG_alloc_small) ((LJPEG_j_common_ptr) cinfo, JPOOL_IMAGE,
+				  MAX_INTERVAL_TASKS * SIZEOF(LJPEG_my_interval_task));
+    coef->task_data = (void **)
+      (*cinfo->mem->LJPEG_alloc_small) ((LJPEG_j_common_ptr) cinfo, JPOOL_IMAGE,
+				  MAX_INTERVAL_TASKS * SIZEOF(void *));
+    for (i = 0; i < MAX_INTERVAL_TASKS; i++) {
+      task = &coef->tasks[i];
+      MEMCOPY(&task->cinfo, cinfo, SIZEOF(struct LJPEG_jpeg_decompress_struct));
+      LJPEG_jinit_arith_interval_decoder(&task->cinfo);
+      task->entropy = task->cinfo.entropy;
+      LJPEG_init_scan_source_mgr(&task->src);
+      coef->task_data[i] = (void *) task;
+    }
+  }
+
+  /* Get the whole-image arrays for the components in this scan.
+   * They are memory-resident, so the tasks can write to them concurrently.
+   */
+  for (ci = 0; ci < cinfo->comps_in_scan; ci++) {
+    compptr = cinfo->cur_comp_info[ci];
+    coef->scan_buffer[ci] = (*cinfo->mem->LJPEG_access_virt_barray)
+      ((LJPEG_j_common_ptr) cinfo, coef->whole_image[compptr->component_index],
+       (LJPEG_JDIMENSION) 0,
+       (LJPEG_JDIMENSION) LJPEG_jround_up((long) compptr->height_in_blocks,
+					  (long) compptr->v_samp_factor),
+       TRUE);
+  }
+
+  /* Share out the intervals, and set up the private objects for the scan */
+  per_task = (num_intervals + MAX_INTERVAL_TASKS - 1) / MAX_INTERVAL_TASKS;
+  num_tasks = (num_intervals + per_task - 1) / per_task;
+  for (i = 0; i < num_tasks; i++) {
+    task = &coef->tasks[i];
+    MEMCOPY(&task->cinfo, cinfo, SIZEOF(struct LJPEG_jpeg_decompress_struct));
+    task->cinfo.entropy = task->entropy;
+    task->cinfo.src = &task->src.pub;
+    LJPEG_jinit_task_error((LJPEG_j_common_ptr) cinfo, &task->err);
+    task->cinfo.err = &task->err.pub;
+    task->first_interval = i * per_task;
+    task->end_interval = MIN(task->first_interval + per_task, num_intervals);
+  }
+
+  (*cinfo->task->run_tasks) ((LJPEG_j_common_ptr) cinfo,
+			     LJPEG_decode_intervals, coef->task_data, num_tasks);
+
+  /* Pass on the tasks' warnings, and re-raise the first error, if any */
+  failed = -1;
+  for (i = 0; i < num_tasks; i++) {
+    if (LJPEG_jmerge_task_error((LJPEG_j_common_ptr) cinfo, &coef->tasks[i].err) &&
+	failed < 0)
+      failed = i;
+  }
+  if (failed >= 0)
+    LJPEG_jraise_task_error((LJPEG_j_common_ptr) cinfo, &coef->tasks[failed].err);
+
+  /* The marker which ended the scan has been read from the real source */
+  cinfo->unread_marker = coef->scan_marker;
+  coef->scan_marker = 0;
+
+  /* Completed the scan */
+  cinfo->input_iMCU_row = cinfo->total_iMCU_rows;
+  (*cinfo->inputctl->LJPEG_finish_input_pass) (cinfo);
+  return JPEG_SCAN_COMPLETED;
+}
+
+
 /*
  * Decompress and return some data in the multi-pass case.
  * Always attempts to emit one fully interleaved MCU row ("iMCU" row).
@@ -698,6 +1197,17 @@ LJPEG_jinit_d_coef_controller (LJPEG_j_decompress_ptr cinfo, boolean need_full_b
     int ci, access_rows;
     LJPEG_jpeg_component_info *compptr;
 
+    /* Restart intervals of arithmetic-coded scans may be decoded
+     * in parallel if the application wants it and provides the means.
+     */
+    coef->parallel_ok = cinfo->parallel_restarts && cinfo->task != NULL &&
+			cinfo->arith_code;
+    coef->scan_data = NULL;
+    coef->fill_chunk = NULL;
+    coef->scan_marker = 0;
+    coef->max_intervals = 0;
+    coef->tasks = NULL;
+
     for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
 	 ci++, compptr++) {
       access_rows = compptr->v_samp_factor;
@@ -706,6 +1216,10 @@ LJPEG_jinit_d_coef_controller (LJPEG_j_decompress_ptr cinfo, boolean need_full_b
       if (cinfo->progressive_mode)
 	access_rows *= 3;
 #endif
+      /* Parallel decoding needs the whole array in memory */
+      if (coef->parallel_ok)
+	access_rows = (int) LJPEG_jround_up((long) compptr->height_in_blocks,
+					    (long) compptr->v_samp_factor);
       coef->whole_image[ci] = (*cinfo->mem->LJPEG_request_virt_barray)
 	((LJPEG_j_common_ptr) cinfo, JPOOL_IMAGE, TRUE,
 	 (LJPEG_JDIMENSION) LJPEG_jround_up((long) compptr->width_in_blocks,
@@ -20,10 +20,10 @@ typedef struct {
   struct LJPEG_jpeg_color_deconverter pub; /* public fields */
 
   /* Private state for YCC->RGB conversion */
-  int * Cr_r_tab;		/* => table for Cr to R conversion */
-  int * Cb_b_tab;		/* => table for Cb to B conversion */
-  INT32 * Cr_g_tab;		/* => table for Cr to G conversion */
-  INT32 * Cb_g_tab;		/* => table for Cb to G conversion */
+  const int * Cr_r_tab;		/* => table for Cr to R conversion */
+  const int * Cb_b_tab;		/* => table for Cb to B conversion */
+  const INT32 * Cr_g_tab;	/* => table for Cr to G conversion */
+  const INT32 * Cb_g_tab;	/* => table for Cb to G conversion */
 
   /* Private state for RGB->Y conversion */
   INT32 * rgb_y_tab;		/* => table for RGB to Y conversion */
@@ -91,38 +91,12 @@ LOCAL(void)
 LJPEG_build_ycc_rgb_table (LJPEG_j_decompress_ptr cinfo)
 {
   LJPEG_my_cconvert_ptr cconvert = (LJPEG_my_cconvert_ptr) cinfo->cconvert;
-  int i;
-  INT32 x;
-  SHIFT_TEMPS
 
-  cconvert->Cr_r_tab = (int *)
-    (*cinfo->mem->LJPEG_alloc_small) ((LJPEG_j_common_ptr) cinfo, JPOOL_IMAGE,
-				(MAXJSAMPLE+1) * SIZEOF(int));
-  cconvert->Cb_b_tab = (int *)
-    (*cinfo->mem->LJPEG_alloc_small) ((LJPEG_j_common_ptr) cinfo, JPOOL_IMAGE,
-				(MAXJSAMPLE+1) * SIZEOF(int));
-  cconvert->Cr_g_tab = (INT32 *)
-    (*cinfo->mem->LJPEG_alloc_small) ((LJPEG_j_common_ptr) cinfo, JPOOL_IMAGE,
-				(MAXJSAMPLE+1) * SIZEOF(INT32));
-  cconvert->Cb_g_tab = (INT32 *)
-    (*cinfo->mem->LJPEG_alloc_small) ((LJPEG_j_common_ptr) cinfo, JPOOL_IMAGE,
-				(MAXJSAMPLE+1) * SIZEOF(INT32));
-
-  for (i = 0, x = -CENTERJSAMPLE; i <= MAXJSAMPLE; i++, x++) {
-    /* i is the actual input pixel value, in the range 0..MAXJSAMPLE */
-    /* The Cb or Cr value we are thinking of is x = i - CENTERJSAMPLE */
-    /* Cr=>R value is nearest int to 1.40200 * x */
-    cconvert->Cr_r_tab[i] = (int)
-		    RIGHT_SHIFT(FIX(1.40200) * x + ONE_HALF, SCALEBITS);
-    /* Cb=>B value is nearest int to 1.77200 * x */
-    cconvert->Cb_b_tab[i] = (int)
-		    RIGHT_SHIFT(FIX(1.77200) * x + ONE_HALF, SCALEBITS);
-    /* Cr=>G value is scaled-up -0.71414 * x */
-    cconvert->Cr_g_tab[i] = (- FIX(0.71414)) * x;
-    /* Cb=>G value is scaled-up -0.34414 * x */
-    /* We also add in ONE_HALF so that need not do it in inner loop */
-    cconvert->Cb_g_tab[i] = (- FIX(0.34414)) * x + ONE_HALF;
-  }
+  /* The tables are constant, so all objects share the ones in jutils.c */
+  cconvert->Cr_r_tab = LJPEG_jpeg_Cr_r_tab;
+  cconvert->Cb_b_tab = LJPEG_jpeg_Cb_b_tab;
+  cconvert->Cr_g_tab = LJPEG_jpeg_Cr_g_tab;
+  cconvert->Cb_g_tab = LJPEG_jpeg_Cb_g_tab;
 }
 
 
@@ -150,10 +124,10 @@ LJPEG_ycc_rgb_convert (LJPEG_j_decompress_ptr cinfo,
   LJPEG_JDIMENSION num_cols = cinfo->output_width;
   /* copy these pointers into registers if possible */
   register LJPEG_JSAMPLE * range_limit = cinfo->sample_range_limit;
-  register int * Crrtab = cconvert->Cr_r_tab;
-  register int * Cbbtab = cconvert->Cb_b_tab;
-  register INT32 * Crgtab = cconvert->Cr_g_tab;
-  register INT32 * Cbgtab = cconvert->Cb_g_tab;
+  register const int * Crrtab = cconvert->Cr_r_tab;
+  register const int * Cbbtab = cconvert->Cb_b_tab;
+  register const INT32 * Crgtab = cconvert->Cr_g_tab;
+  register const INT32 * Cbgtab = cconvert->Cb_g_tab;
   SHIFT_TEMPS
 
   while (--num_rows >= 0) {
@@ -449,10 +423,10 @@ LJPEG_ycck_cmyk_convert (LJPEG_j_decompress_ptr cinfo,
   LJPEG_JDIMENSION num_cols = cinfo->output_width;
   /* copy these pointers into registers if possible */
   register LJPEG_JSAMPLE * range_limit = cinfo->sample_range_limit;
-  register int * Crrtab = cconvert->Cr_r_tab;
-  register int * Cbbtab = cconvert->Cb_b_tab;
-  register INT32 * Crgtab = cconvert->Cr_g_tab;
-  register INT32 * Cbgtab = cconvert->Cb_g_tab;
+  register const int * Crrtab = cconvert->Cr_r_tab;
+  register const int * Cbbtab = cconvert->Cb_b_tab;
+  register const INT32 * Crgtab = cconvert->Cr_g_tab;
+  register const INT32 * Cbgtab = cconvert->Cb_g_tab;
   SHIFT_TEMPS
 
   while (--num_rows >= 0) {
@@ -68,6 +68,23 @@ typedef union {
 } LJPEG_multiplier_table;
 
 
+/* When the application recycles the IMAGE pool (see jdinput.c), the tables
+ * are kept per component in the PERMANENT pool together with the method
+ * and quantization values they were built for, and are rebuilt only when
+ * either changes.
+ */
+
+typedef struct {
+  int method;			/* IDCT method code, or -1 if not valid */
+  UINT16 key[DCTSIZE2];		/* quantval[] the table was built from */
+  LJPEG_multiplier_table table;
+} LJPEG_mult_cache_entry;
+
+typedef struct {
+  LJPEG_mult_cache_entry comp[MAX_COMPONENTS];
+} LJPEG_mult_cache;
+
+
 /* The current scaled-IDCT routines require ISLOW-style multiplier tables,
  * so be sure to compile that code if either ISLOW or SCALING is requested.
  */
@@ -95,6 +112,7 @@ LJPEG_start_pass (LJPEG_j_decompress_ptr cinfo)
   int method = 0;
   inverse_DCT_method_ptr method_ptr = NULL;
   LJPEG_JQUANT_TBL * qtbl;
+  LJPEG_mult_cache_entry * entry;
 
   for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
        ci++, compptr++) {
@@ -270,6 +288,31 @@ LJPEG_start_pass (LJPEG_j_decompress_ptr cinfo)
     if (qtbl == NULL)		/* happens if no data yet for component */
       continue;
     idct->cur_method[ci] = method;
+    /* Use the cached table if it was built from identical contents. */
+    entry = NULL;
+    if (cinfo->table_cache != NULL) {
+      LJPEG_mult_cache * cache = (LJPEG_mult_cache *) cinfo->table_cache->mult_tbls;
+
+      if (cache == NULL) {
+	cache = (LJPEG_mult_cache *)
+	  (*cinfo->mem->LJPEG_alloc_small) ((LJPEG_j_common_ptr) cinfo, JPOOL_PERMANENT,
+				      SIZEOF(LJPEG_mult_cache));
+	for (i = 0; i < MAX_COMPONENTS; i++)
+	  cache->comp[i].method = -1;
+	cinfo->table_cache->mult_tbls = (void *) cache;
+      }
+      entry = & cache->comp[ci];
+      compptr->dct_table = (void *) & entry->table;
+      if (entry->method == method) {
+	for (i = 0; i < DCTSIZE2; i++) {
+	  if (entry->key[i] != qtbl->quantval[i])
+	    break;
+	}
+	if (i == DCTSIZE2)
+	  continue;
+      }
+      entry->method = -1;	/* until the table below is built */
+    }
     switch (method) {
 #ifdef PROVIDE_ISLOW_TABLES
     case JDCT_ISLOW:
@@ -350,6 +393,11 @@ LJPEG_start_pass (LJPEG_j_decompress_ptr cinfo)
       ERREXIT(cinfo, JERR_NOT_COMPILED);
       break;
     }
+    if (entry != NULL) {
+      for (i = 0; i < DCTSIZE2; i++)
+	entry->key[i] = qtbl->quantval[i];
+      entry->method = method;
+    }
   }
 }
 
@@ -314,6 +314,332 @@ static const int LJPEG_jpeg_zigzag_order2[2][2] = {
 };
 
 
+/*
+ * When the application recycles the IMAGE pool, derived tables are kept
+ * in the PERMANENT pool together with a copy of the public table they
+ * were built from, and are rebuilt only if that table has changed.
+ */
+
+typedef struct {
+  boolean valid;		/* TRUE if dtbl matches key */
+  LJPEG_JHUFF_TBL key;		/* public table contents dtbl was built from */
+  LJPEG_d_derived_tbl dtbl;
+} LJPEG_huff_cache_entry;
+
+typedef struct {
+  LJPEG_huff_cache_entry dc[NUM_HUFF_TBLS];
+  LJPEG_huff_cache_entry ac[NUM_HUFF_TBLS];
+} LJPEG_huff_cache;
+
+
+LOCAL(boolean)
+LJPEG_same_huff_tbl (const LJPEG_JHUFF_TBL * a, const LJPEG_JHUFF_TBL * b)
+/* Compare the code-defining parts of two Huffman tables */
+{
+  int i, numsymbols = 0;
+
+  for (i = 1; i <= 16; i++) {
+    if (a->bits[i] != b->bits[i])
+      return FALSE;
+    numsymbols += a->bits[i];
+  }
+  if (numsymbols > 256)
+    return FALSE;		/* let the full derivation complain */
+  for (i = 0; i < numsymbols; i++) {
+    if (a->huffval[i] != b->huffval[i])
+      return FALSE;
+  }
+  return TRUE;
+}
+
+
+/*
+ * Nearly all baseline files use the example Huffman tables given in section
+ * K.3 of the JPEG standard, so the derived tables for those are built in
+ * advance and shared, read-only, by every decompression object rather than
+ * computed again for each image.  Only the backlink in a shared table points
+ * at our own copy of the standard table instead of the object's.  The order
+ * is DC luminance, DC chrominance, AC luminance, AC chrominance; the values
+ * are exactly what LJPEG_jpeg_make_d_derived_tbl computes for these tables.
+ */
+
+static const LJPEG_JHUFF_TBL LJPEG_std_huff_tbl[4] = {
+  { { 0, 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 },
+    { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+      0x08, 0x09, 0x0a, 0x0b }, FALSE },
+  { { 0, 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 },
+    { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+      0x08, 0x09, 0x0a, 0x0b }, FALSE },
+  { { 0, 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 125 },
+    { 0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12,
+      0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+      0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08,
+      0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+      0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16,
+      0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+      0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39,
+      0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+      0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
+      0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+      0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79,
+      0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+      0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98,
+      0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+      0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6,
+      0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+      0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4,
+      0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+      0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea,
+      0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+      0xf9, 0xfa }, FALSE },
+  { { 0, 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 119 },
+    { 0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21,
+      0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+      0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91,
+      0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+      0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34,
+      0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+      0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38,
+      0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+      0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58,
+      0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+      0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78,
+      0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+      0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96,
+      0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+      0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4,
+      0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+      0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2,
+      0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+      0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9,
+      0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+      0xf9, 0xfa }, FALSE }
+};
+
+static const LJPEG_d_derived_tbl LJPEG_std_dtbl[4] = {
+  { { 0, -1, 0, 6, 14, 30, 62, 126, 254,
+      510, -1, -1, -1, -1, -1, -1, -1, 0xFFFFFL },
+    { 0, 0, 0, -1, -8, -23, -54, -117, -244,
+      -499, 0, 0, 0, 0, 0, 0, 0 },
+    (LJPEG_JHUFF_TBL *) &LJPEG_std_huff_tbl[0],
+    { 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+      2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+      2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+      2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+      3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+      3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+      3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+      3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+      3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+      3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+      3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+      3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+      3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+      3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+      4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+      5, 5, 5, 5, 5, 5, 5, 5, 6, 6, 6, 6, 7, 7, 8, 0 },
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+      0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+      0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+      0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02,
+      0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02,
+      0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x03, 0x03, 0x03, 0x03,
+      0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03,
+      0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03,
+      0x03, 0x03, 0x03, 0x03, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04,
+      0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04,
+      0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04,
+      0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05,
+      0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05,
+      0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x06, 0x06, 0x06, 0x06,
+      0x06, 0x06, 0x06, 0x06, 0x06, 0x06, 0x06, 0x06, 0x06, 0x06, 0x06, 0x06,
+      0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x07, 0x08, 0x08, 0x08, 0x08,
+      0x09, 0x09, 0x0a, 0x00 } },
+  { { 0, -1, 2, 6, 14, 30, 62, 126, 254,
+      510, 1022, 2046, -1, -1, -1, -1, -1, 0xFFFFFL },
+    { 0, 0, 0, -3, -10, -25, -56, -119, -246,
+      -501, -1012, -2035, 0, 0, 0, 0, 0 },
+    (LJPEG_JHUFF_TBL *) &LJPEG_std_huff_tbl[1],
+    { 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+      2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+      2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+      2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+      2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+      2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+      2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+      2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+      2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+      2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+      2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+      2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+      3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+      3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+      4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+      5, 5, 5, 5, 5, 5, 5, 5, 6, 6, 6, 6, 7, 7, 8, 0 },
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+      0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+      0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+      0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+      0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+      0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x02, 0x02, 0x02, 0x02,
+      0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02,
+      0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02,
+      0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02,
+      0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02,
+      0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02,
+      0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03,
+      0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03,
+      0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x04, 0x04, 0x04, 0x04,
+      0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04,
+      0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x06, 0x06, 0x06, 0x06,
+      0x07, 0x07, 0x08, 0x00 } },
+  { { 0, -1, 1, 4, 12, 28, 59, 123, 250,
+      506, 1018, 2041, 4087, -1, -1, 32704, 65534, 0xFFFFFL },
+    { 0, 0, 0, -2, -7, -20, -49, -109, -233,
+      -484, -991, -2010, -4052, 0, 0, -32668, -65373 },
+    (LJPEG_JHUFF_TBL *) &LJPEG_std_huff_tbl[2],
+    { 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+      2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+      2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+      2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+      2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+      2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+      2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+      2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+      3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+      3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+      4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+      4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+      4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+      5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+      5, 5, 5, 5, 5, 5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 6,
+      7, 7, 7, 7, 7, 7, 7, 7, 8, 8, 8, 0, 0, 0, 0, 0 },
+    { 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+      0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+      0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+      0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+      0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+      0x01, 0x01, 0x01, 0x01, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02,
+      0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02,
+      0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02,
+      0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02,
+      0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02,
+      0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x03, 0x03, 0x03, 0x03,
+      0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03,
+      0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03,
+      0x03, 0x03, 0x03, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x04, 0x04, 0x04,
+      0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04,
+      0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+      0x11, 0x11, 0x11, 0x11, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05, 0x05,
+      0x12, 0x12, 0x12, 0x12, 0x12, 0x12, 0x12, 0x12, 0x21, 0x21, 0x21, 0x21,
+      0x21, 0x21, 0x21, 0x21, 0x31, 0x31, 0x31, 0x31, 0x41, 0x41, 0x41, 0x41,
+      0x06, 0x06, 0x13, 0x13, 0x51, 0x51, 0x61, 0x61, 0x07, 0x22, 0x71, 0x00,
+      0x00, 0x00, 0x00, 0x00 } },
+  { { 0, -1, 1, 4, 11, 27, 59, 122, 249,
+      506, 1018, 2041, 4087, -1, 16352, 32707, 65534, 0xFFFFFL },
+    { 0, 0, 0, -2, -7, -19, -47, -107, -230,
+      -480, -987, -2006, -4048, 0, -16312, -32665, -65373 },
+    (LJPEG_JHUFF_TBL *) &LJPEG_std_huff_tbl[3],
+    { 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+      2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+      2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+      2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+      2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+      2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+      2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+      2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+      3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+      3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+      4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+      4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+      5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+      5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+      6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+      7, 7, 7, 7, 7, 7, 8, 8, 8, 8, 0, 0, 0, 0, 0, 0 },
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+      0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+      0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+      0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+      0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+      0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x02, 0x02, 0x02, 0x02,
+      0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02,
+      0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02,
+      0x02, 0x02, 0x02, 0x02, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03,
+      0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x11, 0x11, 0x11, 0x11,
+      0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+      0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x05, 0x05, 0x05, 0x05,
+      0x05, 0x05, 0x05, 0x05, 0x21, 0x21, 0x21, 0x21, 0x21, 0x21, 0x21, 0x21,
+      0x31, 0x31, 0x31, 0x31, 0x31, 0x31, 0x31, 0x31, 0x06, 0x06, 0x06, 0x06,
+      0x12, 0x12, 0x12, 0x12, 0x41, 0x41, 0x41, 0x41, 0x51, 0x51, 0x51, 0x51,
+      0x07, 0x07, 0x61, 0x61, 0x71, 0x71, 0x13, 0x22, 0x32, 0x81, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00 } }
+};
+
+
+LOCAL(LJPEG_d_derived_tbl *)
+LJPEG_std_derived_tbl (boolean isDC, const LJPEG_JHUFF_TBL * htbl)
+/* Find the shared derived table for htbl, or NULL if it's not standard */
+{
+  int i;
+
+  for (i = isDC ? 0 : 2; i < (isDC ? 2 : 4); i++) {
+    if (LJPEG_same_huff_tbl(& LJPEG_std_huff_tbl[i], htbl))
+      return (LJPEG_d_derived_tbl *) & LJPEG_std_dtbl[i];
+  }
+  return NULL;
+}
+
+
+LOCAL(boolean)
+LJPEG_is_std_derived_tbl (const LJPEG_d_derived_tbl * dtbl)
+/* Shared tables must never be used as a workspace */
+{
+  int i;
+
+  for (i = 0; i < 4; i++) {
+    if (dtbl == & LJPEG_std_dtbl[i])
+      return TRUE;
+  }
+  return FALSE;
+}
+
+
+LOCAL(LJPEG_JHUFF_TBL *)
+LJPEG_default_huff_tbl (LJPEG_j_decompress_ptr cinfo, boolean isDC, int tblno)
+/* Supply a standard table for a slot no DHT marker has filled */
+{
+  LJPEG_JHUFF_TBL **htblptr;
+
+  /* Motion-JPEG uses only tables 0 (luminance) and 1 (chrominance). */
+  if (! cinfo->std_huff_default || tblno > 1)
+    ERREXIT1(cinfo, JERR_NO_HUFF_TABLE, tblno);
+  htblptr = isDC ? & cinfo->dc_huff_tbl_ptrs[tblno] :
+		   & cinfo->ac_huff_tbl_ptrs[tblno];
+  /* Install it like a DHT marker would, so later frames find it too. */
+  *htblptr = LJPEG_jpeg_alloc_huff_table((LJPEG_j_common_ptr) cinfo);
+  MEMCOPY(*htblptr, & LJPEG_std_huff_tbl[(isDC ? 0 : 2) + tblno],
+	  SIZEOF(LJPEG_JHUFF_TBL));
+  (*htblptr)->sent_table = FALSE;
+  return *htblptr;
+}
+
+
 /*
  * Compute the derived values for a Huffman table.
  * This routine also performs some validation checks on the table.
@@ -325,6 +651,7 @@ LJPEG_jpeg_make_d_derived_tbl (LJPEG_j_decompress_ptr cinfo, boolean isDC, int t
 {
   LJPEG_JHUFF_TBL *htbl;
   LJPEG_d_derived_tbl *dtbl;
+  LJPEG_huff_cache_entry *entry = NULL;
   int p, i, l, si, numsymbols;
   int lookbits, ctr;
   char huffsize[257];
@@ -341,10 +668,35 @@ LJPEG_jpeg_make_d_derived_tbl (LJPEG_j_decompress_ptr cinfo, boolean isDC, int t
   htbl =
     isDC ? cinfo->dc_huff_tbl_ptrs[tblno] : cinfo->ac_huff_tbl_ptrs[tblno];
   if (htbl == NULL)
-    ERREXIT1(cinfo, JERR_NO_HUFF_TABLE, tblno);
+    htbl = LJPEG_default_huff_tbl(cinfo, isDC, tblno);
+
+  /* Standard tables need no derivation at all. */
+  if ((dtbl = LJPEG_std_derived_tbl(isDC, htbl)) != NULL) {
+    *pdtbl = dtbl;
+    return;
+  }
+
+  /* Use the cached table if it was built from identical contents. */
+  if (cinfo->table_cache != NULL) {
+    LJPEG_huff_cache *cache = (LJPEG_huff_cache *) cinfo->table_cache->huff_tbls;
+
+    if (cache == NULL) {
+      cache = (LJPEG_huff_cache *)
+	(*cinfo->mem->LJPEG_alloc_small) ((LJPEG_j_common_ptr) cinfo, JPOOL_PERMANENT,
+				    SIZEOF(LJPEG_huff_cache));
+      MEMZERO(cache, SIZEOF(LJPEG_huff_cache));
+      cinfo->table_cache->huff_tbls = (void *) cache;
+    }
+    entry = isDC ? & cache->dc[tblno] : & cache->ac[tblno];
+    *pdtbl = & entry->dtbl;
+    if (entry->valid && entry->dtbl.pub == htbl &&
+	LJPEG_same_huff_tbl(& entry->key, htbl))
+      return;
+    entry->valid = FALSE;	/* until the derivation below succeeds */
+  }
 
   /* Allocate a workspace if we haven't already done so. */
-  if (*pdtbl == NULL)
+  if (*pdtbl == NULL || LJPEG_is_std_derived_tbl(*pdtbl))
     *pdtbl = (LJPEG_d_derived_tbl *)
       (*cinfo->mem->LJPEG_alloc_small) ((LJPEG_j_common_ptr) cinfo, JPOOL_IMAGE,
 				  SIZEOF(LJPEG_d_derived_tbl));
@@ -437,6 +789,11 @@ LJPEG_jpeg_make_d_derived_tbl (LJPEG_j_decompress_ptr cinfo, boolean isDC, int t
 	ERREXIT(cinfo, JERR_BAD_HUFF_TABLE);
     }
   }
+
+  if (entry != NULL) {
+    MEMCOPY(& entry->key, htbl, SIZEOF(LJPEG_JHUFF_TBL));
+    entry->valid = TRUE;
+  }
 }
 
 
@@ -460,6 +817,11 @@ LJPEG_jpeg_make_d_derived_tbl (LJPEG_j_decompress_ptr cinfo, boolean isDC, int t
 #define MIN_GET_BITS  (BIT_BUF_SIZE-7)
 #endif
 
+/* A refill loads at most this many data bytes, each of which may be
+ * followed by a stuffed zero byte.
+ */
+#define MAX_FILL_BYTES  (2 * ((MIN_GET_BITS + 7) / 8))
+
 
 LOCAL(boolean)
 LJPEG_jpeg_fill_bit_buffer (LJPEG_bitread_working_state * state,
@@ -477,6 +839,30 @@ LJPEG_jpeg_fill_bit_buffer (LJPEG_bitread_working_state * state,
   /* We fail to do so only if we hit a marker or are forced to suspend. */
 
   if (cinfo->unread_marker == 0) {	/* cannot advance past a marker */
+    /* Fast path for a resident source (see jpeglib.h).  The buffer holds
+     * the rest of the stream, so unless we are within a refill of its end
+     * we can read bytes without checking the count for each one, and there
+     * is no suspension to prepare for.  Stop at anything other than a
+     * stuffed FF/00 and let the general loop below deal with it.
+     */
+    if (cinfo->src->resident && bytes_in_buffer >= MAX_FILL_BYTES) {
+      register const JOCTET * start = next_input_byte;
+
+      do {
+	register int c = GETJOCTET(*next_input_byte);
+
+	if (c == 0xFF) {
+	  if (GETJOCTET(next_input_byte[1]) != 0)
+	    break;
+	  next_input_byte++;
+	}
+	next_input_byte++;
+	get_buffer = (get_buffer << 8) | c;
+	bits_left += 8;
+      } while (bits_left < MIN_GET_BITS);
+      bytes_in_buffer -= (size_t) (next_input_byte - start);
+    }
+
     while (bits_left < MIN_GET_BITS) {
       register int c;
 
@@ -629,6 +629,13 @@ LJPEG_reset_input_controller (LJPEG_j_decompress_ptr cinfo)
   (*cinfo->marker->LJPEG_reset_marker_reader) (cinfo);
   /* Reset progression state -- would be cleaner if entropy decoder did this */
   cinfo->coef_bits = NULL;
+  /* Set up the table cache if the application wants recycling */
+  if (cinfo->mem->recycle_image_pool && cinfo->table_cache == NULL) {
+    cinfo->table_cache = (struct LJPEG_jpeg_table_cache *)
+      (*cinfo->mem->LJPEG_alloc_small) ((LJPEG_j_common_ptr) cinfo, JPOOL_PERMANENT,
+				  SIZEOF(struct LJPEG_jpeg_table_cache));
+    MEMZERO(cinfo->table_cache, SIZEOF(struct LJPEG_jpeg_table_cache));
+  }
 }
 
 
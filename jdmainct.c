@@ -300,6 +300,34 @@ LJPEG_set_bottom_pointers (LJPEG_j_decompress_ptr cinfo)
 }
 
 
+/*
+ * Call the postprocessor, and pass the rows it finishes to the row listener.
+ * Every output row comes through here, including those the postprocessor
+ * quantizes, so this is the one place the listener need be called from.
+ * The dummy pass of 2-pass quantization has no output buffer and no rows.
+ */
+
+LOCAL(void)
+LJPEG_post_process_rows (LJPEG_j_decompress_ptr cinfo,
+		   LJPEG_JSAMPIMAGE input_buf, LJPEG_JDIMENSION *in_row_group_ctr,
+		   LJPEG_JDIMENSION in_row_groups_avail,
+		   LJPEG_JSAMPARRAY output_buf, LJPEG_JDIMENSION *out_row_ctr,
+		   LJPEG_JDIMENSION out_rows_avail)
+{
+  LJPEG_JDIMENSION first_row = *out_row_ctr;
+
+  (*cinfo->post->post_process_data) (cinfo, input_buf,
+				     in_row_group_ctr, in_row_groups_avail,
+				     output_buf, out_row_ctr, out_rows_avail);
+
+  if (cinfo->row_listener != NULL && output_buf != NULL &&
+      *out_row_ctr > first_row)
+    (*cinfo->row_listener->rows_ready) (cinfo, output_buf + first_row,
+					cinfo->output_scanline + first_row,
+					*out_row_ctr - first_row);
+}
+
+
 /*
  * Initialize for a processing pass.
  */
@@ -365,9 +393,9 @@ LJPEG_process_data_simple_main (LJPEG_j_decompress_ptr cinfo,
    */
 
   /* Feed the postprocessor */
-  (*cinfo->post->post_process_data) (cinfo, mainp->buffer,
-				     &mainp->rowgroup_ctr, rowgroups_avail,
-				     output_buf, out_row_ctr, out_rows_avail);
+  LJPEG_post_process_rows(cinfo, mainp->buffer,
+		    &mainp->rowgroup_ctr, rowgroups_avail,
+		    output_buf, out_row_ctr, out_rows_avail);
 
   /* Has postprocessor consumed all the data yet? If so, mark buffer empty */
   if (mainp->rowgroup_ctr >= rowgroups_avail) {
@@ -406,9 +434,9 @@ LJPEG_process_data_context_main (LJPEG_j_decompress_ptr cinfo,
   switch (mainp->context_state) {
   case CTX_POSTPONED_ROW:
     /* Call postprocessor using previously set pointers for postponed row */
-    (*cinfo->post->post_process_data) (cinfo, mainp->xbuffer[mainp->whichptr],
-			&mainp->rowgroup_ctr, mainp->rowgroups_avail,
-			output_buf, out_row_ctr, out_rows_avail);
+    LJPEG_post_process_rows(cinfo, mainp->xbuffer[mainp->whichptr],
+		      &mainp->rowgroup_ctr, mainp->rowgroups_avail,
+		      output_buf, out_row_ctr, out_rows_avail);
     if (mainp->rowgroup_ctr < mainp->rowgroups_avail)
       return;			/* Need to suspend */
     mainp->context_state = CTX_PREPARE_FOR_IMCU;
@@ -428,9 +456,9 @@ LJPEG_process_data_context_main (LJPEG_j_decompress_ptr cinfo,
     /*FALLTHROUGH*/
   case CTX_PROCESS_IMCU:
     /* Call postprocessor using previously set pointers */
-    (*cinfo->post->post_process_data) (cinfo, mainp->xbuffer[mainp->whichptr],
-			&mainp->rowgroup_ctr, mainp->rowgroups_avail,
-			output_buf, out_row_ctr, out_rows_avail);
+    LJPEG_post_process_rows(cinfo, mainp->xbuffer[mainp->whichptr],
+		      &mainp->rowgroup_ctr, mainp->rowgroups_avail,
+		      output_buf, out_row_ctr, out_rows_avail);
     if (mainp->rowgroup_ctr < mainp->rowgroups_avail)
       return;			/* Need to suspend */
     /* After the first iMCU, change wraparound pointers to normal state */
@@ -461,9 +489,9 @@ LJPEG_process_data_crank_post (LJPEG_j_decompress_ptr cinfo,
 			 LJPEG_JSAMPARRAY output_buf, LJPEG_JDIMENSION *out_row_ctr,
 			 LJPEG_JDIMENSION out_rows_avail)
 {
-  (*cinfo->post->post_process_data) (cinfo, (LJPEG_JSAMPIMAGE) NULL,
-				     (LJPEG_JDIMENSION *) NULL, (LJPEG_JDIMENSION) 0,
-				     output_buf, out_row_ctr, out_rows_avail);
+  LJPEG_post_process_rows(cinfo, (LJPEG_JSAMPIMAGE) NULL,
+		    (LJPEG_JDIMENSION *) NULL, (LJPEG_JDIMENSION) 0,
+		    output_buf, out_row_ctr, out_rows_avail);
 }
 
 #endif /* QUANT_2PASS_SUPPORTED */
@@ -509,4 +537,16 @@ LJPEG_jinit_d_main_controller (LJPEG_j_decompress_ptr cinfo, boolean need_full_b
        compptr->width_in_blocks * ((LJPEG_JDIMENSION) compptr->DCT_h_scaled_size),
        (LJPEG_JDIMENSION) (rgroup * ngroups));
   }
+
+  /* A row listener may take the rows from a strip of our own */
+  mainp->pub.strip = NULL;
+  mainp->pub.strip_height = 0;
+  if (cinfo->row_listener != NULL) {
+    mainp->pub.strip_height = (LJPEG_JDIMENSION)
+      (cinfo->max_v_samp_factor * cinfo->min_DCT_v_scaled_size);
+    mainp->pub.strip = (*cinfo->mem->LJPEG_alloc_sarray)
+      ((LJPEG_j_common_ptr) cinfo, JPOOL_IMAGE,
+       cinfo->output_width * (LJPEG_JDIMENSION) cinfo->output_components,
+       mainp->pub.strip_height);
+  }
 }
@@ -493,8 +493,16 @@ LJPEG_get_dht (LJPEG_j_decompress_ptr cinfo)
     if (count > 256 || ((INT32) count) > length)
       ERREXIT(cinfo, JERR_BAD_HUFF_TABLE);
 
-    for (i = 0; i < count; i++)
-      INPUT_BYTE(cinfo, huffval[i], return FALSE);
+    if (datasrc->resident && bytes_in_buffer >= (size_t) count) {
+      /* No suspension possible, so copy the values straight out */
+      for (i = 0; i < count; i++)
+	huffval[i] = (UINT8) GETJOCTET(next_input_byte[i]);
+      next_input_byte += count;
+      bytes_in_buffer -= (size_t) count;
+    } else {
+      for (i = 0; i < count; i++)
+	INPUT_BYTE(cinfo, huffval[i], return FALSE);
+    }
 
     length -= count;
 
@@ -1013,7 +1021,16 @@ LJPEG_next_marker (LJPEG_j_decompress_ptr cinfo)
      * This may look a bit inefficient, but it will not occur in a valid file.
      * We sync after each discarded byte so that a suspending data source
      * can discard the byte from its buffer.
+     * A resident source cannot suspend, so there we scan the buffer
+     * directly, falling back to the general loop only if it runs out.
      */
+    if (datasrc->resident) {
+      while (c != 0xFF && bytes_in_buffer > 0) {
+	cinfo->marker->discarded_bytes++;
+	bytes_in_buffer--;
+	c = GETJOCTET(*next_input_byte++);
+      }
+    }
     while (c != 0xFF) {
       cinfo->marker->discarded_bytes++;
       INPUT_SYNC(cinfo);
@@ -1503,3 +1520,184 @@ LJPEG_jpeg_set_marker_processor (LJPEG_j_decompress_ptr cinfo, int marker_code,
   else
     ERREXIT1(cinfo, JERR_UNKNOWN_MARKER, marker_code);
 }
+
+
+/*
+ * Probe a JPEG file held in memory, without a JPEG object.
+ *
+ * The markers ahead of the first SOS are scanned directly in the caller's
+ * buffer, so nothing is allocated and no error manager is needed: any
+ * datastream we cannot make sense of just makes us return FALSE.  TRUE means
+ * an SOFn marker was found and its parameters were stored in *info; the
+ * other fields describe whatever was seen before the marker scan stopped.
+ */
+
+/* Fetch an unsigned 16-bit value stored big- or little-endian */
+#define PROBE_GET16(p,le)  ((le) ? \
+  ((unsigned int) GETJOCTET((p)[1]) << 8) + GETJOCTET((p)[0]) : \
+  ((unsigned int) GETJOCTET((p)[0]) << 8) + GETJOCTET((p)[1]))
+
+
+LOCAL(int)
+LJPEG_probe_exif_orientation (const JOCTET * data, size_t length)
+/* Find the Orientation tag in IFD0 of an Exif APP1 marker's TIFF header.
+ * data points just past the "Exif\0\0" identifier.
+ */
+{
+  boolean le;
+  size_t offset;
+  unsigned int count, value;
+
+  if (length < 8)
+    return 0;
+  if (GETJOCTET(data[0]) == 0x49 && GETJOCTET(data[1]) == 0x49)
+    le = TRUE;			/* "II" = Intel byte order */
+  else if (GETJOCTET(data[0]) == 0x4D && GETJOCTET(data[1]) == 0x4D)
+    le = FALSE;			/* "MM" = Motorola byte order */
+  else
+    return 0;
+  if (PROBE_GET16(data + 2, le) != 42)
+    return 0;
+  /* The IFD0 offset is 32 bits, but an APP1 marker is never 64K long */
+  if (PROBE_GET16(data + (le ? 6 : 4), le) != 0)
+    return 0;
+  offset = PROBE_GET16(data + (le ? 4 : 6), le);
+  if (offset < 8 || offset > length - 2)
+    return 0;
+  count = PROBE_GET16(data + offset, le);
+  data += offset + 2;
+  length -= offset + 2;
+  /* Each IFD entry is 12 bytes: tag, type, count, value */
+  for (; count > 0 && length >= 12; count--, data += 12, length -= 12) {
+    if (PROBE_GET16(data, le) != 0x0112)
+      continue;
+    if (PROBE_GET16(data + 2, le) != 3)	/* must be type SHORT */
+      return 0;
+    value = PROBE_GET16(data + 8, le);
+    return (value >= 1 && value <= 8) ? (int) value : 0;
+  }
+  return 0;
+}
+
+
+LOCAL(void)
+LJPEG_probe_appn (int marker, const JOCTET * data, size_t length,
+		  LJPEG_jpeg_probe_info * info)
+/* Look for the APPn markers the probe reports on */
+{
+  static const char icc_id[12] = "ICC_PROFILE";
+  int i;
+
+  switch (marker) {
+  case M_APP0:
+    if (length >= APP0_DATA_LEN &&
+	GETJOCTET(data[0]) == 0x4A &&
+	GETJOCTET(data[1]) == 0x46 &&
+	GETJOCTET(data[2]) == 0x49 &&
+	GETJOCTET(data[3]) == 0x46 &&
+	GETJOCTET(data[4]) == 0)
+      info->saw_JFIF_marker = TRUE;
+    break;
+  case M_APP0+1:
+    if (length >= 6 && info->orientation == 0 &&
+	GETJOCTET(data[0]) == 0x45 &&
+	GETJOCTET(data[1]) == 0x78 &&
+	GETJOCTET(data[2]) == 0x69 &&
+	GETJOCTET(data[3]) == 0x66 &&
+	GETJOCTET(data[4]) == 0 &&
+	GETJOCTET(data[5]) == 0)
+      info->orientation = LJPEG_probe_exif_orientation(data + 6, length - 6);
+    break;
+  case M_APP0+2:
+    if (length >= 12) {
+      for (i = 0; i < 12; i++)	/* "ICC_PROFILE" including the null */
+	if (GETJOCTET(data[i]) != (int) (unsigned char) icc_id[i])
+	  break;
+      if (i == 12)
+	info->saw_ICC_profile = TRUE;
+    }
+    break;
+  case M_APP14:
+    if (length >= APP14_DATA_LEN &&
+	GETJOCTET(data[0]) == 0x41 &&
+	GETJOCTET(data[1]) == 0x64 &&
+	GETJOCTET(data[2]) == 0x6F &&
+	GETJOCTET(data[3]) == 0x62 &&
+	GETJOCTET(data[4]) == 0x65) {
+      info->saw_Adobe_marker = TRUE;
+      info->Adobe_transform = (UINT8) GETJOCTET(data[11]);
+    }
+    break;
+  }
+}
+
+
+GLOBAL(boolean)
+LJPEG_jpeg_probe (const JOCTET * data, size_t size, LJPEG_jpeg_probe_info * info)
+{
+  size_t pos, length;
+  int marker, nc, ci;
+  const JOCTET * p;
+  boolean saw_SOF = FALSE;
+
+  MEMZERO(info, SIZEOF(LJPEG_jpeg_probe_info));
+
+  if (data == NULL || size < 4 ||
+      GETJOCTET(data[0]) != 0xFF || GETJOCTET(data[1]) != (int) M_SOI)
+    return FALSE;
+
+  for (pos = 2;;) {
+    /* Find the next marker, skipping any fill bytes (as next_marker does) */
+    while (pos < size && GETJOCTET(data[pos]) != 0xFF)
+      pos++;
+    while (pos < size && GETJOCTET(data[pos]) == 0xFF)
+      pos++;
+    if (pos >= size)
+      break;
+    marker = GETJOCTET(data[pos++]);
+    if (marker == 0)		/* stuffed zero, not a marker */
+      continue;
+    if (marker == (int) M_SOS || marker == (int) M_EOI)
+      break;
+    if (marker == (int) M_TEM ||
+	(marker >= (int) M_RST0 && marker <= (int) M_RST7))
+      continue;			/* these are all parameterless */
+    /* All other markers have a length word, which counts itself */
+    if (size - pos < 2)
+      break;
+    length = ((size_t) GETJOCTET(data[pos]) << 8) + GETJOCTET(data[pos+1]);
+    if (length < 2 || length > size - pos)
+      break;
+    p = data + pos + 2;
+    length -= 2;
+    pos += length + 2;
+
+    if (marker >= (int) M_SOF0 && marker <= (int) M_SOF15 &&
+	marker != (int) M_DHT && marker != (int) M_JPG &&
+	marker != (int) M_DAC) {
+      if (saw_SOF || length < 6)
+	return FALSE;		/* as with JERR_SOF_DUPLICATE */
+      nc = GETJOCTET(p[5]);
+      if (nc <= 0 || nc > MAX_COMPONENTS || length != 6 + (size_t) nc * 3)
+	return FALSE;		/* as with JERR_BAD_LENGTH/JERR_COMPONENT_COUNT */
+      info->sof_marker = marker;
+      info->progressive_mode = ((marker & 3) == 2);
+      info->arith_code = (marker >= (int) M_SOF9);
+      info->data_precision = GETJOCTET(p[0]);
+      info->image_height = ((LJPEG_JDIMENSION) GETJOCTET(p[1]) << 8) +
+			   GETJOCTET(p[2]);
+      info->image_width = ((LJPEG_JDIMENSION) GETJOCTET(p[3]) << 8) +
+			  GETJOCTET(p[4]);
+      info->num_components = nc;
+      for (ci = 0; ci < nc; ci++) {
+	info->component_id[ci] = GETJOCTET(p[6 + ci*3]);
+	info->h_samp_factor[ci] = (GETJOCTET(p[7 + ci*3]) >> 4) & 15;
+	info->v_samp_factor[ci] = GETJOCTET(p[7 + ci*3]) & 15;
+      }
+      saw_SOF = TRUE;
+    } else if (marker >= (int) M_APP0 && marker <= (int) M_APP15)
+      LJPEG_probe_appn(marker, p, length, info);
+  }
+
+  return saw_SOF;
+}
@@ -79,25 +79,17 @@ LJPEG_use_merged_upsample (LJPEG_j_decompress_ptr cinfo)
 
 /*
  * Compute output image dimensions and related values.
- * NOTE: this is exported for possible use by application.
- * Hence it mustn't do anything that can't be done twice.
- * Also note that it may be called before the master module is initialized!
- */
-GLOBAL(void)
-LJPEG_jpeg_calc_output_dimensions (LJPEG_j_decompress_ptr cinfo)
-/* Do computations that are needed before master selection phase.
- * This function is used for full decompression.
+ * This is the guts of LJPEG_jpeg_calc_output_dimensions, also used by
+ * LJPEG_jpeg_new_scale.
  */
+LOCAL(void)
+LJPEG_output_dimensions (LJPEG_j_decompress_ptr cinfo)
 {
 #ifdef IDCT_SCALING_SUPPORTED
   int ci;
   LJPEG_jpeg_component_info *compptr;
 #endif
 
-  /* Prevent application from calling me at wrong times */
-  if (cinfo->global_state != DSTATE_READY)
-    ERREXIT1(cinfo, JERR_BAD_STATE, cinfo->global_state);
-
   /* Compute core output image dimensions and DCT scaling choices. */
   LJPEG_jpeg_core_output_dimensions(cinfo);
 
@@ -181,6 +173,26 @@ LJPEG_jpeg_calc_output_dimensions (LJPEG_j_decompress_ptr cinfo)
 }
 
 
+/*
+ * Compute output image dimensions and related values.
+ * NOTE: this is exported for possible use by application.
+ * Hence it mustn't do anything that can't be done twice.
+ * Also note that it may be called before the master module is initialized!
+ */
+GLOBAL(void)
+LJPEG_jpeg_calc_output_dimensions (LJPEG_j_decompress_ptr cinfo)
+/* Do computations that are needed before master selection phase.
+ * This function is used for full decompression.
+ */
+{
+  /* Prevent application from calling me at wrong times */
+  if (cinfo->global_state != DSTATE_READY)
+    ERREXIT1(cinfo, JERR_BAD_STATE, cinfo->global_state);
+
+  LJPEG_output_dimensions(cinfo);
+}
+
+
 /*
  * Several decompression processes need to range-limit values to the range
  * 0..MAXJSAMPLE; the input value may fall somewhat outside this range
@@ -220,36 +232,105 @@ LJPEG_jpeg_calc_output_dimensions (LJPEG_j_decompress_ptr cinfo)
  * with the simpler range limiting table.  The post-IDCT table begins at
  * sample_range_limit + CENTERJSAMPLE.
  *
- * Note that the table is allocated in near data space on PCs; it's small
- * enough and used often enough to justify this.
+ * The table is the same for every image, so it is built by the compiler
+ * (see LJPEG_jpeg_range_limit in jutils.c) and shared by all decompression
+ * objects; we need only point at it.  sample_range_limit keeps its old
+ * non-const type for the sake of existing code, so the cast below drops
+ * the const; nothing may ever store through the pointer.
  */
 
 LOCAL(void)
 LJPEG_prepare_range_limit_table (LJPEG_j_decompress_ptr cinfo)
-/* Allocate and fill in the sample_range_limit table */
+/* Set up the sample_range_limit table */
 {
-  LJPEG_JSAMPLE * table;
-  int i;
+  cinfo->sample_range_limit =
+    (LJPEG_JSAMPLE *) LJPEG_jpeg_range_limit + (MAXJSAMPLE+1);
+}
 
-  table = (LJPEG_JSAMPLE *)
+
+/*
+ * Allocate the workspace for raw data output to cinfo->raw_planes.
+ * The IDCT fills whole blocks, so it can write straight into a plane only
+ * if the plane's rows are contiguous and have room for the padding on the
+ * right; otherwise that component goes through scratch rows and is copied.
+ * Padding rows below the bottom of a plane all go to one dummy row.
+ */
+
+LOCAL(void)
+LJPEG_alloc_plane_rows (LJPEG_j_decompress_ptr cinfo)
+{
+  int ci;
+  LJPEG_JDIMENSION padded_width, max_width;
+  LJPEG_jpeg_component_info *compptr;
+  struct LJPEG_jpeg_decomp_master * master = cinfo->master;
+
+  master->plane_rows = (LJPEG_JSAMPIMAGE)
+    (*cinfo->mem->LJPEG_alloc_small) ((LJPEG_j_common_ptr) cinfo, JPOOL_IMAGE,
+				cinfo->num_components * SIZEOF(LJPEG_JSAMPARRAY));
+  master->plane_scratch = (LJPEG_JSAMPIMAGE)
     (*cinfo->mem->LJPEG_alloc_small) ((LJPEG_j_common_ptr) cinfo, JPOOL_IMAGE,
-		(5 * (MAXJSAMPLE+1) + CENTERJSAMPLE) * SIZEOF(LJPEG_JSAMPLE));
-  table += (MAXJSAMPLE+1);	/* allow negative subscripts of simple table */
-  cinfo->sample_range_limit = table;
-  /* First segment of "simple" table: limit[x] = 0 for x < 0 */
-  MEMZERO(table - (MAXJSAMPLE+1), (MAXJSAMPLE+1) * SIZEOF(LJPEG_JSAMPLE));
-  /* Main part of "simple" table: limit[x] = x */
-  for (i = 0; i <= MAXJSAMPLE; i++)
-    table[i] = (LJPEG_JSAMPLE) i;
-  table += CENTERJSAMPLE;	/* Point to where post-IDCT table starts */
-  /* End of simple table, rest of first half of post-IDCT table */
-  for (i = CENTERJSAMPLE; i < 2*(MAXJSAMPLE+1); i++)
-    table[i] = MAXJSAMPLE;
-  /* Second half of post-IDCT table */
-  MEMZERO(table + (2 * (MAXJSAMPLE+1)),
-	  (2 * (MAXJSAMPLE+1) - CENTERJSAMPLE) * SIZEOF(LJPEG_JSAMPLE));
-  MEMCOPY(table + (4 * (MAXJSAMPLE+1) - CENTERJSAMPLE),
-	  cinfo->sample_range_limit, CENTERJSAMPLE * SIZEOF(LJPEG_JSAMPLE));
+				cinfo->num_components * SIZEOF(LJPEG_JSAMPARRAY));
+  max_width = 0;
+  for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
+       ci++, compptr++) {
+    padded_width = compptr->width_in_blocks *
+		   (LJPEG_JDIMENSION) compptr->DCT_h_scaled_size;
+    if (padded_width > max_width)
+      max_width = padded_width;
+    master->plane_rows[ci] = (LJPEG_JSAMPARRAY)
+      (*cinfo->mem->LJPEG_alloc_small) ((LJPEG_j_common_ptr) cinfo, JPOOL_IMAGE,
+		(size_t) (compptr->v_samp_factor * compptr->DCT_v_scaled_size) *
+		SIZEOF(LJPEG_JSAMPROW));
+    master->plane_scratch[ci] = NULL;
+    if (cinfo->raw_planes[ci].sample_step != 1 ||
+	cinfo->raw_planes[ci].row_stride < padded_width)
+      master->plane_scratch[ci] = (*cinfo->mem->LJPEG_alloc_sarray)
+	((LJPEG_j_common_ptr) cinfo, JPOOL_IMAGE, padded_width,
+	 (LJPEG_JDIMENSION) (compptr->v_samp_factor * compptr->DCT_v_scaled_size));
+  }
+  master->plane_dummy = (*cinfo->mem->LJPEG_alloc_sarray)
+    ((LJPEG_j_common_ptr) cinfo, JPOOL_IMAGE, max_width, (LJPEG_JDIMENSION) 1)[0];
+}
+
+
+/*
+ * Select the modules that depend on the output scaling: post-processing,
+ * beginning with color conversion, and the inverse DCT.
+ */
+
+LOCAL(void)
+LJPEG_output_selection (LJPEG_j_decompress_ptr cinfo)
+{
+  LJPEG_my_master_ptr master = (LJPEG_my_master_ptr) cinfo->master;
+
+  if (! cinfo->raw_data_out) {
+    if (master->using_merged_upsample) {
+#ifdef UPSAMPLE_MERGING_SUPPORTED
+      LJPEG_jinit_merged_upsampler(cinfo); /* does color conversion too */
+#else
+      ERREXIT(cinfo, JERR_NOT_COMPILED);
+#endif
+    } else {
+      LJPEG_jinit_color_deconverter(cinfo);
+      LJPEG_jinit_upsampler(cinfo);
+    }
+    LJPEG_jinit_d_post_controller(cinfo, cinfo->enable_2pass_quant);
+  }
+  LJPEG_jinit_inverse_dct(cinfo);
+}
+
+
+/*
+ * Select the main buffer controller, or the raw data workspace.
+ */
+
+LOCAL(void)
+LJPEG_main_selection (LJPEG_j_decompress_ptr cinfo)
+{
+  if (! cinfo->raw_data_out)
+    LJPEG_jinit_d_main_controller(cinfo, FALSE /* never need full buffer here */);
+  else if (cinfo->raw_planes != NULL)
+    LJPEG_alloc_plane_rows(cinfo);
 }
 
 
@@ -335,22 +416,8 @@ LJPEG_master_selection (LJPEG_j_decompress_ptr cinfo)
      */
   }
 
-  /* Post-processing: in particular, color conversion first */
-  if (! cinfo->raw_data_out) {
-    if (master->using_merged_upsample) {
-#ifdef UPSAMPLE_MERGING_SUPPORTED
-      LJPEG_jinit_merged_upsampler(cinfo); /* does color conversion too */
-#else
-      ERREXIT(cinfo, JERR_NOT_COMPILED);
-#endif
-    } else {
-      LJPEG_jinit_color_deconverter(cinfo);
-      LJPEG_jinit_upsampler(cinfo);
-    }
-    LJPEG_jinit_d_post_controller(cinfo, cinfo->enable_2pass_quant);
-  }
-  /* Inverse DCT */
-  LJPEG_jinit_inverse_dct(cinfo);
+  /* Post-processing and inverse DCT */
+  LJPEG_output_selection(cinfo);
   /* Entropy decoding: either Huffman or arithmetic coding. */
   if (cinfo->arith_code)
     LJPEG_jinit_arith_decoder(cinfo);
@@ -360,10 +427,15 @@ LJPEG_master_selection (LJPEG_j_decompress_ptr cinfo)
 
   /* Initialize principal buffer controllers. */
   use_c_buffer = cinfo->inputctl->has_multiple_scans || cinfo->buffered_image;
+#ifdef D_MULTISCAN_FILES_SUPPORTED
+  /* Parallel decoding of restart intervals works through the buffer, too */
+  if (cinfo->parallel_restarts && cinfo->task != NULL && cinfo->arith_code &&
+      cinfo->restart_interval)
+    use_c_buffer = TRUE;
+#endif
   LJPEG_jinit_d_coef_controller(cinfo, use_c_buffer);
 
-  if (! cinfo->raw_data_out)
-    LJPEG_jinit_d_main_controller(cinfo, FALSE /* never need full buffer here */);
+  LJPEG_main_selection(cinfo);
 
   /* We can now tell the memory manager to allocate virtual arrays. */
   (*cinfo->mem->LJPEG_realize_virt_arrays) ((LJPEG_j_common_ptr) cinfo);
@@ -503,6 +575,53 @@ LJPEG_jpeg_new_colormap (LJPEG_j_decompress_ptr cinfo)
     ERREXIT(cinfo, JERR_MODE_CHANGE);
 }
 
+
+/*
+ * Switch to new output scaling between output passes.
+ * The application changes scale_num/scale_denom (or another parameter
+ * that affects only the output side, such as out_color_space) first.
+ * The coefficients are all kept in the buffer, so only the modules from
+ * the IDCT onward need be selected again.  The old ones are abandoned in
+ * the IMAGE pool, which is not released until the end of the image, so
+ * each call costs another set of output buffers.  Color quantization
+ * can't be changed this way, since its modules are chosen for the whole
+ * image.
+ */
+GLOBAL(void)
+LJPEG_jpeg_new_scale (LJPEG_j_decompress_ptr cinfo)
+{
+  LJPEG_my_master_ptr master = (LJPEG_my_master_ptr) cinfo->master;
+  long samplesperrow;
+  LJPEG_JDIMENSION jd_samplesperrow;
+  int ci;
+  LJPEG_jpeg_component_info *compptr;
+
+  /* Prevent application from calling me at wrong times */
+  if (cinfo->global_state != DSTATE_BUFIMAGE)
+    ERREXIT1(cinfo, JERR_BAD_STATE, cinfo->global_state);
+  if (cinfo->quantize_colors)
+    ERREXIT(cinfo, JERR_MODE_CHANGE);
+
+  LJPEG_output_dimensions(cinfo);
+
+  /* Width of an output scanline must be representable as LJPEG_JDIMENSION. */
+  samplesperrow = (long) cinfo->output_width * (long) cinfo->out_color_components;
+  jd_samplesperrow = (LJPEG_JDIMENSION) samplesperrow;
+  if ((long) jd_samplesperrow != samplesperrow)
+    ERREXIT(cinfo, JERR_WIDTH_OVERFLOW);
+
+  /* The previous color deconverter may have marked some components as not
+   * needed (eg, chroma for grayscale output); let the new one decide afresh.
+   */
+  for (ci = 0, compptr = cinfo->comp_info; ci < cinfo->num_components;
+       ci++, compptr++)
+    compptr->component_needed = TRUE;
+
+  master->using_merged_upsample = LJPEG_use_merged_upsample(cinfo);
+  LJPEG_output_selection(cinfo);
+  LJPEG_main_selection(cinfo);
+}
+
 #endif /* D_MULTISCAN_FILES_SUPPORTED */
 
 
@@ -523,6 +642,9 @@ LJPEG_jinit_master_decompress (LJPEG_j_decompress_ptr cinfo)
   master->pub.LJPEG_finish_output_pass = LJPEG_finish_output_pass;
 
   master->pub.is_dummy_pass = FALSE;
+  master->pub.plane_rows = NULL;
+  master->pub.plane_scratch = NULL;
+  master->pub.plane_dummy = NULL;
 
   LJPEG_master_selection(cinfo);
 }
@@ -50,10 +50,10 @@ typedef struct {
 			   LJPEG_JSAMPARRAY output_buf));
 
   /* Private state for YCC->RGB conversion */
-  int * Cr_r_tab;		/* => table for Cr to R conversion */
-  int * Cb_b_tab;		/* => table for Cb to B conversion */
-  INT32 * Cr_g_tab;		/* => table for Cr to G conversion */
-  INT32 * Cb_g_tab;		/* => table for Cb to G conversion */
+  const int * Cr_r_tab;		/* => table for Cr to R conversion */
+  const int * Cb_b_tab;		/* => table for Cb to B conversion */
+  const INT32 * Cr_g_tab;	/* => table for Cr to G conversion */
+  const INT32 * Cb_g_tab;	/* => table for Cb to G conversion */
 
   /* For 2:1 vertical sampling, we produce two output rows at a time.
    * We need a "spare" row buffer to hold the second output row if the
@@ -70,8 +70,6 @@ typedef struct {
 typedef LJPEG_my_upsampler * LJPEG_my_upsample_ptr;
 
 #define SCALEBITS	16	/* speediest right-shift on some machines */
-#define ONE_HALF	((INT32) 1 << (SCALEBITS-1))
-#define FIX(x)		((INT32) ((x) * (1L<<SCALEBITS) + 0.5))
 
 
 /*
@@ -83,38 +81,12 @@ LOCAL(void)
 LJPEG_build_ycc_rgb_table (LJPEG_j_decompress_ptr cinfo)
 {
   LJPEG_my_upsample_ptr upsample = (LJPEG_my_upsample_ptr) cinfo->upsample;
-  int i;
-  INT32 x;
-  SHIFT_TEMPS
 
-  upsample->Cr_r_tab = (int *)
-    (*cinfo->mem->LJPEG_alloc_small) ((LJPEG_j_common_ptr) cinfo, JPOOL_IMAGE,
-				(MAXJSAMPLE+1) * SIZEOF(int));
-  upsample->Cb_b_tab = (int *)
-    (*cinfo->mem->LJPEG_alloc_small) ((LJPEG_j_common_ptr) cinfo, JPOOL_IMAGE,
-				(MAXJSAMPLE+1) * SIZEOF(int));
-  upsample->Cr_g_tab = (INT32 *)
-    (*cinfo->mem->LJPEG_alloc_small) ((LJPEG_j_common_ptr) cinfo, JPOOL_IMAGE,
-				(MAXJSAMPLE+1) * SIZEOF(INT32));
-  upsample->Cb_g_tab = (INT32 *)
-    (*cinfo->mem->LJPEG_alloc_small) ((LJPEG_j_common_ptr) cinfo, JPOOL_IMAGE,
-				(MAXJSAMPLE+1) * SIZEOF(INT32));
-
-  for (i = 0, x = -CENTERJSAMPLE; i <= MAXJSAMPLE; i++, x++) {
-    /* i is the actual input pixel value, in the range 0..MAXJSAMPLE */
-    /* The Cb or Cr value we are thinking of is x = i - CENTERJSAMPLE */
-    /* Cr=>R value is nearest int to 1.40200 * x */
-    upsample->Cr_r_tab[i] = (int)
-		    RIGHT_SHIFT(FIX(1.40200) * x + ONE_HALF, SCALEBITS);
-    /* Cb=>B value is nearest int to 1.77200 * x */
-    upsample->Cb_b_tab[i] = (int)
-		    RIGHT_SHIFT(FIX(1.77200) * x + ONE_HALF, SCALEBITS);
-    /* Cr=>G value is scaled-up -0.71414 * x */
-    upsample->Cr_g_tab[i] = (- FIX(0.71414)) * x;
-    /* Cb=>G value is scaled-up -0.34414 * x */
-    /* We also add in ONE_HALF so that need not do it in inner loop */
-    upsample->Cb_g_tab[i] = (- FIX(0.34414)) * x + ONE_HALF;
-  }
+  /* The tables are constant, so all objects share the ones in jutils.c */
+  upsample->Cr_r_tab = LJPEG_jpeg_Cr_r_tab;
+  upsample->Cb_b_tab = LJPEG_jpeg_Cb_b_tab;
+  upsample->Cr_g_tab = LJPEG_jpeg_Cr_g_tab;
+  upsample->Cb_g_tab = LJPEG_jpeg_Cb_g_tab;
 }
 
 
@@ -235,10 +207,10 @@ LJPEG_h2v1_merged_upsample (LJPEG_j_decompress_ptr cinfo,
   LJPEG_JDIMENSION col;
   /* copy these pointers into registers if possible */
   register LJPEG_JSAMPLE * range_limit = cinfo->sample_range_limit;
-  int * Crrtab = upsample->Cr_r_tab;
-  int * Cbbtab = upsample->Cb_b_tab;
-  INT32 * Crgtab = upsample->Cr_g_tab;
-  INT32 * Cbgtab = upsample->Cb_g_tab;
+  const int * Crrtab = upsample->Cr_r_tab;
+  const int * Cbbtab = upsample->Cb_b_tab;
+  const INT32 * Crgtab = upsample->Cr_g_tab;
+  const INT32 * Cbgtab = upsample->Cb_g_tab;
   SHIFT_TEMPS
 
   inptr0 = input_buf[0][in_row_group_ctr];
@@ -297,10 +269,10 @@ LJPEG_h2v2_merged_upsample (LJPEG_j_decompress_ptr cinfo,
   LJPEG_JDIMENSION col;
   /* copy these pointers into registers if possible */
   register LJPEG_JSAMPLE * range_limit = cinfo->sample_range_limit;
-  int * Crrtab = upsample->Cr_r_tab;
-  int * Cbbtab = upsample->Cb_b_tab;
-  INT32 * Crgtab = upsample->Cr_g_tab;
-  INT32 * Cbgtab = upsample->Cb_g_tab;
+  const int * Crrtab = upsample->Cr_r_tab;
+  const int * Cbbtab = upsample->Cb_b_tab;
+  const INT32 * Crgtab = upsample->Cr_g_tab;
+  const INT32 * Cbgtab = upsample->Cb_g_tab;
   SHIFT_TEMPS
 
   inptr00 = input_buf[0][in_row_group_ctr*2];
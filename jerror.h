@@ -62,6 +62,7 @@ LJPEG_JMESSAGE(JERR_BAD_PROGRESSION,
 	 "Invalid progressive parameters Ss=%d Se=%d Ah=%d Al=%d")
 LJPEG_JMESSAGE(JERR_BAD_PROG_SCRIPT,
 	 "Invalid progressive parameters at scan script entry %d")
+LJPEG_JMESSAGE(JERR_BAD_ROW_ALIGN, "Invalid row alignment %d")
 LJPEG_JMESSAGE(JERR_BAD_SAMPLING, "Bogus sampling factors")
 LJPEG_JMESSAGE(JERR_BAD_SCAN_SCRIPT, "Invalid scan script at entry %d")
 LJPEG_JMESSAGE(JERR_BAD_STATE, "Improper call to JPEG library in state %d")
@@ -100,6 +101,8 @@ LJPEG_JMESSAGE(JERR_NO_BACKING_STORE, "Backing store not supported")
 LJPEG_JMESSAGE(JERR_NO_HUFF_TABLE, "Huffman table 0x%02x was not defined")
 LJPEG_JMESSAGE(JERR_NO_IMAGE, "JPEG datastream contains no image")
 LJPEG_JMESSAGE(JERR_NO_QUANT_TABLE, "Quantization table 0x%02x was not defined")
+LJPEG_JMESSAGE(JERR_NO_RAW_PLANES, "No raw data buffer, and no raw planes for the data")
+LJPEG_JMESSAGE(JERR_NO_ROW_LISTENER, "No scanline buffer, and no row listener to take the rows")
 LJPEG_JMESSAGE(JERR_NO_SOI, "Not a JPEG file: starts with 0x%02x 0x%02x")
 LJPEG_JMESSAGE(JERR_OUT_OF_MEMORY, "Insufficient memory (case %d)")
 LJPEG_JMESSAGE(JERR_QUANT_COMPONENTS,
@@ -45,6 +45,13 @@
 
 #include <stdio.h>
 
+/*
+ * Tasks run by the application's task dispatcher catch their own errors
+ * with setjmp/longjmp (see jcomapi.c), so we need <setjmp.h> as well.
+ */
+
+#include <setjmp.h>
+
 /*
  * We need memory copying and zeroing functions, plus strncpy().
  * ANSI and System V implementations declare these in <string.h>.
@@ -0,0 +1,224 @@
+/*
+ * jmemmap.c
+ *
+ * This file is not part of the original IJG distribution.  It is provided
+ * under the same conditions; see the accompanying README file.
+ *
+ * This file provides an implementation of the system-dependent portion of
+ * the JPEG memory manager for POSIX systems with mmap().  Like jmemansi.c,
+ * it gets its temporary files from tmpfile(), which are unlinked already.
+ * But instead of copying strips of a virtual array to and from the file,
+ * it maps the whole file into the address space, so that jmemmgr.c can
+ * access the virtual array in place and the kernel does the paging.
+ * A file is mapped only if its full size can be reserved on disk first,
+ * with posix_fallocate(); a sparse file would turn a full disk into a
+ * SIGBUS at some later store into the mapping, instead of an error we can
+ * report.  If the file cannot be mapped, it falls back to stdio file
+ * access, and where posix_fadvise() is available asks the kernel to read
+ * ahead the strips jmemmgr.c will want next.
+ * As with jmemansi.c, the amount of memory available is set by the user.
+ */
+
+#define JPEG_INTERNALS
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "jmemsys.h"		/* import the system-dependent declarations */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#ifndef HAVE_STDLIB_H		/* <stdlib.h> should declare malloc(),free() */
+extern void * malloc LJPEG_JPP((size_t size));
+extern void free LJPEG_JPP((void *ptr));
+#endif
+
+#ifndef SEEK_SET		/* pre-ANSI systems may not define this; */
+#define SEEK_SET  0		/* if not, assume 0 is correct */
+#endif
+
+#ifndef MAP_FAILED		/* older systems return -1 cast to a pointer */
+#define MAP_FAILED  ((void *) -1)
+#endif
+
+/* posix_fallocate() belongs to the POSIX advisory information option.
+ * Without it we have no way to reserve the file space, so we never map.
+ */
+#if defined(_POSIX_ADVISORY_INFO) && _POSIX_ADVISORY_INFO > 0
+#define MAP_BACKING_STORE
+#endif
+
+
+/*
+ * Memory allocation and freeing are controlled by the regular library
+ * routines malloc() and free().
+ */
+GLOBAL(void *)
+LJPEG_jpeg_get_small (LJPEG_j_common_ptr cinfo, size_t sizeofobject)
+{
+  return (void *) malloc(sizeofobject);
+}
+GLOBAL(void)
+LJPEG_jpeg_free_small (LJPEG_j_common_ptr cinfo, void * object, size_t sizeofobject)
+{
+  free(object);
+}
+
+
+/*
+ * "Large" objects are treated the same as "small" ones.
+ */
+GLOBAL(void FAR *)
+LJPEG_jpeg_get_large (LJPEG_j_common_ptr cinfo, size_t sizeofobject)
+{
+  return (void FAR *) malloc(sizeofobject);
+}
+GLOBAL(void)
+LJPEG_jpeg_free_large (LJPEG_j_common_ptr cinfo, void FAR * object, size_t sizeofobject)
+{
+  free(object);
+}
+
+
+/*
+ * This routine computes the total memory space available for allocation.
+ * As in jmemansi.c, we make the user tell us (with a default value set at
+ * compile time).  Mapped virtual arrays do not count against this limit;
+ * it only decides which arrays are put in backing store.
+ */
+
+#ifndef DEFAULT_MAX_MEM		/* so can override from makefile */
+#define DEFAULT_MAX_MEM		1000000L /* default: one megabyte */
+#endif
+GLOBAL(long)
+LJPEG_jpeg_mem_available (LJPEG_j_common_ptr cinfo, long min_bytes_needed,
+		    long max_bytes_needed, long already_allocated)
+{
+  return cinfo->mem->max_memory_to_use - already_allocated;
+}
+
+
+/*
+ * Backing store (temporary file) management.
+ * The read, write and prefetch routines are used only if the file could not
+ * be mapped.  Writes go through the kernel's buffer cache and so are already
+ * written behind; reads are made asynchronous by the prefetch hint, which
+ * starts the kernel reading the next strip while we work on this one.
+ */
+
+
+LJPEG_METHODDEF(void)
+LJPEG_read_backing_store (LJPEG_j_common_ptr cinfo, LJPEG_backing_store_ptr info,
+		    void FAR * buffer_address,
+		    long file_offset, long byte_count)
+{
+  if (fseek(info->temp_file, file_offset, SEEK_SET))
+    ERREXIT(cinfo, JERR_TFILE_SEEK);
+  if (JFREAD(info->temp_file, buffer_address, byte_count)
+      != (size_t) byte_count)
+    ERREXIT(cinfo, JERR_TFILE_READ);
+}
+
+
+LJPEG_METHODDEF(void)
+LJPEG_write_backing_store (LJPEG_j_common_ptr cinfo, LJPEG_backing_store_ptr info,
+		     void FAR * buffer_address,
+		     long file_offset, long byte_count)
+{
+  if (fseek(info->temp_file, file_offset, SEEK_SET))
+    ERREXIT(cinfo, JERR_TFILE_SEEK);
+  if (JFWRITE(info->temp_file, buffer_address, byte_count)
+      != (size_t) byte_count)
+    ERREXIT(cinfo, JERR_TFILE_WRITE);
+}
+
+
+#ifdef POSIX_FADV_WILLNEED
+
+LJPEG_METHODDEF(void)
+LJPEG_prefetch_backing_store (LJPEG_j_common_ptr cinfo, LJPEG_backing_store_ptr info,
+			long file_offset, long byte_count)
+{
+  /* This follows a read, so no written data is left in the stdio buffer */
+  (void) posix_fadvise(fileno(info->temp_file), (off_t) file_offset,
+		       (off_t) byte_count, POSIX_FADV_WILLNEED);
+}
+
+#endif /* POSIX_FADV_WILLNEED */
+
+
+LJPEG_METHODDEF(void)
+LJPEG_close_backing_store (LJPEG_j_common_ptr cinfo, LJPEG_backing_store_ptr info)
+{
+  if (info->mapped_address != NULL) {
+    munmap(info->mapped_address, info->mapped_size);
+    info->mapped_address = NULL;
+  }
+  fclose(info->temp_file);
+  /* Since this implementation uses tmpfile() to create the file,
+   * no explicit file deletion is needed.
+   */
+}
+
+
+/*
+ * Initial opening of a backing-store object.
+ *
+ * The file's space is allocated in full and the file mapped shared, so
+ * that pages the kernel evicts are written to the file rather than to swap.
+ * The file has no name, so its space is reclaimed when it is closed, even
+ * if the program dies first.  If the space cannot be allocated, as when
+ * the disk is full, we use stdio access, which reports a failed write as
+ * an ordinary error.
+ */
+GLOBAL(void)
+LJPEG_jpeg_open_backing_store (LJPEG_j_common_ptr cinfo, LJPEG_backing_store_ptr info,
+			 long total_bytes_needed)
+{
+#ifdef MAP_BACKING_STORE
+  void * address;
+#endif
+
+  if ((info->temp_file = tmpfile()) == NULL)
+    ERREXITS(cinfo, JERR_TFILE_CREATE, "");
+  info->LJPEG_read_backing_store = LJPEG_read_backing_store;
+  info->LJPEG_write_backing_store = LJPEG_write_backing_store;
+  info->LJPEG_close_backing_store = LJPEG_close_backing_store;
+  info->mapped_address = NULL;
+  info->mapped_size = (size_t) total_bytes_needed;
+
+#ifdef MAP_BACKING_STORE
+  /* Try to map the file; on any failure just use stdio access */
+  if (total_bytes_needed > 0 &&
+      (long) info->mapped_size == total_bytes_needed &&
+      posix_fallocate(fileno(info->temp_file), (off_t) 0,
+		      (off_t) total_bytes_needed) == 0) {
+    address = mmap((void *) NULL, info->mapped_size, PROT_READ | PROT_WRITE,
+		   MAP_SHARED, fileno(info->temp_file), (off_t) 0);
+    if (address != MAP_FAILED) {
+      info->mapped_address = (void FAR *) address;
+      return;
+    }
+  }
+#endif
+#ifdef POSIX_FADV_WILLNEED
+  info->LJPEG_prefetch_backing_store = LJPEG_prefetch_backing_store;
+#endif
+}
+
+
+/*
+ * These routines take care of any system-dependent initialization and
+ * cleanup required.
+ */
+GLOBAL(long)
+LJPEG_jpeg_mem_init (LJPEG_j_common_ptr cinfo)
+{
+  return DEFAULT_MAX_MEM;	/* default for max_memory_to_use */
+}
+GLOBAL(void)
+LJPEG_jpeg_mem_term (LJPEG_j_common_ptr cinfo)
+{
+  /* no work */
+}
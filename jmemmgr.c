@@ -75,9 +75,54 @@ extern char * getenv LJPEG_JPP((const char * name));
 #endif
 
 
+/*
+ * Pools are obtained from the application's allocator if one was given
+ * when the JPEG object was created, otherwise from the system-dependent
+ * routines declared in jmemsys.h.
+ */
+
+LOCAL(void *)
+LJPEG_get_small_chunk (LJPEG_j_common_ptr cinfo, struct LJPEG_jpeg_allocator * allocator,
+		 size_t sizeofobject)
+{
+  if (allocator != NULL)
+    return (*allocator->get_small) (allocator, sizeofobject);
+  return LJPEG_jpeg_get_small(cinfo, sizeofobject);
+}
+
+LOCAL(void)
+LJPEG_free_small_chunk (LJPEG_j_common_ptr cinfo, struct LJPEG_jpeg_allocator * allocator,
+		  void * object, size_t sizeofobject)
+{
+  if (allocator != NULL)
+    (*allocator->free_small) (allocator, object, sizeofobject);
+  else
+    LJPEG_jpeg_free_small(cinfo, object, sizeofobject);
+}
+
+LOCAL(void FAR *)
+LJPEG_get_large_chunk (LJPEG_j_common_ptr cinfo, struct LJPEG_jpeg_allocator * allocator,
+		 size_t sizeofobject)
+{
+  if (allocator != NULL)
+    return (*allocator->get_large) (allocator, sizeofobject);
+  return LJPEG_jpeg_get_large(cinfo, sizeofobject);
+}
+
+LOCAL(void)
+LJPEG_free_large_chunk (LJPEG_j_common_ptr cinfo, struct LJPEG_jpeg_allocator * allocator,
+		  void FAR * object, size_t sizeofobject)
+{
+  if (allocator != NULL)
+    (*allocator->free_large) (allocator, object, sizeofobject);
+  else
+    LJPEG_jpeg_free_large(cinfo, object, sizeofobject);
+}
+
+
 /*
  * We allocate objects from "pools", where each pool is gotten with a single
- * request to LJPEG_jpeg_get_small() or LJPEG_jpeg_get_large().  There is no per-object
+ * request to LJPEG_get_small_chunk() or LJPEG_get_large_chunk().  There is no per-object
  * overhead within a pool, except for alignment padding.  Each pool has a
  * header with a link to the next pool of the same class.
  * Small and large pool headers are identical except that the latter's
@@ -94,6 +139,7 @@ typedef union LJPEG_small_pool_struct {
     LJPEG_small_pool_ptr next;	/* next in list of pools */
     size_t bytes_used;		/* how many bytes already used within pool */
     size_t bytes_left;		/* bytes still available in this pool */
+    size_t bytes_marked;	/* bytes_used at LJPEG_begin_estimate */
   } hdr;
   ALIGN_TYPE dummy;		/* included in union to ensure alignment */
 } LJPEG_small_pool_hdr;
@@ -105,11 +151,28 @@ typedef union LJPEG_large_pool_struct {
     LJPEG_large_pool_ptr next;	/* next in list of pools */
     size_t bytes_used;		/* how many bytes already used within pool */
     size_t bytes_left;		/* bytes still available in this pool */
+    boolean detached;		/* TRUE if from LJPEG_alloc_detached */
   } hdr;
   ALIGN_TYPE dummy;		/* included in union to ensure alignment */
 } LJPEG_large_pool_hdr;
 
 
+LOCAL(size_t)
+LJPEG_release_large_pool (LJPEG_j_common_ptr cinfo, LJPEG_large_pool_ptr hdr_ptr)
+/* Return a large pool to whichever allocator it came from; returns its size */
+{
+  size_t space_freed = hdr_ptr->hdr.bytes_used + hdr_ptr->hdr.bytes_left +
+		       SIZEOF(LJPEG_large_pool_hdr);
+
+  if (hdr_ptr->hdr.detached)
+    LJPEG_jpeg_free_large(cinfo, (void FAR *) hdr_ptr, space_freed);
+  else
+    LJPEG_free_large_chunk(cinfo, cinfo->mem->allocator,
+			   (void FAR *) hdr_ptr, space_freed);
+  return space_freed;
+}
+
+
 /*
  * Here is the full definition of a memory manager object.
  */
@@ -121,6 +184,11 @@ typedef struct {
   LJPEG_small_pool_ptr small_list[JPOOL_NUMPOOLS];
   LJPEG_large_pool_ptr large_list[JPOOL_NUMPOOLS];
 
+  /* Large chunks released by LJPEG_recycle_pool, kept for reuse by the
+   * next image's LJPEG_alloc_large requests.
+   */
+  LJPEG_large_pool_ptr large_free_list[JPOOL_NUMPOOLS];
+
   /* Since we only have one lifetime class of virtual arrays, only one
    * linked list is necessary (for each datatype).  Note that the virtual
    * array control blocks being linked together are actually stored somewhere
@@ -129,13 +197,35 @@ typedef struct {
   LJPEG_jvirt_sarray_ptr virt_sarray_list;
   LJPEG_jvirt_barray_ptr virt_barray_list;
 
-  /* This counts total space obtained from LJPEG_jpeg_get_small/large */
+  /* This counts total space obtained from LJPEG_get_small/large_chunk,
+   * not including large chunks sitting idle in large_free_list.
+   */
   long total_space_allocated;
 
+  /* Statistics for LJPEG_get_mem_stats; see LJPEG_jpeg_memory_stats. */
+  long peak_space_allocated;
+  long small_allocs[JPOOL_NUMPOOLS];
+  long large_allocs[JPOOL_NUMPOOLS];
+  long backing_store_read;
+  long backing_store_written;
+
   /* LJPEG_alloc_sarray and LJPEG_alloc_barray set this value for use by virtual
    * array routines.
    */
   LJPEG_JDIMENSION last_rowsperchunk;	/* from most recent LJPEG_alloc_sarray/barray */
+
+  /* Between LJPEG_begin_estimate and LJPEG_end_estimate, we remember
+   * where the pools ended before, so new objects can be released again,
+   * and virtual arrays are only sized, not allocated.
+   */
+  boolean estimating;
+  LJPEG_small_pool_ptr small_mark[JPOOL_NUMPOOLS]; /* last pool before */
+  LJPEG_large_pool_ptr large_mark[JPOOL_NUMPOOLS]; /* first chunk before */
+  LJPEG_jvirt_sarray_ptr virt_sarray_mark;
+  LJPEG_jvirt_barray_ptr virt_barray_mark;
+  long est_virt_space;		/* as found by LJPEG_realize_virt_arrays */
+  long est_virt_in_memory;
+  boolean est_backing_store;
 } LJPEG_my_memory_mgr;
 
 typedef LJPEG_my_memory_mgr * LJPEG_my_mem_ptr;
@@ -164,6 +254,18 @@ struct LJPEG_jvirt_sarray_control {
   LJPEG_backing_store_info b_s_info;	/* System-dependent control info */
 };
 
+/*
+ * A row of a coefficient-block array kept packed in memory holds, for each
+ * block, DCTSIZE flag bytes in which bit j of byte i is set if coefficient
+ * [i*DCTSIZE+j] is nonzero; these are followed by the nonzero coefficients
+ * of all the blocks, in order.
+ */
+
+typedef struct {
+  UINT8 FAR * data;		/* packed row, or NULL if never written */
+  size_t space;			/* size of space allocated at data */
+} LJPEG_packed_row;
+
 struct LJPEG_jvirt_barray_control {
   LJPEG_JBLOCKARRAY mem_buffer;	/* => the in-memory buffer */
   LJPEG_JDIMENSION rows_in_array;	/* total virtual array height */
@@ -176,6 +278,7 @@ struct LJPEG_jvirt_barray_control {
   boolean pre_zero;		/* pre-zero mode requested? */
   boolean dirty;		/* do current buffer contents need written? */
   boolean b_s_open;		/* is backing-store data valid? */
+  LJPEG_packed_row * packed_rows; /* rows kept packed instead, or NULL */
   LJPEG_jvirt_barray_ptr next;	/* link to next virtual barray control block */
   LJPEG_backing_store_info b_s_info;	/* System-dependent control info */
 };
@@ -254,6 +357,30 @@ static const size_t extra_pool_slop[JPOOL_NUMPOOLS] =
 #define MIN_SLOP  50		/* greater than 0 to avoid futile looping */
 
 
+LOCAL(size_t)
+LJPEG_large_alignment (LJPEG_j_common_ptr cinfo)
+/* Validate and return the requested alignment, or 0 if none beyond ALIGN_TYPE */
+{
+  long align = cinfo->mem->row_alignment;
+
+  if (align == 0)
+    return 0;
+  if (align < 0 || (align & (align-1)) != 0 || align > 4096L)
+    ERREXIT1(cinfo, JERR_BAD_ROW_ALIGN, (int) align);
+  if (align <= (long) SIZEOF(ALIGN_TYPE))
+    return 0;
+  return (size_t) align;
+}
+
+
+LOCAL(size_t)
+LJPEG_align_pad (char FAR * ptr, size_t align)
+/* Return the # of bytes to skip from ptr to the next multiple of align */
+{
+  return (align - ((size_t) ptr & (align-1))) & (align-1);
+}
+
+
 LJPEG_METHODDEF(void *)
 LJPEG_alloc_small (LJPEG_j_common_ptr cinfo, int pool_id, size_t sizeofobject)
 /* Allocate a "small" object */
@@ -261,10 +388,13 @@ LJPEG_alloc_small (LJPEG_j_common_ptr cinfo, int pool_id, size_t sizeofobject)
   LJPEG_my_mem_ptr mem = (LJPEG_my_mem_ptr) cinfo->mem;
   LJPEG_small_pool_ptr hdr_ptr, prev_hdr_ptr;
   char * data_ptr;
-  size_t odd_bytes, min_request, slop;
+  size_t odd_bytes, min_request, slop, align, pad;
+
+  /* Workspace buffers are aligned like rows if the application asks */
+  align = LJPEG_large_alignment(cinfo);
 
   /* Check for unsatisfiable request (do now to ensure no overflow below) */
-  if (sizeofobject > (size_t) (MAX_ALLOC_CHUNK-SIZEOF(LJPEG_small_pool_hdr)))
+  if (sizeofobject > (size_t) (MAX_ALLOC_CHUNK-SIZEOF(LJPEG_small_pool_hdr)-align))
     LJPEG_out_of_memory(cinfo, 1);	/* request exceeds malloc's ability */
 
   /* Round up the requested size to a multiple of SIZEOF(ALIGN_TYPE) */
@@ -275,10 +405,15 @@ LJPEG_alloc_small (LJPEG_j_common_ptr cinfo, int pool_id, size_t sizeofobject)
   /* See if space is available in any existing pool */
   if (pool_id < 0 || pool_id >= JPOOL_NUMPOOLS)
     ERREXIT1(cinfo, JERR_BAD_POOL_ID, pool_id);	/* safety check */
+  mem->small_allocs[pool_id]++;
   prev_hdr_ptr = NULL;
   hdr_ptr = mem->small_list[pool_id];
+  pad = 0;
   while (hdr_ptr != NULL) {
-    if (hdr_ptr->hdr.bytes_left >= sizeofobject)
+    if (align > 0)
+      pad = LJPEG_align_pad((char *) (hdr_ptr + 1) + hdr_ptr->hdr.bytes_used,
+			    align);
+    if (hdr_ptr->hdr.bytes_left >= sizeofobject + pad)
       break;			/* found pool with enough space */
     prev_hdr_ptr = hdr_ptr;
     hdr_ptr = hdr_ptr->hdr.next;
@@ -287,7 +422,7 @@ LJPEG_alloc_small (LJPEG_j_common_ptr cinfo, int pool_id, size_t sizeofobject)
   /* Time to make a new pool? */
   if (hdr_ptr == NULL) {
     /* min_request is what we need now, slop is what will be leftover */
-    min_request = sizeofobject + SIZEOF(LJPEG_small_pool_hdr);
+    min_request = sizeofobject + align + SIZEOF(LJPEG_small_pool_hdr);
     if (prev_hdr_ptr == NULL)	/* first pool in class? */
       slop = LJPEG_first_pool_slop[pool_id];
     else
@@ -297,29 +432,34 @@ LJPEG_alloc_small (LJPEG_j_common_ptr cinfo, int pool_id, size_t sizeofobject)
       slop = (size_t) (MAX_ALLOC_CHUNK-min_request);
     /* Try to get space, if fail reduce slop and try again */
     for (;;) {
-      hdr_ptr = (LJPEG_small_pool_ptr) LJPEG_jpeg_get_small(cinfo, min_request + slop);
+      hdr_ptr = (LJPEG_small_pool_ptr)
+	LJPEG_get_small_chunk(cinfo, mem->pub.allocator, min_request + slop);
       if (hdr_ptr != NULL)
 	break;
       slop /= 2;
       if (slop < MIN_SLOP)	/* give up when it gets real small */
-	LJPEG_out_of_memory(cinfo, 2); /* LJPEG_jpeg_get_small failed */
+	LJPEG_out_of_memory(cinfo, 2); /* LJPEG_get_small_chunk failed */
     }
     mem->total_space_allocated += min_request + slop;
+    if (mem->total_space_allocated > mem->peak_space_allocated)
+      mem->peak_space_allocated = mem->total_space_allocated;
     /* Success, initialize the new pool header and add to end of list */
     hdr_ptr->hdr.next = NULL;
     hdr_ptr->hdr.bytes_used = 0;
-    hdr_ptr->hdr.bytes_left = sizeofobject + slop;
+    hdr_ptr->hdr.bytes_left = sizeofobject + align + slop;
     if (prev_hdr_ptr == NULL)	/* first pool in class? */
       mem->small_list[pool_id] = hdr_ptr;
     else
       prev_hdr_ptr->hdr.next = hdr_ptr;
+    if (align > 0)
+      pad = LJPEG_align_pad((char *) (hdr_ptr + 1), align);
   }
 
   /* OK, allocate the object from the current pool */
   data_ptr = (char *) (hdr_ptr + 1); /* point to first data byte in pool */
-  data_ptr += hdr_ptr->hdr.bytes_used; /* point to place for object */
-  hdr_ptr->hdr.bytes_used += sizeofobject;
-  hdr_ptr->hdr.bytes_left -= sizeofobject;
+  data_ptr += hdr_ptr->hdr.bytes_used + pad; /* point to place for object */
+  hdr_ptr->hdr.bytes_used += sizeofobject + pad;
+  hdr_ptr->hdr.bytes_left -= sizeofobject + pad;
 
   return (void *) data_ptr;
 }
@@ -332,7 +472,7 @@ LJPEG_alloc_small (LJPEG_j_common_ptr cinfo, int pool_id, size_t sizeofobject)
  * except that FAR pointers are used on 80x86.  However the pool
  * management heuristics are quite different.  We assume that each
  * request is large enough that it may as well be passed directly to
- * LJPEG_jpeg_get_large; the pool management just links everything together
+ * LJPEG_get_large_chunk; the pool management just links everything together
  * so that we can free it all on demand.
  * Note: the major use of "large" objects is in LJPEG_JSAMPARRAY and LJPEG_JBLOCKARRAY
  * structures.  The routines that create these structures (see below)
@@ -345,37 +485,168 @@ LJPEG_alloc_large (LJPEG_j_common_ptr cinfo, int pool_id, size_t sizeofobject)
 {
   LJPEG_my_mem_ptr mem = (LJPEG_my_mem_ptr) cinfo->mem;
   LJPEG_large_pool_ptr hdr_ptr;
-  size_t odd_bytes;
+  char FAR * data_ptr;
+  size_t odd_bytes, align;
+
+  /* Leave room to align the object if the application asked for that */
+  align = LJPEG_large_alignment(cinfo);
 
   /* Check for unsatisfiable request (do now to ensure no overflow below) */
-  if (sizeofobject > (size_t) (MAX_ALLOC_CHUNK-SIZEOF(LJPEG_large_pool_hdr)))
+  if (sizeofobject > (size_t) (MAX_ALLOC_CHUNK-SIZEOF(LJPEG_large_pool_hdr)-align))
     LJPEG_out_of_memory(cinfo, 3);	/* request exceeds malloc's ability */
 
   /* Round up the requested size to a multiple of SIZEOF(ALIGN_TYPE) */
   odd_bytes = sizeofobject % SIZEOF(ALIGN_TYPE);
   if (odd_bytes > 0)
     sizeofobject += SIZEOF(ALIGN_TYPE) - odd_bytes;
+  sizeofobject += align;
 
-  /* Always make a new pool */
   if (pool_id < 0 || pool_id >= JPOOL_NUMPOOLS)
     ERREXIT1(cinfo, JERR_BAD_POOL_ID, pool_id);	/* safety check */
+  mem->large_allocs[pool_id]++;
+
+  /* Reuse the best-fitting recycled chunk, if any is big enough */
+  hdr_ptr = NULL;
+  if (mem->large_free_list[pool_id] != NULL && ! mem->estimating) {
+    LJPEG_large_pool_ptr * prev_link;
+    LJPEG_large_pool_ptr * best_link = NULL;
+    size_t chunk_size, best_size = 0;
+
+    for (prev_link = & mem->large_free_list[pool_id]; *prev_link != NULL;
+	 prev_link = & (*prev_link)->hdr.next) {
+      chunk_size = (*prev_link)->hdr.bytes_used + (*prev_link)->hdr.bytes_left;
+      if (chunk_size >= sizeofobject &&
+	  (best_link == NULL || chunk_size < best_size)) {
+	best_link = prev_link;
+	best_size = chunk_size;
+      }
+    }
+    if (best_link != NULL) {
+      hdr_ptr = *best_link;
+      *best_link = hdr_ptr->hdr.next;
+      mem->total_space_allocated += best_size + SIZEOF(LJPEG_large_pool_hdr);
+      hdr_ptr->hdr.bytes_used = sizeofobject;
+      hdr_ptr->hdr.bytes_left = best_size - sizeofobject;
+    }
+  }
 
-  hdr_ptr = (LJPEG_large_pool_ptr) LJPEG_jpeg_get_large(cinfo, sizeofobject +
-					    SIZEOF(LJPEG_large_pool_hdr));
-  if (hdr_ptr == NULL)
-    LJPEG_out_of_memory(cinfo, 4);	/* LJPEG_jpeg_get_large failed */
-  mem->total_space_allocated += sizeofobject + SIZEOF(LJPEG_large_pool_hdr);
+  /* Otherwise make a new pool */
+  if (hdr_ptr == NULL) {
+    hdr_ptr = (LJPEG_large_pool_ptr)
+      LJPEG_get_large_chunk(cinfo, mem->pub.allocator,
+			    sizeofobject + SIZEOF(LJPEG_large_pool_hdr));
+    if (hdr_ptr == NULL)
+      LJPEG_out_of_memory(cinfo, 4);	/* LJPEG_get_large_chunk failed */
+    mem->total_space_allocated += sizeofobject + SIZEOF(LJPEG_large_pool_hdr);
+    /* We maintain space counts in each pool header for statistical purposes,
+     * even though they are not needed for allocation.
+     */
+    hdr_ptr->hdr.bytes_used = sizeofobject;
+    hdr_ptr->hdr.bytes_left = 0;
+    hdr_ptr->hdr.detached = FALSE;
+  }
+
+  if (mem->total_space_allocated > mem->peak_space_allocated)
+    mem->peak_space_allocated = mem->total_space_allocated;
 
-  /* Success, initialize the new pool header and add to list */
+  /* Success, add to list */
   hdr_ptr->hdr.next = mem->large_list[pool_id];
-  /* We maintain space counts in each pool header for statistical purposes,
-   * even though they are not needed for allocation.
-   */
+  mem->large_list[pool_id] = hdr_ptr;
+
+  data_ptr = (char FAR *) (hdr_ptr + 1); /* point to first data byte in pool */
+  if (align > 0)
+    data_ptr += LJPEG_align_pad(data_ptr, align);
+  return (void FAR *) data_ptr;
+}
+
+
+/*
+ * Allocation of "detached" large objects.
+ *
+ * Tasks run by the task dispatcher must not call LJPEG_alloc_large, which
+ * updates the pool lists shared by the whole object.  LJPEG_alloc_detached
+ * touches no shared state: it gets the object straight from the
+ * system-dependent allocator (never from the application's chunk
+ * allocator, which need not be reentrant), and the object belongs to no
+ * pool yet.  After the tasks have completed, the main thread must give
+ * every such object to LJPEG_attach_detached, which adds it to a pool; it
+ * is then released with that pool like any other large object.  Detached
+ * objects get no alignment beyond ALIGN_TYPE.
+ */
+
+LJPEG_METHODDEF(void FAR *)
+LJPEG_alloc_detached (LJPEG_j_common_ptr cinfo, size_t sizeofobject)
+{
+  LJPEG_large_pool_ptr hdr_ptr;
+  size_t odd_bytes;
+
+  if (sizeofobject > (size_t) (MAX_ALLOC_CHUNK-SIZEOF(LJPEG_large_pool_hdr)))
+    LJPEG_out_of_memory(cinfo, 8);	/* request exceeds malloc's ability */
+
+  odd_bytes = sizeofobject % SIZEOF(ALIGN_TYPE);
+  if (odd_bytes > 0)
+    sizeofobject += SIZEOF(ALIGN_TYPE) - odd_bytes;
+
+  hdr_ptr = (LJPEG_large_pool_ptr)
+    LJPEG_jpeg_get_large(cinfo, sizeofobject + SIZEOF(LJPEG_large_pool_hdr));
+  if (hdr_ptr == NULL)
+    LJPEG_out_of_memory(cinfo, 9);	/* LJPEG_jpeg_get_large failed */
+  hdr_ptr->hdr.next = NULL;
   hdr_ptr->hdr.bytes_used = sizeofobject;
   hdr_ptr->hdr.bytes_left = 0;
+  hdr_ptr->hdr.detached = TRUE;
+
+  return (void FAR *) (hdr_ptr + 1);
+}
+
+
+LJPEG_METHODDEF(void)
+LJPEG_attach_detached (LJPEG_j_common_ptr cinfo, int pool_id, void FAR * object)
+{
+  LJPEG_my_mem_ptr mem = (LJPEG_my_mem_ptr) cinfo->mem;
+  LJPEG_large_pool_ptr hdr_ptr = ((LJPEG_large_pool_ptr) object) - 1;
+
+  if (pool_id < 0 || pool_id >= JPOOL_NUMPOOLS)
+    ERREXIT1(cinfo, JERR_BAD_POOL_ID, pool_id);	/* safety check */
+
+  mem->large_allocs[pool_id]++;
+  mem->total_space_allocated += hdr_ptr->hdr.bytes_used +
+				SIZEOF(LJPEG_large_pool_hdr);
+  if (mem->total_space_allocated > mem->peak_space_allocated)
+    mem->peak_space_allocated = mem->total_space_allocated;
+
+  hdr_ptr->hdr.next = mem->large_list[pool_id];
   mem->large_list[pool_id] = hdr_ptr;
+}
+
 
-  return (void FAR *) (hdr_ptr + 1); /* point to first data byte in pool */
+/*
+ * When the application asks for aligned rows, each row of a sample or
+ * block array starts on the requested boundary, and the space between
+ * the end of a row's data and the start of the next row is padding that
+ * SIMD code may read (and scribble on) freely.  Widths passed around
+ * by the library are not changed; only the row spacing is.
+ */
+
+LOCAL(LJPEG_JDIMENSION)
+LJPEG_padded_width (LJPEG_j_common_ptr cinfo, LJPEG_JDIMENSION width,
+		    size_t elemsize)
+/* Round width up so that a row of it fills whole alignment units */
+{
+  size_t align = LJPEG_large_alignment(cinfo);
+  size_t unit;
+
+  if (align > 0) {
+    /* A row of n elements fills whole units when n * elemsize is a
+     * multiple of align, i.e. when n is a multiple of align divided by
+     * the largest power of 2 that divides both.  Since align is a power
+     * of 2, that divisor is the lowest set bit of elemsize, up to align.
+     */
+    unit = elemsize & (~elemsize + 1);
+    unit = (unit >= align) ? 1 : align / unit;
+    width = (LJPEG_JDIMENSION) (((size_t) width + unit - 1) / unit * unit);
+  }
+  return width;
 }
 
 
@@ -400,12 +671,15 @@ LJPEG_alloc_sarray (LJPEG_j_common_ptr cinfo, int pool_id,
   LJPEG_my_mem_ptr mem = (LJPEG_my_mem_ptr) cinfo->mem;
   LJPEG_JSAMPARRAY result;
   LJPEG_JSAMPROW workspace;
-  LJPEG_JDIMENSION rowsperchunk, currow, i;
+  LJPEG_JDIMENSION rowsperchunk, currow, i, rowstride;
   long ltemp;
 
+  rowstride = LJPEG_padded_width(cinfo, samplesperrow, SIZEOF(LJPEG_JSAMPLE));
+
   /* Calculate max # of rows allowed in one allocation chunk */
-  ltemp = (MAX_ALLOC_CHUNK-SIZEOF(LJPEG_large_pool_hdr)) /
-	  ((long) samplesperrow * SIZEOF(LJPEG_JSAMPLE));
+  ltemp = (MAX_ALLOC_CHUNK-SIZEOF(LJPEG_large_pool_hdr)-
+	   (long) LJPEG_large_alignment(cinfo)) /
+	  ((long) rowstride * SIZEOF(LJPEG_JSAMPLE));
   if (ltemp <= 0)
     ERREXIT(cinfo, JERR_WIDTH_OVERFLOW);
   if (ltemp < (long) numrows)
@@ -423,11 +697,11 @@ LJPEG_alloc_sarray (LJPEG_j_common_ptr cinfo, int pool_id,
   while (currow < numrows) {
     rowsperchunk = MIN(rowsperchunk, numrows - currow);
     workspace = (LJPEG_JSAMPROW) LJPEG_alloc_large(cinfo, pool_id,
-	(size_t) ((size_t) rowsperchunk * (size_t) samplesperrow
+	(size_t) ((size_t) rowsperchunk * (size_t) rowstride
 		  * SIZEOF(LJPEG_JSAMPLE)));
     for (i = rowsperchunk; i > 0; i--) {
       result[currow++] = workspace;
-      workspace += samplesperrow;
+      workspace += rowstride;
     }
   }
 
@@ -448,12 +722,15 @@ LJPEG_alloc_barray (LJPEG_j_common_ptr cinfo, int pool_id,
   LJPEG_my_mem_ptr mem = (LJPEG_my_mem_ptr) cinfo->mem;
   LJPEG_JBLOCKARRAY result;
   LJPEG_JBLOCKROW workspace;
-  LJPEG_JDIMENSION rowsperchunk, currow, i;
+  LJPEG_JDIMENSION rowsperchunk, currow, i, rowstride;
   long ltemp;
 
+  rowstride = LJPEG_padded_width(cinfo, blocksperrow, SIZEOF(LJPEG_JBLOCK));
+
   /* Calculate max # of rows allowed in one allocation chunk */
-  ltemp = (MAX_ALLOC_CHUNK-SIZEOF(LJPEG_large_pool_hdr)) /
-	  ((long) blocksperrow * SIZEOF(LJPEG_JBLOCK));
+  ltemp = (MAX_ALLOC_CHUNK-SIZEOF(LJPEG_large_pool_hdr)-
+	   (long) LJPEG_large_alignment(cinfo)) /
+	  ((long) rowstride * SIZEOF(LJPEG_JBLOCK));
   if (ltemp <= 0)
     ERREXIT(cinfo, JERR_WIDTH_OVERFLOW);
   if (ltemp < (long) numrows)
@@ -471,11 +748,11 @@ LJPEG_alloc_barray (LJPEG_j_common_ptr cinfo, int pool_id,
   while (currow < numrows) {
     rowsperchunk = MIN(rowsperchunk, numrows - currow);
     workspace = (LJPEG_JBLOCKROW) LJPEG_alloc_large(cinfo, pool_id,
-	(size_t) ((size_t) rowsperchunk * (size_t) blocksperrow
+	(size_t) ((size_t) rowsperchunk * (size_t) rowstride
 		  * SIZEOF(LJPEG_JBLOCK)));
     for (i = rowsperchunk; i > 0; i--) {
       result[currow++] = workspace;
-      workspace += blocksperrow;
+      workspace += rowstride;
     }
   }
 
@@ -539,7 +816,9 @@ LJPEG_request_virt_sarray (LJPEG_j_common_ptr cinfo, int pool_id, boolean pre_ze
 
   result->mem_buffer = NULL;	/* marks array not yet realized */
   result->rows_in_array = numrows;
-  result->samplesperrow = samplesperrow;
+  /* Backing store I/O treats the rows of a chunk as contiguous */
+  result->samplesperrow = LJPEG_padded_width(cinfo, samplesperrow,
+					     SIZEOF(LJPEG_JSAMPLE));
   result->maxaccess = maxaccess;
   result->pre_zero = pre_zero;
   result->b_s_open = FALSE;	/* no associated backing-store object */
@@ -569,10 +848,13 @@ LJPEG_request_virt_barray (LJPEG_j_common_ptr cinfo, int pool_id, boolean pre_ze
 
   result->mem_buffer = NULL;	/* marks array not yet realized */
   result->rows_in_array = numrows;
-  result->blocksperrow = blocksperrow;
+  /* Backing store I/O treats the rows of a chunk as contiguous */
+  result->blocksperrow = LJPEG_padded_width(cinfo, blocksperrow,
+					    SIZEOF(LJPEG_JBLOCK));
   result->maxaccess = maxaccess;
   result->pre_zero = pre_zero;
   result->b_s_open = FALSE;	/* no associated backing-store object */
+  result->packed_rows = NULL;
   result->next = mem->virt_barray_list; /* add to list of virtual arrays */
   mem->virt_barray_list = result;
 
@@ -580,6 +862,87 @@ LJPEG_request_virt_barray (LJPEG_j_common_ptr cinfo, int pool_id, boolean pre_ze
 }
 
 
+LOCAL(long)
+LJPEG_array_space (LJPEG_j_common_ptr cinfo, long bytesperrow,
+		   LJPEG_JDIMENSION numrows, size_t ptrsize)
+/* Compute the space LJPEG_alloc_sarray/barray would take for an array.
+ * The row pointers are small objects, and whether they fit in the current
+ * small pool depends on everything allocated before; so they are really
+ * allocated, to be measured and released along with the other small objects.
+ */
+{
+  long space, chunkbytes, odd_bytes, align, ltemp;
+  LJPEG_JDIMENSION rowsperchunk, currow;
+
+  align = (long) LJPEG_large_alignment(cinfo);
+  ltemp = (MAX_ALLOC_CHUNK-SIZEOF(LJPEG_large_pool_hdr)-align) / bytesperrow;
+  if (ltemp <= 0)
+    ERREXIT(cinfo, JERR_WIDTH_OVERFLOW);
+  if (ltemp < (long) numrows)
+    rowsperchunk = (LJPEG_JDIMENSION) ltemp;
+  else
+    rowsperchunk = numrows;
+
+  (void) LJPEG_alloc_small(cinfo, JPOOL_IMAGE, (size_t) numrows * ptrsize);
+  space = 0;
+  for (currow = 0; currow < numrows; currow += rowsperchunk) {
+    rowsperchunk = MIN(rowsperchunk, numrows - currow);
+    chunkbytes = (long) rowsperchunk * bytesperrow;
+    odd_bytes = chunkbytes % SIZEOF(ALIGN_TYPE);
+    if (odd_bytes > 0)
+      chunkbytes += SIZEOF(ALIGN_TYPE) - odd_bytes;
+    space += chunkbytes + align + SIZEOF(LJPEG_large_pool_hdr);
+  }
+  return space;
+}
+
+
+LOCAL(void)
+LJPEG_estimate_virt_arrays (LJPEG_j_common_ptr cinfo, long max_minheights)
+/* Record what LJPEG_realize_virt_arrays would allocate, without doing so */
+{
+  LJPEG_my_mem_ptr mem = (LJPEG_my_mem_ptr) cinfo->mem;
+  long minheights;
+  LJPEG_jvirt_sarray_ptr sptr;
+  LJPEG_jvirt_barray_ptr bptr;
+  LJPEG_JDIMENSION rows;
+
+  for (sptr = mem->virt_sarray_list; sptr != NULL; sptr = sptr->next) {
+    if (sptr->mem_buffer == NULL) {
+      minheights = ((long) sptr->rows_in_array - 1L) / sptr->maxaccess + 1L;
+      rows = sptr->rows_in_array;
+      if (minheights > max_minheights) {
+	rows = (LJPEG_JDIMENSION) (max_minheights * sptr->maxaccess);
+	mem->est_backing_store = TRUE;
+      }
+      mem->est_virt_in_memory +=
+	LJPEG_array_space(cinfo, (long) sptr->samplesperrow *
+				 SIZEOF(LJPEG_JSAMPLE),
+			  rows, SIZEOF(LJPEG_JSAMPROW));
+    }
+  }
+  for (bptr = mem->virt_barray_list; bptr != NULL; bptr = bptr->next) {
+    if (bptr->mem_buffer == NULL) {
+      minheights = ((long) bptr->rows_in_array - 1L) / bptr->maxaccess + 1L;
+      rows = bptr->rows_in_array;
+      if (minheights > max_minheights) {
+	rows = (LJPEG_JDIMENSION) (max_minheights * bptr->maxaccess);
+	/* The packed rows themselves depend on the data */
+	if (mem->pub.pack_block_arrays)
+	  (void) LJPEG_alloc_small(cinfo, JPOOL_IMAGE,
+		(size_t) bptr->rows_in_array * SIZEOF(LJPEG_packed_row));
+	else
+	  mem->est_backing_store = TRUE;
+      }
+      mem->est_virt_in_memory +=
+	LJPEG_array_space(cinfo, (long) bptr->blocksperrow *
+				 SIZEOF(LJPEG_JBLOCK),
+			  rows, SIZEOF(LJPEG_JBLOCKROW));
+    }
+  }
+}
+
+
 LJPEG_METHODDEF(void)
 LJPEG_realize_virt_arrays (LJPEG_j_common_ptr cinfo)
 /* Allocate the in-memory buffers for any unrealized virtual arrays */
@@ -589,6 +952,7 @@ LJPEG_realize_virt_arrays (LJPEG_j_common_ptr cinfo)
   long minheights, max_minheights;
   LJPEG_jvirt_sarray_ptr sptr;
   LJPEG_jvirt_barray_ptr bptr;
+  LJPEG_JDIMENSION row;
 
   /* Compute the minimum space needed (maxaccess rows in each buffer)
    * and the maximum space needed (full image height in each buffer).
@@ -635,6 +999,12 @@ LJPEG_realize_virt_arrays (LJPEG_j_common_ptr cinfo)
       max_minheights = 1;
   }
 
+  if (mem->estimating) {
+    mem->est_virt_space += maximum_space;
+    LJPEG_estimate_virt_arrays(cinfo, max_minheights);
+    return;
+  }
+
   /* Allocate the in-memory buffers and initialize backing store as needed. */
 
   for (sptr = mem->virt_sarray_list; sptr != NULL; sptr = sptr->next) {
@@ -646,15 +1016,32 @@ LJPEG_realize_virt_arrays (LJPEG_j_common_ptr cinfo)
       } else {
 	/* It doesn't fit in memory, create backing store. */
 	sptr->rows_in_mem = (LJPEG_JDIMENSION) (max_minheights * sptr->maxaccess);
+	sptr->b_s_info.mapped_address = NULL;
+	sptr->b_s_info.LJPEG_prefetch_backing_store = NULL;
 	LJPEG_jpeg_open_backing_store(cinfo, & sptr->b_s_info,
 				(long) sptr->rows_in_array *
 				(long) sptr->samplesperrow *
 				(long) SIZEOF(LJPEG_JSAMPLE));
 	sptr->b_s_open = TRUE;
+	if (sptr->b_s_info.mapped_address != NULL) {
+	  /* Mapped backing store: point the rows into it, so no I/O occurs */
+	  LJPEG_JSAMPROW rowptr = (LJPEG_JSAMPROW) sptr->b_s_info.mapped_address;
+
+	  sptr->rows_in_mem = sptr->rows_in_array;
+	  sptr->mem_buffer = (LJPEG_JSAMPARRAY) LJPEG_alloc_small(cinfo, JPOOL_IMAGE,
+		(size_t) (sptr->rows_in_array * SIZEOF(LJPEG_JSAMPROW)));
+	  for (row = 0; row < sptr->rows_in_array; row++) {
+	    sptr->mem_buffer[row] = rowptr;
+	    rowptr += sptr->samplesperrow;
+	  }
+	  sptr->rowsperchunk = sptr->rows_in_array;
+	}
+      }
+      if (sptr->mem_buffer == NULL) {
+	sptr->mem_buffer = LJPEG_alloc_sarray(cinfo, JPOOL_IMAGE,
+					sptr->samplesperrow, sptr->rows_in_mem);
+	sptr->rowsperchunk = mem->last_rowsperchunk;
       }
-      sptr->mem_buffer = LJPEG_alloc_sarray(cinfo, JPOOL_IMAGE,
-				      sptr->samplesperrow, sptr->rows_in_mem);
-      sptr->rowsperchunk = mem->last_rowsperchunk;
       sptr->cur_start_row = 0;
       sptr->first_undef_row = 0;
       sptr->dirty = FALSE;
@@ -667,18 +1054,45 @@ LJPEG_realize_virt_arrays (LJPEG_j_common_ptr cinfo)
       if (minheights <= max_minheights) {
 	/* This buffer fits in memory */
 	bptr->rows_in_mem = bptr->rows_in_array;
+      } else if (mem->pub.pack_block_arrays) {
+	/* It doesn't fit in memory, keep the rest packed in memory. */
+	bptr->rows_in_mem = (LJPEG_JDIMENSION) (max_minheights * bptr->maxaccess);
+	bptr->packed_rows = (LJPEG_packed_row *) LJPEG_alloc_small(cinfo,
+		JPOOL_IMAGE,
+		(size_t) bptr->rows_in_array * SIZEOF(LJPEG_packed_row));
+	for (row = 0; row < bptr->rows_in_array; row++) {
+	  bptr->packed_rows[row].data = NULL;
+	  bptr->packed_rows[row].space = 0;
+	}
       } else {
 	/* It doesn't fit in memory, create backing store. */
 	bptr->rows_in_mem = (LJPEG_JDIMENSION) (max_minheights * bptr->maxaccess);
+	bptr->b_s_info.mapped_address = NULL;
+	bptr->b_s_info.LJPEG_prefetch_backing_store = NULL;
 	LJPEG_jpeg_open_backing_store(cinfo, & bptr->b_s_info,
 				(long) bptr->rows_in_array *
 				(long) bptr->blocksperrow *
 				(long) SIZEOF(LJPEG_JBLOCK));
 	bptr->b_s_open = TRUE;
+	if (bptr->b_s_info.mapped_address != NULL) {
+	  /* Mapped backing store: point the rows into it, so no I/O occurs */
+	  LJPEG_JBLOCKROW rowptr = (LJPEG_JBLOCKROW) bptr->b_s_info.mapped_address;
+
+	  bptr->rows_in_mem = bptr->rows_in_array;
+	  bptr->mem_buffer = (LJPEG_JBLOCKARRAY) LJPEG_alloc_small(cinfo, JPOOL_IMAGE,
+		(size_t) (bptr->rows_in_array * SIZEOF(LJPEG_JBLOCKROW)));
+	  for (row = 0; row < bptr->rows_in_array; row++) {
+	    bptr->mem_buffer[row] = rowptr;
+	    rowptr += bptr->blocksperrow;
+	  }
+	  bptr->rowsperchunk = bptr->rows_in_array;
+	}
+      }
+      if (bptr->mem_buffer == NULL) {
+	bptr->mem_buffer = LJPEG_alloc_barray(cinfo, JPOOL_IMAGE,
+					bptr->blocksperrow, bptr->rows_in_mem);
+	bptr->rowsperchunk = mem->last_rowsperchunk;
       }
-      bptr->mem_buffer = LJPEG_alloc_barray(cinfo, JPOOL_IMAGE,
-				      bptr->blocksperrow, bptr->rows_in_mem);
-      bptr->rowsperchunk = mem->last_rowsperchunk;
       bptr->cur_start_row = 0;
       bptr->first_undef_row = 0;
       bptr->dirty = FALSE;
@@ -691,6 +1105,7 @@ LOCAL(void)
 LJPEG_do_sarray_io (LJPEG_j_common_ptr cinfo, LJPEG_jvirt_sarray_ptr ptr, boolean writing)
 /* Do backing store read or write of a virtual sample array */
 {
+  LJPEG_my_mem_ptr mem = (LJPEG_my_mem_ptr) cinfo->mem;
   long bytesperrow, file_offset, byte_count, rows, thisrow, i;
 
   bytesperrow = (long) ptr->samplesperrow * SIZEOF(LJPEG_JSAMPLE);
@@ -707,25 +1122,168 @@ LJPEG_do_sarray_io (LJPEG_j_common_ptr cinfo, LJPEG_jvirt_sarray_ptr ptr, boolea
     if (rows <= 0)		/* this chunk might be past end of file! */
       break;
     byte_count = rows * bytesperrow;
-    if (writing)
+    if (writing) {
       (*ptr->b_s_info.LJPEG_write_backing_store) (cinfo, & ptr->b_s_info,
 					    (void FAR *) ptr->mem_buffer[i],
 					    file_offset, byte_count);
-    else
+      mem->backing_store_written += byte_count;
+    } else {
       (*ptr->b_s_info.LJPEG_read_backing_store) (cinfo, & ptr->b_s_info,
 					   (void FAR *) ptr->mem_buffer[i],
 					   file_offset, byte_count);
+      mem->backing_store_read += byte_count;
+    }
     file_offset += byte_count;
   }
 }
 
 
+/*
+ * Packed storage of coefficient-block arrays.
+ * Most coefficients of a typical image are zero, so packing the rows that
+ * are outside the in-memory buffer usually takes a fraction of the space of
+ * the blocks themselves.  Each row's space is reused when the row is packed
+ * again, and only replaced (with some room to grow) if it is too small, as
+ * happens when successive progressive scans fill in more coefficients.
+ */
+
+LOCAL(void)
+LJPEG_pack_block_row (LJPEG_j_common_ptr cinfo, LJPEG_jvirt_barray_ptr ptr,
+		      LJPEG_JDIMENSION row, LJPEG_JBLOCKROW blocks)
+{
+  LJPEG_my_mem_ptr mem = (LJPEG_my_mem_ptr) cinfo->mem;
+  LJPEG_packed_row * prow = ptr->packed_rows + row;
+  register LJPEG_JCOEFPTR coef;
+  register LJPEG_JCOEF FAR * value;
+  UINT8 FAR * flags;
+  register int flagbyte, i, j;
+  LJPEG_JDIMENSION b;
+  long nonzero, bytes, space;
+
+  /* Count the nonzero coefficients to size the packed row */
+  nonzero = 0;
+  for (b = 0; b < ptr->blocksperrow; b++) {
+    coef = blocks[b];
+    for (i = 0; i < DCTSIZE2; i++) {
+      if (coef[i] != 0)
+	nonzero++;
+    }
+  }
+  bytes = (long) ptr->blocksperrow * DCTSIZE * SIZEOF(UINT8) +
+	  nonzero * SIZEOF(LJPEG_JCOEF);
+
+  if (bytes > (long) prow->space) {
+    if (prow->data != NULL) {
+      LJPEG_free_large_chunk(cinfo, mem->pub.allocator,
+			     (void FAR *) prow->data, prow->space);
+      mem->total_space_allocated -= (long) prow->space;
+      prow->data = NULL;
+      prow->space = 0;
+    }
+    if (bytes > MAX_ALLOC_CHUNK)
+      LJPEG_out_of_memory(cinfo, 5);	/* request exceeds malloc's ability */
+    space = MIN(bytes + bytes / 4, MAX_ALLOC_CHUNK);
+    prow->data = (UINT8 FAR *)
+      LJPEG_get_large_chunk(cinfo, mem->pub.allocator, (size_t) space);
+    if (prow->data == NULL)
+      LJPEG_out_of_memory(cinfo, 6);	/* LJPEG_get_large_chunk failed */
+    prow->space = (size_t) space;
+    mem->total_space_allocated += space;
+    if (mem->total_space_allocated > mem->peak_space_allocated)
+      mem->peak_space_allocated = mem->total_space_allocated;
+  }
+
+  flags = prow->data;
+  value = (LJPEG_JCOEF FAR *) (flags + (size_t) ptr->blocksperrow * DCTSIZE);
+  for (b = 0; b < ptr->blocksperrow; b++) {
+    coef = blocks[b];
+    for (i = 0; i < DCTSIZE2; i += DCTSIZE) {
+      flagbyte = 0;
+      for (j = 0; j < DCTSIZE; j++) {
+	if (coef[i+j] != 0) {
+	  flagbyte |= 1 << j;
+	  *value++ = coef[i+j];
+	}
+      }
+      *flags++ = (UINT8) flagbyte;
+    }
+  }
+}
+
+
+LOCAL(void)
+LJPEG_unpack_block_row (LJPEG_j_common_ptr cinfo, LJPEG_jvirt_barray_ptr ptr,
+			LJPEG_JDIMENSION row, LJPEG_JBLOCKROW blocks)
+{
+  LJPEG_packed_row * prow = ptr->packed_rows + row;
+  register LJPEG_JCOEFPTR coef;
+  register LJPEG_JCOEF FAR * value;
+  UINT8 FAR * flags;
+  register int flagbyte, i, j;
+  LJPEG_JDIMENSION b;
+
+  FMEMZERO((void FAR *) blocks,
+	   (size_t) ptr->blocksperrow * SIZEOF(LJPEG_JBLOCK));
+  if (prow->data == NULL)	/* only if the row was never written */
+    return;
+
+  flags = prow->data;
+  value = (LJPEG_JCOEF FAR *) (flags + (size_t) ptr->blocksperrow * DCTSIZE);
+  for (b = 0; b < ptr->blocksperrow; b++) {
+    coef = blocks[b];
+    for (i = 0; i < DCTSIZE2; i += DCTSIZE) {
+      for (flagbyte = *flags++ & 0xFF, j = i; flagbyte != 0;
+	   flagbyte >>= 1, j++) {
+	if (flagbyte & 1)
+	  coef[j] = *value++;
+      }
+    }
+  }
+}
+
+
+LOCAL(void)
+LJPEG_free_packed_rows (LJPEG_j_common_ptr cinfo, LJPEG_jvirt_barray_ptr ptr)
+{
+  LJPEG_my_mem_ptr mem = (LJPEG_my_mem_ptr) cinfo->mem;
+  LJPEG_JDIMENSION row;
+
+  for (row = 0; row < ptr->rows_in_array; row++) {
+    if (ptr->packed_rows[row].data != NULL) {
+      LJPEG_free_large_chunk(cinfo, mem->pub.allocator,
+			     (void FAR *) ptr->packed_rows[row].data,
+			     ptr->packed_rows[row].space);
+      mem->total_space_allocated -= (long) ptr->packed_rows[row].space;
+      ptr->packed_rows[row].data = NULL;
+    }
+  }
+}
+
+
 LOCAL(void)
 LJPEG_do_barray_io (LJPEG_j_common_ptr cinfo, LJPEG_jvirt_barray_ptr ptr, boolean writing)
 /* Do backing store read or write of a virtual coefficient-block array */
 {
+  LJPEG_my_mem_ptr mem = (LJPEG_my_mem_ptr) cinfo->mem;
   long bytesperrow, file_offset, byte_count, rows, thisrow, i;
 
+  /* Packed rows are not contiguous, so they are done one at a time */
+  if (ptr->packed_rows != NULL) {
+    rows = MIN((long) ptr->rows_in_mem,
+	       (long) ptr->first_undef_row - (long) ptr->cur_start_row);
+    rows = MIN(rows, (long) ptr->rows_in_array - (long) ptr->cur_start_row);
+    for (i = 0; i < rows; i++) {
+      thisrow = (long) ptr->cur_start_row + i;
+      if (writing)
+	LJPEG_pack_block_row(cinfo, ptr, (LJPEG_JDIMENSION) thisrow,
+			     ptr->mem_buffer[i]);
+      else
+	LJPEG_unpack_block_row(cinfo, ptr, (LJPEG_JDIMENSION) thisrow,
+			       ptr->mem_buffer[i]);
+    }
+    return;
+  }
+
   bytesperrow = (long) ptr->blocksperrow * SIZEOF(LJPEG_JBLOCK);
   file_offset = ptr->cur_start_row * bytesperrow;
   /* Loop to read or write each allocation chunk in mem_buffer */
@@ -740,19 +1298,59 @@ LJPEG_do_barray_io (LJPEG_j_common_ptr cinfo, LJPEG_jvirt_barray_ptr ptr, boolea
     if (rows <= 0)		/* this chunk might be past end of file! */
       break;
     byte_count = rows * bytesperrow;
-    if (writing)
+    if (writing) {
       (*ptr->b_s_info.LJPEG_write_backing_store) (cinfo, & ptr->b_s_info,
 					    (void FAR *) ptr->mem_buffer[i],
 					    file_offset, byte_count);
-    else
+      mem->backing_store_written += byte_count;
+    } else {
       (*ptr->b_s_info.LJPEG_read_backing_store) (cinfo, & ptr->b_s_info,
 					   (void FAR *) ptr->mem_buffer[i],
 					   file_offset, byte_count);
+      mem->backing_store_read += byte_count;
+    }
     file_offset += byte_count;
   }
 }
 
 
+/*
+ * After a new window of a virtual array has been read in, tell the backing
+ * store which rows are likely to come next: the following window when
+ * scanning forward, the preceding one when scanning backward.  The system
+ * can then read them while we work on the current window.
+ */
+
+LOCAL(void)
+LJPEG_prefetch_rows (LJPEG_j_common_ptr cinfo, LJPEG_backing_store_ptr info,
+		     long cur_start_row, long rows_in_mem,
+		     long first_undef_row, long bytesperrow, boolean forward)
+/* Common code for virtual sample and block arrays */
+{
+  long next_row, rows;
+
+  if (info->LJPEG_prefetch_backing_store == NULL)
+    return;
+  rows = rows_in_mem;
+  /* A window at the top is where a reading pass after the writing pass
+   * starts, so it is followed by the rows below it in any case.
+   */
+  if (forward || cur_start_row == 0)
+    next_row = cur_start_row + rows;
+  else {
+    rows = MIN(rows, cur_start_row);
+    next_row = cur_start_row - rows;
+  }
+  /* Rows never written are not in the file */
+  rows = MIN(rows, first_undef_row - next_row);
+  if (rows <= 0)
+    return;
+  (*info->LJPEG_prefetch_backing_store) (cinfo, info,
+					 next_row * bytesperrow,
+					 rows * bytesperrow);
+}
+
+
 LJPEG_METHODDEF(LJPEG_JSAMPARRAY)
 LJPEG_access_virt_sarray (LJPEG_j_common_ptr cinfo, LJPEG_jvirt_sarray_ptr ptr,
 		    LJPEG_JDIMENSION start_row, LJPEG_JDIMENSION num_rows,
@@ -763,6 +1361,7 @@ LJPEG_access_virt_sarray (LJPEG_j_common_ptr cinfo, LJPEG_jvirt_sarray_ptr ptr,
 {
   LJPEG_JDIMENSION end_row = start_row + num_rows;
   LJPEG_JDIMENSION undef_row;
+  boolean forward;
 
   /* debugging check */
   if (end_row > ptr->rows_in_array || num_rows > ptr->maxaccess ||
@@ -786,7 +1385,8 @@ LJPEG_access_virt_sarray (LJPEG_j_common_ptr cinfo, LJPEG_jvirt_sarray_ptr ptr,
      * Note that when switching from forward write to forward read, will have
      * start_row = 0, so the limiting case applies and we load from 0 anyway.
      */
-    if (start_row > ptr->cur_start_row) {
+    forward = (start_row > ptr->cur_start_row);
+    if (forward) {
       ptr->cur_start_row = start_row;
     } else {
       /* use long arithmetic here to avoid overflow & unsigned problems */
@@ -802,6 +1402,10 @@ LJPEG_access_virt_sarray (LJPEG_j_common_ptr cinfo, LJPEG_jvirt_sarray_ptr ptr,
      * because the selected part is all undefined.
      */
     LJPEG_do_sarray_io(cinfo, ptr, FALSE);
+    LJPEG_prefetch_rows(cinfo, & ptr->b_s_info, (long) ptr->cur_start_row,
+			(long) ptr->rows_in_mem, (long) ptr->first_undef_row,
+			(long) ptr->samplesperrow * SIZEOF(LJPEG_JSAMPLE),
+			forward);
   }
   /* Ensure the accessed part of the array is defined; prezero if needed.
    * To improve locality of access, we only prezero the part of the array
@@ -848,6 +1452,7 @@ LJPEG_access_virt_barray (LJPEG_j_common_ptr cinfo, LJPEG_jvirt_barray_ptr ptr,
 {
   LJPEG_JDIMENSION end_row = start_row + num_rows;
   LJPEG_JDIMENSION undef_row;
+  boolean forward;
 
   /* debugging check */
   if (end_row > ptr->rows_in_array || num_rows > ptr->maxaccess ||
@@ -857,7 +1462,7 @@ LJPEG_access_virt_barray (LJPEG_j_common_ptr cinfo, LJPEG_jvirt_barray_ptr ptr,
   /* Make the desired part of the virtual array accessible */
   if (start_row < ptr->cur_start_row ||
       end_row > ptr->cur_start_row+ptr->rows_in_mem) {
-    if (! ptr->b_s_open)
+    if (! ptr->b_s_open && ptr->packed_rows == NULL)
       ERREXIT(cinfo, JERR_VIRTUAL_BUG);
     /* Flush old buffer contents if necessary */
     if (ptr->dirty) {
@@ -871,7 +1476,8 @@ LJPEG_access_virt_barray (LJPEG_j_common_ptr cinfo, LJPEG_jvirt_barray_ptr ptr,
      * Note that when switching from forward write to forward read, will have
      * start_row = 0, so the limiting case applies and we load from 0 anyway.
      */
-    if (start_row > ptr->cur_start_row) {
+    forward = (start_row > ptr->cur_start_row);
+    if (forward) {
       ptr->cur_start_row = start_row;
     } else {
       /* use long arithmetic here to avoid overflow & unsigned problems */
@@ -887,6 +1493,11 @@ LJPEG_access_virt_barray (LJPEG_j_common_ptr cinfo, LJPEG_jvirt_barray_ptr ptr,
      * because the selected part is all undefined.
      */
     LJPEG_do_barray_io(cinfo, ptr, FALSE);
+    if (ptr->packed_rows == NULL)	/* packed rows are in memory already */
+      LJPEG_prefetch_rows(cinfo, & ptr->b_s_info, (long) ptr->cur_start_row,
+			  (long) ptr->rows_in_mem, (long) ptr->first_undef_row,
+			  (long) ptr->blocksperrow * SIZEOF(LJPEG_JBLOCK),
+			  forward);
   }
   /* Ensure the accessed part of the array is defined; prezero if needed.
    * To improve locality of access, we only prezero the part of the array
@@ -923,6 +1534,37 @@ LJPEG_access_virt_barray (LJPEG_j_common_ptr cinfo, LJPEG_jvirt_barray_ptr ptr,
 }
 
 
+/*
+ * Close the backing store of all virtual arrays and forget them.
+ * The control blocks themselves live in the IMAGE pool.
+ */
+
+LOCAL(void)
+LJPEG_close_virt_arrays (LJPEG_j_common_ptr cinfo)
+{
+  LJPEG_my_mem_ptr mem = (LJPEG_my_mem_ptr) cinfo->mem;
+  LJPEG_jvirt_sarray_ptr sptr;
+  LJPEG_jvirt_barray_ptr bptr;
+
+  for (sptr = mem->virt_sarray_list; sptr != NULL; sptr = sptr->next) {
+    if (sptr->b_s_open) {	/* there may be no backing store */
+      sptr->b_s_open = FALSE;	/* prevent recursive close if error */
+      (*sptr->b_s_info.LJPEG_close_backing_store) (cinfo, & sptr->b_s_info);
+    }
+  }
+  mem->virt_sarray_list = NULL;
+  for (bptr = mem->virt_barray_list; bptr != NULL; bptr = bptr->next) {
+    if (bptr->b_s_open) {	/* there may be no backing store */
+      bptr->b_s_open = FALSE;	/* prevent recursive close if error */
+      (*bptr->b_s_info.LJPEG_close_backing_store) (cinfo, & bptr->b_s_info);
+    }
+    if (bptr->packed_rows != NULL)
+      LJPEG_free_packed_rows(cinfo, bptr);
+  }
+  mem->virt_barray_list = NULL;
+}
+
+
 /*
  * Release all objects belonging to a specified pool.
  */
@@ -944,24 +1586,18 @@ LJPEG_free_pool (LJPEG_j_common_ptr cinfo, int pool_id)
 #endif
 
   /* If freeing IMAGE pool, close any virtual arrays first */
-  if (pool_id == JPOOL_IMAGE) {
-    LJPEG_jvirt_sarray_ptr sptr;
-    LJPEG_jvirt_barray_ptr bptr;
-
-    for (sptr = mem->virt_sarray_list; sptr != NULL; sptr = sptr->next) {
-      if (sptr->b_s_open) {	/* there may be no backing store */
-	sptr->b_s_open = FALSE;	/* prevent recursive close if error */
-	(*sptr->b_s_info.LJPEG_close_backing_store) (cinfo, & sptr->b_s_info);
-      }
-    }
-    mem->virt_sarray_list = NULL;
-    for (bptr = mem->virt_barray_list; bptr != NULL; bptr = bptr->next) {
-      if (bptr->b_s_open) {	/* there may be no backing store */
-	bptr->b_s_open = FALSE;	/* prevent recursive close if error */
-	(*bptr->b_s_info.LJPEG_close_backing_store) (cinfo, & bptr->b_s_info);
-      }
-    }
-    mem->virt_barray_list = NULL;
+  if (pool_id == JPOOL_IMAGE)
+    LJPEG_close_virt_arrays(cinfo);
+  mem->estimating = FALSE;	/* the marks may be gone */
+
+  /* Release recycled large chunks (already uncounted) */
+  lhdr_ptr = mem->large_free_list[pool_id];
+  mem->large_free_list[pool_id] = NULL;
+
+  while (lhdr_ptr != NULL) {
+    LJPEG_large_pool_ptr next_lhdr_ptr = lhdr_ptr->hdr.next;
+    (void) LJPEG_release_large_pool(cinfo, lhdr_ptr);
+    lhdr_ptr = next_lhdr_ptr;
   }
 
   /* Release large objects */
@@ -970,10 +1606,7 @@ LJPEG_free_pool (LJPEG_j_common_ptr cinfo, int pool_id)
 
   while (lhdr_ptr != NULL) {
     LJPEG_large_pool_ptr next_lhdr_ptr = lhdr_ptr->hdr.next;
-    space_freed = lhdr_ptr->hdr.bytes_used +
-		  lhdr_ptr->hdr.bytes_left +
-		  SIZEOF(LJPEG_large_pool_hdr);
-    LJPEG_jpeg_free_large(cinfo, (void FAR *) lhdr_ptr, space_freed);
+    space_freed = LJPEG_release_large_pool(cinfo, lhdr_ptr);
     mem->total_space_allocated -= space_freed;
     lhdr_ptr = next_lhdr_ptr;
   }
@@ -987,13 +1620,285 @@ LJPEG_free_pool (LJPEG_j_common_ptr cinfo, int pool_id)
     space_freed = shdr_ptr->hdr.bytes_used +
 		  shdr_ptr->hdr.bytes_left +
 		  SIZEOF(LJPEG_small_pool_hdr);
-    LJPEG_jpeg_free_small(cinfo, (void *) shdr_ptr, space_freed);
+    LJPEG_free_small_chunk(cinfo, mem->pub.allocator,
+			   (void *) shdr_ptr, space_freed);
     mem->total_space_allocated -= space_freed;
     shdr_ptr = next_shdr_ptr;
   }
 }
 
 
+/*
+ * Release all objects belonging to a specified pool, but keep the
+ * underlying memory for the pool's next life.  Small pools are simply
+ * emptied in place, so LJPEG_alloc_small will carve the same space again.
+ * Large chunks are moved to a free list from which LJPEG_alloc_large
+ * takes the best fit.  Chunks that stayed on the free list through a
+ * whole image are returned to the system here, so the retained space
+ * follows the needs of recent images rather than the largest one seen.
+ */
+
+LJPEG_METHODDEF(void)
+LJPEG_recycle_pool (LJPEG_j_common_ptr cinfo, int pool_id)
+{
+  LJPEG_my_mem_ptr mem = (LJPEG_my_mem_ptr) cinfo->mem;
+  LJPEG_small_pool_ptr shdr_ptr;
+  LJPEG_large_pool_ptr lhdr_ptr, next_lhdr_ptr;
+
+  if (pool_id < 0 || pool_id >= JPOOL_NUMPOOLS)
+    ERREXIT1(cinfo, JERR_BAD_POOL_ID, pool_id);	/* safety check */
+
+#ifdef MEM_STATS
+  if (cinfo->err->trace_level > 1)
+    LJPEG_print_mem_stats(cinfo, pool_id); /* print pool's memory usage statistics */
+#endif
+
+  /* Virtual arrays must not outlive their image */
+  if (pool_id == JPOOL_IMAGE)
+    LJPEG_close_virt_arrays(cinfo);
+  mem->estimating = FALSE;	/* the marks may be gone */
+
+  /* Give back chunks that were not reused by the last image */
+  lhdr_ptr = mem->large_free_list[pool_id];
+  while (lhdr_ptr != NULL) {
+    next_lhdr_ptr = lhdr_ptr->hdr.next;
+    (void) LJPEG_release_large_pool(cinfo, lhdr_ptr);
+    lhdr_ptr = next_lhdr_ptr;
+  }
+
+  /* Park the current large chunks for reuse */
+  lhdr_ptr = mem->large_list[pool_id];
+  mem->large_list[pool_id] = NULL;
+  mem->large_free_list[pool_id] = lhdr_ptr;
+  for (; lhdr_ptr != NULL; lhdr_ptr = lhdr_ptr->hdr.next)
+    mem->total_space_allocated -= lhdr_ptr->hdr.bytes_used +
+				  lhdr_ptr->hdr.bytes_left +
+				  SIZEOF(LJPEG_large_pool_hdr);
+
+  /* Empty the small pools in place */
+  for (shdr_ptr = mem->small_list[pool_id]; shdr_ptr != NULL;
+       shdr_ptr = shdr_ptr->hdr.next) {
+    shdr_ptr->hdr.bytes_left += shdr_ptr->hdr.bytes_used;
+    shdr_ptr->hdr.bytes_used = 0;
+  }
+}
+
+
+/*
+ * Measure what a stretch of initialization code allocates.
+ * LJPEG_jpeg_estimate_compress/decompress bracket the module setup of
+ * LJPEG_jpeg_start_compress/decompress with these calls.  LJPEG_end_estimate
+ * measures the pools and then releases the objects created in between,
+ * leaving the pools as they were before.  Recycled large chunks are not
+ * reused meanwhile, so that they remain for the real run.
+ * Virtual arrays are planned exactly as LJPEG_realize_virt_arrays would,
+ * but their buffers and backing store are not created.
+ */
+
+LJPEG_METHODDEF(void)
+LJPEG_begin_estimate (LJPEG_j_common_ptr cinfo)
+{
+  LJPEG_my_mem_ptr mem = (LJPEG_my_mem_ptr) cinfo->mem;
+  LJPEG_small_pool_ptr shdr_ptr;
+  int pool;
+
+  for (pool = JPOOL_NUMPOOLS-1; pool >= JPOOL_PERMANENT; pool--) {
+    mem->small_mark[pool] = NULL;
+    for (shdr_ptr = mem->small_list[pool]; shdr_ptr != NULL;
+	 shdr_ptr = shdr_ptr->hdr.next) {
+      shdr_ptr->hdr.bytes_marked = shdr_ptr->hdr.bytes_used;
+      mem->small_mark[pool] = shdr_ptr;
+    }
+    mem->large_mark[pool] = mem->large_list[pool];
+  }
+  mem->virt_sarray_mark = mem->virt_sarray_list;
+  mem->virt_barray_mark = mem->virt_barray_list;
+  mem->est_virt_space = 0;
+  mem->est_virt_in_memory = 0;
+  mem->est_backing_store = FALSE;
+  mem->estimating = TRUE;
+}
+
+
+LJPEG_METHODDEF(void)
+LJPEG_end_estimate (LJPEG_j_common_ptr cinfo, LJPEG_jpeg_estimate * estimate)
+/* Report what was allocated since LJPEG_begin_estimate (if estimate isn't
+ * NULL), then release it.
+ */
+{
+  LJPEG_my_mem_ptr mem = (LJPEG_my_mem_ptr) cinfo->mem;
+  LJPEG_small_pool_ptr shdr_ptr;
+  LJPEG_large_pool_ptr lhdr_ptr;
+  size_t space_freed;
+  int pool;
+
+  if (! mem->estimating)
+    return;
+
+  if (estimate != NULL) {
+    for (pool = JPOOL_NUMPOOLS-1; pool >= JPOOL_PERMANENT; pool--) {
+      estimate->pool_space[pool] = 0;
+      for (lhdr_ptr = mem->large_list[pool]; lhdr_ptr != NULL;
+	   lhdr_ptr = lhdr_ptr->hdr.next)
+	estimate->pool_space[pool] += (long) (lhdr_ptr->hdr.bytes_used +
+					      lhdr_ptr->hdr.bytes_left +
+					      SIZEOF(LJPEG_large_pool_hdr));
+      for (shdr_ptr = mem->small_list[pool]; shdr_ptr != NULL;
+	   shdr_ptr = shdr_ptr->hdr.next)
+	estimate->pool_space[pool] += (long) (shdr_ptr->hdr.bytes_used +
+					      shdr_ptr->hdr.bytes_left +
+					      SIZEOF(LJPEG_small_pool_hdr));
+    }
+    estimate->pool_space[JPOOL_IMAGE] += mem->est_virt_in_memory;
+    estimate->peak_space = mem->total_space_allocated +
+			   mem->est_virt_in_memory;
+    estimate->virt_array_space = mem->est_virt_space;
+    estimate->virt_array_in_memory = mem->est_virt_in_memory;
+    estimate->backing_store = mem->est_backing_store;
+  }
+
+  /* Virtual arrays requested since are unrealized and have no backing store */
+  mem->virt_sarray_list = mem->virt_sarray_mark;
+  mem->virt_barray_list = mem->virt_barray_mark;
+
+  for (pool = JPOOL_NUMPOOLS-1; pool >= JPOOL_PERMANENT; pool--) {
+    /* Large chunks are pushed on the front of the list */
+    lhdr_ptr = mem->large_list[pool];
+    mem->large_list[pool] = mem->large_mark[pool];
+    while (lhdr_ptr != mem->large_mark[pool]) {
+      LJPEG_large_pool_ptr next_lhdr_ptr = lhdr_ptr->hdr.next;
+      space_freed = LJPEG_release_large_pool(cinfo, lhdr_ptr);
+      mem->total_space_allocated -= space_freed;
+      lhdr_ptr = next_lhdr_ptr;
+    }
+    /* Older small pools get their space back; new ones are at the end */
+    if (mem->small_mark[pool] == NULL) {
+      shdr_ptr = mem->small_list[pool];
+      mem->small_list[pool] = NULL;
+    } else {
+      for (shdr_ptr = mem->small_list[pool]; ; shdr_ptr = shdr_ptr->hdr.next) {
+	shdr_ptr->hdr.bytes_left += shdr_ptr->hdr.bytes_used -
+				    shdr_ptr->hdr.bytes_marked;
+	shdr_ptr->hdr.bytes_used = shdr_ptr->hdr.bytes_marked;
+	if (shdr_ptr == mem->small_mark[pool])
+	  break;
+      }
+      shdr_ptr = mem->small_mark[pool]->hdr.next;
+      mem->small_mark[pool]->hdr.next = NULL;
+    }
+    while (shdr_ptr != NULL) {
+      LJPEG_small_pool_ptr next_shdr_ptr = shdr_ptr->hdr.next;
+      space_freed = shdr_ptr->hdr.bytes_used +
+		    shdr_ptr->hdr.bytes_left +
+		    SIZEOF(LJPEG_small_pool_hdr);
+      LJPEG_free_small_chunk(cinfo, mem->pub.allocator,
+			     (void *) shdr_ptr, space_freed);
+      mem->total_space_allocated -= space_freed;
+      shdr_ptr = next_shdr_ptr;
+    }
+  }
+
+  mem->estimating = FALSE;
+}
+
+
+/*
+ * Report the memory manager's activity.  The space figures are found by
+ * walking the pools, so this costs nothing until it is called; only the
+ * peak, the request counts and the backing-store traffic are counted as
+ * they happen.
+ */
+
+LJPEG_METHODDEF(void)
+LJPEG_get_mem_stats (LJPEG_j_common_ptr cinfo, LJPEG_jpeg_memory_stats * stats)
+{
+  LJPEG_my_mem_ptr mem = (LJPEG_my_mem_ptr) cinfo->mem;
+  LJPEG_small_pool_ptr shdr_ptr;
+  LJPEG_large_pool_ptr lhdr_ptr;
+  LJPEG_jvirt_sarray_ptr sptr;
+  LJPEG_jvirt_barray_ptr bptr;
+  LJPEG_JDIMENSION row;
+  long space, bytesperrow;
+  int pool;
+
+  stats->small_space = 0;
+  stats->large_space = 0;
+  for (pool = JPOOL_NUMPOOLS-1; pool >= JPOOL_PERMANENT; pool--) {
+    stats->pool_space[pool] = 0;
+    for (lhdr_ptr = mem->large_list[pool]; lhdr_ptr != NULL;
+	 lhdr_ptr = lhdr_ptr->hdr.next) {
+      space = (long) (lhdr_ptr->hdr.bytes_used + lhdr_ptr->hdr.bytes_left +
+		      SIZEOF(LJPEG_large_pool_hdr));
+      stats->pool_space[pool] += space;
+      stats->large_space += space;
+    }
+    for (shdr_ptr = mem->small_list[pool]; shdr_ptr != NULL;
+	 shdr_ptr = shdr_ptr->hdr.next) {
+      space = (long) (shdr_ptr->hdr.bytes_used + shdr_ptr->hdr.bytes_left +
+		      SIZEOF(LJPEG_small_pool_hdr));
+      stats->pool_space[pool] += space;
+      stats->small_space += space;
+    }
+    stats->small_allocs[pool] = mem->small_allocs[pool];
+    stats->large_allocs[pool] = mem->large_allocs[pool];
+  }
+  stats->total_space = mem->total_space_allocated;
+  stats->peak_space = mem->peak_space_allocated;
+
+  /* Only realized arrays count; mapped backing store is not in memory */
+  stats->virt_array_space = 0;
+  stats->virt_array_in_memory = 0;
+  stats->virt_array_swapped = 0;
+  for (sptr = mem->virt_sarray_list; sptr != NULL; sptr = sptr->next) {
+    if (sptr->mem_buffer == NULL)
+      continue;
+    bytesperrow = (long) sptr->samplesperrow * SIZEOF(LJPEG_JSAMPLE);
+    space = (long) sptr->rows_in_array * bytesperrow;
+    stats->virt_array_space += space;
+    if (sptr->b_s_open)
+      stats->virt_array_swapped += space;
+    if (! sptr->b_s_open || sptr->b_s_info.mapped_address == NULL)
+      stats->virt_array_in_memory += (long) sptr->rows_in_mem * bytesperrow;
+  }
+  stats->virt_array_packed = 0;
+  for (bptr = mem->virt_barray_list; bptr != NULL; bptr = bptr->next) {
+    if (bptr->mem_buffer == NULL)
+      continue;
+    if (bptr->packed_rows != NULL) {
+      for (row = 0; row < bptr->rows_in_array; row++)
+	stats->virt_array_packed += (long) bptr->packed_rows[row].space;
+    }
+    bytesperrow = (long) bptr->blocksperrow * SIZEOF(LJPEG_JBLOCK);
+    space = (long) bptr->rows_in_array * bytesperrow;
+    stats->virt_array_space += space;
+    if (bptr->b_s_open)
+      stats->virt_array_swapped += space;
+    if (! bptr->b_s_open || bptr->b_s_info.mapped_address == NULL)
+      stats->virt_array_in_memory += (long) bptr->rows_in_mem * bytesperrow;
+  }
+
+  stats->backing_store_read = mem->backing_store_read;
+  stats->backing_store_written = mem->backing_store_written;
+}
+
+
+LJPEG_METHODDEF(void)
+LJPEG_reset_mem_stats (LJPEG_j_common_ptr cinfo)
+/* Restart the counts, and the peak from the space now held */
+{
+  LJPEG_my_mem_ptr mem = (LJPEG_my_mem_ptr) cinfo->mem;
+  int pool;
+
+  for (pool = JPOOL_NUMPOOLS-1; pool >= JPOOL_PERMANENT; pool--) {
+    mem->small_allocs[pool] = 0;
+    mem->large_allocs[pool] = 0;
+  }
+  mem->peak_space_allocated = mem->total_space_allocated;
+  mem->backing_store_read = 0;
+  mem->backing_store_written = 0;
+}
+
+
 /*
  * Close up shop entirely.
  * Note that this cannot be called unless cinfo->mem is non-NULL.
@@ -1002,6 +1907,7 @@ LJPEG_free_pool (LJPEG_j_common_ptr cinfo, int pool_id)
 LJPEG_METHODDEF(void)
 LJPEG_self_destruct (LJPEG_j_common_ptr cinfo)
 {
+  struct LJPEG_jpeg_allocator * allocator = cinfo->mem->allocator;
   int pool;
 
   /* Close all backing store, release all memory.
@@ -1013,7 +1919,8 @@ LJPEG_self_destruct (LJPEG_j_common_ptr cinfo)
   }
 
   /* Release the memory manager control block too. */
-  LJPEG_jpeg_free_small(cinfo, (void *) cinfo->mem, SIZEOF(LJPEG_my_memory_mgr));
+  LJPEG_free_small_chunk(cinfo, allocator,
+			 (void *) cinfo->mem, SIZEOF(LJPEG_my_memory_mgr));
   cinfo->mem = NULL;		/* ensures I will be called only once */
 
   LJPEG_jpeg_mem_term(cinfo);		/* system-dependent cleanup */
@@ -1023,9 +1930,11 @@ LJPEG_self_destruct (LJPEG_j_common_ptr cinfo)
 /*
  * Memory manager initialization.
  * When this is called, only the error manager pointer is valid in cinfo!
+ * allocator is the application's chunk allocator, or NULL to use the
+ * system-dependent routines.
  */
 GLOBAL(void)
-LJPEG_jinit_memory_mgr (LJPEG_j_common_ptr cinfo)
+LJPEG_jinit_memory_mgr (LJPEG_j_common_ptr cinfo, struct LJPEG_jpeg_allocator * allocator)
 {
   LJPEG_my_mem_ptr mem;
   long max_to_use;
@@ -1056,7 +1965,8 @@ LJPEG_jinit_memory_mgr (LJPEG_j_common_ptr cinfo)
   max_to_use = LJPEG_jpeg_mem_init(cinfo); /* system-dependent initialization */
 
   /* Attempt to allocate memory manager's control block */
-  mem = (LJPEG_my_mem_ptr) LJPEG_jpeg_get_small(cinfo, SIZEOF(LJPEG_my_memory_mgr));
+  mem = (LJPEG_my_mem_ptr)
+    LJPEG_get_small_chunk(cinfo, allocator, SIZEOF(LJPEG_my_memory_mgr));
 
   if (mem == NULL) {
     LJPEG_jpeg_mem_term(cinfo);	/* system-dependent cleanup */
@@ -1066,6 +1976,8 @@ LJPEG_jinit_memory_mgr (LJPEG_j_common_ptr cinfo)
   /* OK, fill in the method pointers */
   mem->pub.LJPEG_alloc_small = LJPEG_alloc_small;
   mem->pub.LJPEG_alloc_large = LJPEG_alloc_large;
+  mem->pub.LJPEG_alloc_detached = LJPEG_alloc_detached;
+  mem->pub.LJPEG_attach_detached = LJPEG_attach_detached;
   mem->pub.LJPEG_alloc_sarray = LJPEG_alloc_sarray;
   mem->pub.LJPEG_alloc_barray = LJPEG_alloc_barray;
   mem->pub.LJPEG_request_virt_sarray = LJPEG_request_virt_sarray;
@@ -1074,22 +1986,39 @@ LJPEG_jinit_memory_mgr (LJPEG_j_common_ptr cinfo)
   mem->pub.LJPEG_access_virt_sarray = LJPEG_access_virt_sarray;
   mem->pub.LJPEG_access_virt_barray = LJPEG_access_virt_barray;
   mem->pub.LJPEG_free_pool = LJPEG_free_pool;
+  mem->pub.LJPEG_recycle_pool = LJPEG_recycle_pool;
+  mem->pub.LJPEG_begin_estimate = LJPEG_begin_estimate;
+  mem->pub.LJPEG_end_estimate = LJPEG_end_estimate;
+  mem->pub.LJPEG_get_mem_stats = LJPEG_get_mem_stats;
+  mem->pub.LJPEG_reset_mem_stats = LJPEG_reset_mem_stats;
   mem->pub.LJPEG_self_destruct = LJPEG_self_destruct;
 
+  mem->pub.allocator = allocator;
+
   /* Make MAX_ALLOC_CHUNK accessible to other modules */
   mem->pub.max_alloc_chunk = MAX_ALLOC_CHUNK;
 
   /* Initialize working state */
   mem->pub.max_memory_to_use = max_to_use;
+  mem->pub.recycle_image_pool = FALSE;
+  mem->pub.row_alignment = 0;
+  mem->pub.pack_block_arrays = FALSE;
 
   for (pool = JPOOL_NUMPOOLS-1; pool >= JPOOL_PERMANENT; pool--) {
     mem->small_list[pool] = NULL;
     mem->large_list[pool] = NULL;
+    mem->large_free_list[pool] = NULL;
+    mem->small_allocs[pool] = 0;
+    mem->large_allocs[pool] = 0;
   }
   mem->virt_sarray_list = NULL;
   mem->virt_barray_list = NULL;
+  mem->estimating = FALSE;
 
   mem->total_space_allocated = SIZEOF(LJPEG_my_memory_mgr);
+  mem->peak_space_allocated = mem->total_space_allocated;
+  mem->backing_store_read = 0;
+  mem->backing_store_written = 0;
 
   /* Declare ourselves open for business */
   cinfo->mem = & mem->pub;
@@ -17,6 +17,11 @@
 #include "jpeglib.h"
 #include "jmemsys.h"		/* import the system-dependent declarations */
 
+#ifdef HAVE_POSIX_FADVISE	/* for the read-ahead hint */
+#include <sys/types.h>
+#include <fcntl.h>
+#endif
+
 #ifndef HAVE_STDLIB_H		/* <stdlib.h> should declare malloc(),free() */
 extern void * malloc LJPEG_JPP((size_t size));
 extern void free LJPEG_JPP((void *ptr));
@@ -226,6 +231,20 @@ LJPEG_write_backing_store (LJPEG_j_common_ptr cinfo, LJPEG_backing_store_ptr inf
 }
 
 
+#ifdef POSIX_FADV_WILLNEED
+
+LJPEG_METHODDEF(void)
+LJPEG_prefetch_backing_store (LJPEG_j_common_ptr cinfo, LJPEG_backing_store_ptr info,
+			long file_offset, long byte_count)
+{
+  /* This follows a read, so no written data is left in the stdio buffer */
+  (void) posix_fadvise(fileno(info->temp_file), (off_t) file_offset,
+		       (off_t) byte_count, POSIX_FADV_WILLNEED);
+}
+
+#endif /* POSIX_FADV_WILLNEED */
+
+
 LJPEG_METHODDEF(void)
 LJPEG_close_backing_store (LJPEG_j_common_ptr cinfo, LJPEG_backing_store_ptr info)
 {
@@ -253,6 +272,9 @@ LJPEG_jpeg_open_backing_store (LJPEG_j_common_ptr cinfo, LJPEG_backing_store_ptr
   info->LJPEG_read_backing_store = LJPEG_read_backing_store;
   info->LJPEG_write_backing_store = LJPEG_write_backing_store;
   info->LJPEG_close_backing_store = LJPEG_close_backing_store;
+#ifdef POSIX_FADV_WILLNEED
+  info->LJPEG_prefetch_backing_store = LJPEG_prefetch_backing_store;
+#endif
   TRACEMSS(cinfo, 1, JTRC_TFILE_OPEN, info->temp_name);
 }
 
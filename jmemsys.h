@@ -109,8 +109,16 @@ EXTERN(long) LJPEG_jpeg_mem_available LJPEG_JPP((LJPEG_j_common_ptr cinfo,
 /*
  * This structure holds whatever state is needed to access a single
  * backing-store object.  The read/write/close method pointers are called
- * by jmemmgr.c to manipulate the backing-store object; all other fields
- * are private to the system-dependent backing store routines.
+ * by jmemmgr.c to manipulate the backing-store object.  If the open routine
+ * can map the whole object into the address space, it stores the address of
+ * the mapping in mapped_address (which jmemmgr.c sets to NULL beforehand);
+ * jmemmgr.c then accesses the virtual array in place and never calls the
+ * read/write methods.  The open routine may also supply a prefetch method
+ * (jmemmgr.c sets it to NULL beforehand): after reading a strip, jmemmgr.c
+ * calls it with the part of the object it expects to read next, so that
+ * the system can start fetching that in the background.  It is only a hint
+ * and must not fail.  All other fields are private to the system-dependent
+ * backing store routines.
  */
 
 #define TEMP_NAME_LENGTH   64	/* max length of a temporary file's name */
@@ -148,6 +156,12 @@ typedef struct LJPEG_backing_store_struct {
 				      long file_offset, long byte_count));
   LJPEG_JMETHOD(void, LJPEG_close_backing_store, (LJPEG_j_common_ptr cinfo,
 				      LJPEG_backing_store_ptr info));
+  LJPEG_JMETHOD(void, LJPEG_prefetch_backing_store, (LJPEG_j_common_ptr cinfo,
+					 LJPEG_backing_store_ptr info,
+					 long file_offset, long byte_count));
+
+  /* Address of the whole object if mapped into memory, else NULL */
+  void FAR * mapped_address;
 
   /* Private fields for system-dependent backing-store management */
 #ifdef USE_MSDOS_MEMMGR
@@ -164,6 +178,7 @@ typedef struct LJPEG_backing_store_struct {
   /* For a typical implementation with temp files, we need: */
   FILE * temp_file;		/* stdio reference to temp file */
   char temp_name[TEMP_NAME_LENGTH]; /* name of temp file */
+  size_t mapped_size;		/* length of mapping, if jmemmap.c mapped it */
 #endif
 #endif
 } LJPEG_backing_store_info;
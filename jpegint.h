@@ -51,6 +51,12 @@ struct LJPEG_jpeg_comp_master {
   /* State variables made visible to other modules */
   boolean call_LJPEG_pass_startup;	/* True if LJPEG_pass_startup must be called */
   boolean is_last_pass;		/* True during last pass */
+  boolean parallel_scans;	/* True if scans are entropy-coded concurrently */
+
+  /* Workspace for raw data input from cinfo->raw_planes; see jcapistd.c */
+  LJPEG_JSAMPIMAGE plane_rows;	/* one iMCU row of pointers per component */
+  LJPEG_JSAMPIMAGE plane_scratch; /* rows for planes the DCT can't read */
+  LJPEG_JSAMPIMAGE plane_edge;	/* last block column of unpadded planes */
 };
 
 /* Main buffer control (downsampled-data buffer) */
@@ -143,6 +149,11 @@ struct LJPEG_jpeg_decomp_master {
 
   /* State variables made visible to other modules */
   boolean is_dummy_pass;	/* True during 1st pass for 2-pass quant */
+
+  /* Workspace for raw data output to cinfo->raw_planes; see jdapistd.c */
+  LJPEG_JSAMPIMAGE plane_rows;	/* one iMCU row of pointers per component */
+  LJPEG_JSAMPIMAGE plane_scratch; /* rows for planes the IDCT can't fill */
+  LJPEG_JSAMPROW plane_dummy;	/* target for rows below the image */
 };
 
 /* Input control module */
@@ -163,6 +174,9 @@ struct LJPEG_jpeg_d_main_controller {
   LJPEG_JMETHOD(void, process_data, (LJPEG_j_decompress_ptr cinfo,
 			       LJPEG_JSAMPARRAY output_buf, LJPEG_JDIMENSION *out_row_ctr,
 			       LJPEG_JDIMENSION out_rows_avail));
+  /* Output rows for a row listener when the application gives none */
+  LJPEG_JSAMPARRAY strip;		/* NULL if there is no row listener */
+  LJPEG_JDIMENSION strip_height;	/* one iMCU row's worth of output rows */
 };
 
 /* Coefficient buffer control */
@@ -259,6 +273,15 @@ struct LJPEG_jpeg_color_quantizer {
   LJPEG_JMETHOD(void, new_color_map, (LJPEG_j_decompress_ptr cinfo));
 };
 
+/* Constant tables kept across images when the IMAGE pool is recycled.
+ * Created in the PERMANENT pool by the first image that starts with
+ * cinfo->mem->recycle_image_pool set; NULL until then.
+ */
+struct LJPEG_jpeg_table_cache {
+  void * huff_tbls;		/* private to jdhuff.c, or NULL */
+  void * mult_tbls;		/* private to jddctmgr.c, or NULL */
+};
+
 
 /* Miscellaneous useful macros */
 
@@ -298,6 +321,7 @@ struct LJPEG_jpeg_color_quantizer {
 #define LJPEG_jinit_c_main_controller	jICMainC
 #define LJPEG_jinit_c_prep_controller	jICPrepC
 #define LJPEG_jinit_c_coef_controller	jICCoefC
+#define LJPEG_jinit_c_coef_scan_copy	jICCoefS
 #define LJPEG_jinit_color_converter	jICColor
 #define LJPEG_jinit_downsampler	jIDownsampler
 #define LJPEG_jinit_forward_dct	jIFDCT
@@ -312,6 +336,7 @@ struct LJPEG_jpeg_color_quantizer {
 #define LJPEG_jinit_marker_reader	jIMReader
 #define LJPEG_jinit_huff_decoder	jIHDecoder
 #define LJPEG_jinit_arith_decoder	jIADecoder
+#define LJPEG_jinit_arith_interval_decoder	jIAIDecoder
 #define LJPEG_jinit_inverse_dct	jIIDCT
 #define LJPEG_jinit_upsampler		jIUpsampler
 #define LJPEG_jinit_color_deconverter	jIDColor
@@ -319,6 +344,9 @@ struct LJPEG_jpeg_color_quantizer {
 #define LJPEG_jinit_2pass_quantizer	jI2Quant
 #define LJPEG_jinit_merged_upsampler	jIMUpsampler
 #define LJPEG_jinit_memory_mgr	jIMemMgr
+#define LJPEG_jinit_task_error	jITaskErr
+#define LJPEG_jmerge_task_error	jMrgTaskErr
+#define LJPEG_jraise_task_error	jRsTaskErr
 #define LJPEG_jdiv_round_up		jDivRound
 #define LJPEG_jround_up		jRound
 #define LJPEG_jzero_far		jZeroFar
@@ -332,6 +360,11 @@ struct LJPEG_jpeg_color_quantizer {
 #define LJPEG_jpeg_natural_order4	jZAG4Table
 #define LJPEG_jpeg_natural_order3	jZAG3Table
 #define LJPEG_jpeg_natural_order2	jZAG2Table
+#define LJPEG_jpeg_range_limit	jRangeLimit
+#define LJPEG_jpeg_Cr_r_tab		jCrRTab
+#define LJPEG_jpeg_Cb_b_tab		jCbBTab
+#define LJPEG_jpeg_Cr_g_tab		jCrGTab
+#define LJPEG_jpeg_Cb_g_tab		jCbGTab
 #define LJPEG_jpeg_aritab		jAriTab
 #endif /* NEED_SHORT_EXTERNAL_NAMES */
 
@@ -366,6 +399,8 @@ EXTERN(void) LJPEG_jinit_c_prep_controller LJPEG_JPP((LJPEG_j_compress_ptr cinfo
 					  boolean need_full_buffer));
 EXTERN(void) LJPEG_jinit_c_coef_controller LJPEG_JPP((LJPEG_j_compress_ptr cinfo,
 					  boolean need_full_buffer));
+EXTERN(void) LJPEG_jinit_c_coef_scan_copy LJPEG_JPP((LJPEG_j_compress_ptr cinfo,
+					 LJPEG_j_compress_ptr scaninfo));
 EXTERN(void) LJPEG_jinit_color_converter LJPEG_JPP((LJPEG_j_compress_ptr cinfo));
 EXTERN(void) LJPEG_jinit_downsampler LJPEG_JPP((LJPEG_j_compress_ptr cinfo));
 EXTERN(void) LJPEG_jinit_forward_dct LJPEG_JPP((LJPEG_j_compress_ptr cinfo));
@@ -384,6 +419,7 @@ EXTERN(void) LJPEG_jinit_input_controller LJPEG_JPP((LJPEG_j_decompress_ptr cinf
 EXTERN(void) LJPEG_jinit_marker_reader LJPEG_JPP((LJPEG_j_decompress_ptr cinfo));
 EXTERN(void) LJPEG_jinit_huff_decoder LJPEG_JPP((LJPEG_j_decompress_ptr cinfo));
 EXTERN(void) LJPEG_jinit_arith_decoder LJPEG_JPP((LJPEG_j_decompress_ptr cinfo));
+EXTERN(void) LJPEG_jinit_arith_interval_decoder LJPEG_JPP((LJPEG_j_decompress_ptr cinfo));
 EXTERN(void) LJPEG_jinit_inverse_dct LJPEG_JPP((LJPEG_j_decompress_ptr cinfo));
 EXTERN(void) LJPEG_jinit_upsampler LJPEG_JPP((LJPEG_j_decompress_ptr cinfo));
 EXTERN(void) LJPEG_jinit_color_deconverter LJPEG_JPP((LJPEG_j_decompress_ptr cinfo));
@@ -391,7 +427,31 @@ EXTERN(void) LJPEG_jinit_1pass_quantizer LJPEG_JPP((LJPEG_j_decompress_ptr cinfo
 EXTERN(void) LJPEG_jinit_2pass_quantizer LJPEG_JPP((LJPEG_j_decompress_ptr cinfo));
 EXTERN(void) LJPEG_jinit_merged_upsampler LJPEG_JPP((LJPEG_j_decompress_ptr cinfo));
 /* Memory manager initialization */
-EXTERN(void) LJPEG_jinit_memory_mgr LJPEG_JPP((LJPEG_j_common_ptr cinfo));
+EXTERN(void) LJPEG_jinit_memory_mgr LJPEG_JPP((LJPEG_j_common_ptr cinfo,
+					   struct LJPEG_jpeg_allocator * allocator));
+
+/* Error handling for tasks run by the task dispatcher, in jcomapi.c.
+ * A task reports to a private error manager: warnings are counted there,
+ * and an error returns to the setjmp point in the task routine.  The main
+ * thread then passes the warnings on and re-raises the error, if any.
+ */
+typedef struct {
+  struct LJPEG_jpeg_error_mgr pub; /* private error manager for the task */
+  jmp_buf setjmp_buffer;	/* set by the task routine */
+  boolean failed;		/* TRUE if the task ended with an error */
+  int warning_code;		/* first warning of the task, to reissue */
+  union {
+    int i[8];
+    char s[JMSG_STR_PARM_MAX];
+  } warning_parm;
+} LJPEG_jpeg_task_error_mgr;
+
+EXTERN(void) LJPEG_jinit_task_error LJPEG_JPP((LJPEG_j_common_ptr cinfo,
+					   LJPEG_jpeg_task_error_mgr * err));
+EXTERN(boolean) LJPEG_jmerge_task_error LJPEG_JPP((LJPEG_j_common_ptr cinfo,
+					       LJPEG_jpeg_task_error_mgr * err));
+EXTERN(void) LJPEG_jraise_task_error LJPEG_JPP((LJPEG_j_common_ptr cinfo,
+					    LJPEG_jpeg_task_error_mgr * err));
 
 /* Utility routines in jutils.c */
 EXTERN(long) LJPEG_jdiv_round_up LJPEG_JPP((long a, long b));
@@ -412,6 +472,11 @@ extern const int LJPEG_jpeg_natural_order5[]; /* zz to natural order for 5x5 blo
 extern const int LJPEG_jpeg_natural_order4[]; /* zz to natural order for 4x4 block */
 extern const int LJPEG_jpeg_natural_order3[]; /* zz to natural order for 3x3 block */
 extern const int LJPEG_jpeg_natural_order2[]; /* zz to natural order for 2x2 block */
+extern const LJPEG_JSAMPLE LJPEG_jpeg_range_limit[]; /* see jdmaster.c */
+extern const int LJPEG_jpeg_Cr_r_tab[];	/* YCC->RGB conversion tables, */
+extern const int LJPEG_jpeg_Cb_b_tab[];	/* see jdcolor.c */
+extern const INT32 LJPEG_jpeg_Cr_g_tab[];
+extern const INT32 LJPEG_jpeg_Cb_g_tab[];
 
 /* Arithmetic coding probability estimation tables in jaricom.c */
 extern const INT32 LJPEG_jpeg_aritab[];
@@ -197,6 +197,14 @@ typedef struct {
   int Ah, Al;			/* progressive JPEG successive approx. parms */
 } LJPEG_jpeg_scan_info;
 
+/* Raw data can be taken from or put straight into planes of these: */
+
+typedef struct {
+  LJPEG_JSAMPROW base;		/* first sample of the plane's top row */
+  LJPEG_JDIMENSION row_stride;	/* samples from one row to the next */
+  int sample_step;		/* samples from one column to the next */
+} LJPEG_jpeg_raw_plane;
+
 /* The decompressor can save APPn and COM markers in a list of these: */
 
 typedef struct LJPEG_jpeg_marker_struct FAR * LJPEG_jpeg_saved_marker_ptr;
@@ -258,6 +266,7 @@ typedef enum {
   struct LJPEG_jpeg_error_mgr * err;	/* Error handler module */\
   struct LJPEG_jpeg_memory_mgr * mem;	/* Memory manager module */\
   struct LJPEG_jpeg_progress_mgr * progress; /* Progress monitor, or NULL if none */\
+  struct LJPEG_jpeg_task_mgr * task;	/* Task dispatcher, or NULL if none */\
   void * client_data;		/* Available for use by application */\
   boolean is_decompressor;	/* So common code can tell which is which */\
   int global_state		/* For checking call sequence validity */
@@ -348,8 +357,11 @@ struct LJPEG_jpeg_compress_struct {
    */
 
   boolean raw_data_in;		/* TRUE=caller supplies downsampled data */
+  /* Whole-image planes, one per component, to take raw data from directly */
+  LJPEG_jpeg_raw_plane * raw_planes; /* NULL if not wanted */
   boolean arith_code;		/* TRUE=arithmetic coding, FALSE=Huffman */
   boolean optimize_coding;	/* TRUE=optimize entropy encoding parms */
+  boolean parallel_scans;	/* TRUE=entropy-code scans concurrently */
   boolean CCIR601_sampling;	/* TRUE=first samples are cosited */
   boolean do_fancy_downsampling; /* TRUE=apply fancy downsampling */
   int smoothing_factor;		/* 1..100, or 0 for no input smoothing */
@@ -476,10 +488,13 @@ struct LJPEG_jpeg_decompress_struct {
 
   boolean buffered_image;	/* TRUE=multiple output passes */
   boolean raw_data_out;		/* TRUE=downsampled data wanted */
+  /* Whole-image planes, one per component, for raw data to go to directly */
+  LJPEG_jpeg_raw_plane * raw_planes; /* NULL if not wanted */
 
   LJPEG_J_DCT_METHOD dct_method;	/* IDCT algorithm selector */
   boolean do_fancy_upsampling;	/* TRUE=apply fancy upsampling */
   boolean do_block_smoothing;	/* TRUE=apply interblock smoothing */
+  boolean parallel_restarts;	/* TRUE=decode restart intervals in parallel */
 
   boolean quantize_colors;	/* TRUE=colormapped output wanted */
   /* the following are ignored if not quantize_colors: */
@@ -491,6 +506,15 @@ struct LJPEG_jpeg_decompress_struct {
   boolean enable_external_quant;/* enable future use of external colormap */
   boolean enable_2pass_quant;	/* enable future use of 2-pass quantizer */
 
+  /* Told of each group of output rows as it is finished, if not NULL */
+  struct LJPEG_jpeg_row_listener * row_listener;
+
+  /* TRUE if a Huffman table that no DHT marker has defined is to be taken
+   * as the standard one of JPEG section K.3, as Motion-JPEG frames expect.
+   * Set by LJPEG_jpeg_mjpeg_stream; not reset by LJPEG_jpeg_read_header.
+   */
+  boolean std_huff_default;
+
   /* Description of actual output image that will be returned to application.
    * These fields are computed by LJPEG_jpeg_start_decompress().
    * You can also use LJPEG_jpeg_calc_output_dimensions() to determine these values
@@ -633,6 +657,7 @@ struct LJPEG_jpeg_decompress_struct {
    */
 
   LJPEG_JSAMPLE * sample_range_limit; /* table for fast range-limiting */
+				/* (shared by all objects: read only!) */
 
   /*
    * These fields are valid during any one scan.
@@ -679,6 +704,7 @@ struct LJPEG_jpeg_decompress_struct {
   struct LJPEG_jpeg_upsampler * upsample;
   struct LJPEG_jpeg_color_deconverter * cconvert;
   struct LJPEG_jpeg_color_quantizer * cquantize;
+  struct LJPEG_jpeg_table_cache * table_cache;
 };
 
 
@@ -760,6 +786,58 @@ struct LJPEG_jpeg_progress_mgr {
 };
 
 
+/* Task dispatcher object (optional) */
+
+typedef LJPEG_JMETHOD(void, LJPEG_jpeg_task_method, (void * task_data));
+
+struct LJPEG_jpeg_task_mgr {
+  /* Run task(task_data[i]) for i = 0..num_tasks-1, in any order and on any
+   * threads, and return when all of them have completed.
+   */
+  LJPEG_JMETHOD(void, run_tasks, (LJPEG_j_common_ptr cinfo,
+				  LJPEG_jpeg_task_method task,
+				  void * task_data[], int num_tasks));
+};
+
+
+/* Row listener object (optional) */
+
+struct LJPEG_jpeg_row_listener {
+  /* Called as soon as output rows first_row .. first_row+num_rows-1 are
+   * final.  rows[] points to them where they were decoded: in the buffer
+   * given to LJPEG_jpeg_read_scanlines, or in the library's own strip if that
+   * was NULL.  The rows may be read or changed in place, but are only
+   * valid until the call returns.
+   */
+  LJPEG_JMETHOD(void, rows_ready, (LJPEG_j_decompress_ptr cinfo,
+				   LJPEG_JSAMPARRAY rows,
+				   LJPEG_JDIMENSION first_row,
+				   LJPEG_JDIMENSION num_rows));
+};
+
+
+/* Chunk allocator object (optional) */
+
+struct LJPEG_jpeg_allocator {
+  /* Obtain and release the chunks from which the memory manager carves
+   * its pools, in place of the system-dependent LJPEG_jpeg_get_small,
+   * LJPEG_jpeg_free_small, LJPEG_jpeg_get_large and LJPEG_jpeg_free_large.
+   * The get routines return NULL on failure; the free routines are passed
+   * the size that was requested for the chunk.  Each routine is passed
+   * the allocator object itself, so it can find its arena.
+   */
+  LJPEG_JMETHOD(void *, get_small, (struct LJPEG_jpeg_allocator * self,
+				    size_t sizeofobject));
+  LJPEG_JMETHOD(void, free_small, (struct LJPEG_jpeg_allocator * self,
+				   void * object, size_t sizeofobject));
+  LJPEG_JMETHOD(void FAR *, get_large, (struct LJPEG_jpeg_allocator * self,
+					size_t sizeofobject));
+  LJPEG_JMETHOD(void, free_large, (struct LJPEG_jpeg_allocator * self,
+				   void FAR * object, size_t sizeofobject));
+  void * arena;			/* Available for use by the allocator */
+};
+
+
 /* Data destination object for compression */
 
 struct LJPEG_jpeg_destination_mgr {
@@ -771,6 +849,33 @@ struct LJPEG_jpeg_destination_mgr {
   LJPEG_JMETHOD(void, LJPEG_term_destination, (LJPEG_j_compress_ptr cinfo));
 };
 
+/* Output buffer allocator for LJPEG_jpeg_mem_dest_alloc (optional) */
+
+struct LJPEG_jpeg_buffer_allocator {
+  /* Resize the buffer at ptr (NULL for a new buffer) to newsize bytes,
+   * keeping its contents, as realloc() does.  Return NULL on failure.
+   */
+  LJPEG_JMETHOD(void *, realloc_buffer, (struct LJPEG_jpeg_buffer_allocator * self,
+					 void * ptr, size_t newsize));
+  void * arena;			/* Available for use by the allocator */
+};
+
+/* One of the caller's buffers for LJPEG_jpeg_scatter_dest */
+
+typedef struct {
+  JOCTET * buffer;		/* start of buffer (set by caller) */
+  size_t size;			/* size of buffer (set by caller) */
+  size_t used;			/* # of bytes written (set by library) */
+} LJPEG_jpeg_output_chunk;
+
+
+/* One of the caller's buffers for LJPEG_jpeg_gather_src */
+
+typedef struct {
+  const JOCTET * buffer;	/* start of buffer */
+  size_t size;			/* # of bytes of JPEG data in it */
+} LJPEG_jpeg_input_chunk;
+
 
 /* Data source object for decompression */
 
@@ -783,6 +888,8 @@ struct LJPEG_jpeg_source_mgr {
   LJPEG_JMETHOD(void, LJPEG_skip_input_data, (LJPEG_j_decompress_ptr cinfo, long num_bytes));
   LJPEG_JMETHOD(boolean, resync_to_restart, (LJPEG_j_decompress_ptr cinfo, int desired));
   LJPEG_JMETHOD(void, LJPEG_term_source, (LJPEG_j_decompress_ptr cinfo));
+
+  boolean resident;		/* TRUE if buffer holds all remaining data */
 };
 
 
@@ -804,6 +911,43 @@ struct LJPEG_jpeg_source_mgr {
 typedef struct LJPEG_jvirt_sarray_control * LJPEG_jvirt_sarray_ptr;
 typedef struct LJPEG_jvirt_barray_control * LJPEG_jvirt_barray_ptr;
 
+/* Resources needed to start processing an image, as reported by
+ * LJPEG_jpeg_estimate_compress and LJPEG_jpeg_estimate_decompress.
+ * Space is counted in bytes obtained from the system, pool headers and
+ * alignment padding included.
+ */
+
+typedef struct {
+  long pool_space[JPOOL_NUMPOOLS]; /* space held by each pool */
+  long peak_space;		/* total space held by the memory manager */
+  long virt_array_space;	/* full size of all virtual arrays */
+  long virt_array_in_memory;	/* part of it held in memory buffers */
+  boolean backing_store;	/* TRUE if some virtual array needs backing store */
+  int num_scans;		/* scans to be written or (estimated) read */
+  int total_passes;		/* passes over the image data */
+} LJPEG_jpeg_estimate;
+
+/* Memory manager activity, as reported by its LJPEG_get_mem_stats method.
+ * Space figures are current, except the peak; counts and I/O totals
+ * accumulate from object creation or the last LJPEG_reset_mem_stats call.
+ */
+
+typedef struct {
+  long pool_space[JPOOL_NUMPOOLS]; /* space held by each pool */
+  long small_space;		/* held in small-object pools */
+  long large_space;		/* held in large objects */
+  long total_space;		/* all space held by the memory manager */
+  long peak_space;		/* high-water mark of total_space */
+  long small_allocs[JPOOL_NUMPOOLS]; /* LJPEG_alloc_small requests per pool */
+  long large_allocs[JPOOL_NUMPOOLS]; /* LJPEG_alloc_large requests per pool */
+  long virt_array_space;	/* full size of realized virtual arrays */
+  long virt_array_in_memory;	/* part of it held in memory buffers */
+  long virt_array_swapped;	/* size of arrays kept in backing store */
+  long virt_array_packed;	/* space held by packed block-array rows */
+  long backing_store_read;	/* bytes read from backing store */
+  long backing_store_written;	/* bytes written to backing store */
+} LJPEG_jpeg_memory_stats;
+
 
 struct LJPEG_jpeg_memory_mgr {
   /* Method pointers */
@@ -811,6 +955,10 @@ struct LJPEG_jpeg_memory_mgr {
 				size_t sizeofobject));
   LJPEG_JMETHOD(void FAR *, LJPEG_alloc_large, (LJPEG_j_common_ptr cinfo, int pool_id,
 				     size_t sizeofobject));
+  LJPEG_JMETHOD(void FAR *, LJPEG_alloc_detached, (LJPEG_j_common_ptr cinfo,
+					size_t sizeofobject));
+  LJPEG_JMETHOD(void, LJPEG_attach_detached, (LJPEG_j_common_ptr cinfo, int pool_id,
+				       void FAR * object));
   LJPEG_JMETHOD(LJPEG_JSAMPARRAY, LJPEG_alloc_sarray, (LJPEG_j_common_ptr cinfo, int pool_id,
 				     LJPEG_JDIMENSION samplesperrow,
 				     LJPEG_JDIMENSION numrows));
@@ -842,6 +990,13 @@ struct LJPEG_jpeg_memory_mgr {
 					    boolean writable));
   LJPEG_JMETHOD(void, LJPEG_free_pool, (LJPEG_j_common_ptr cinfo, int pool_id));
   LJPEG_JMETHOD(void, LJPEG_self_destruct, (LJPEG_j_common_ptr cinfo));
+  LJPEG_JMETHOD(void, LJPEG_recycle_pool, (LJPEG_j_common_ptr cinfo, int pool_id));
+  LJPEG_JMETHOD(void, LJPEG_begin_estimate, (LJPEG_j_common_ptr cinfo));
+  LJPEG_JMETHOD(void, LJPEG_end_estimate, (LJPEG_j_common_ptr cinfo,
+					  LJPEG_jpeg_estimate * estimate));
+  LJPEG_JMETHOD(void, LJPEG_get_mem_stats, (LJPEG_j_common_ptr cinfo,
+					   LJPEG_jpeg_memory_stats * stats));
+  LJPEG_JMETHOD(void, LJPEG_reset_mem_stats, (LJPEG_j_common_ptr cinfo));
 
   /* Limit on memory allocation for this JPEG object.  (Note that this is
    * merely advisory, not a guaranteed maximum; it only affects the space
@@ -852,6 +1007,30 @@ struct LJPEG_jpeg_memory_mgr {
 
   /* Maximum allocation request accepted by LJPEG_alloc_large. */
   long max_alloc_chunk;
+
+  /* Chunk allocator given at object creation, or NULL.  Read-only. */
+  struct LJPEG_jpeg_allocator * allocator;
+
+  /* If TRUE, LJPEG_jpeg_abort (and hence LJPEG_jpeg_finish_compress/decompress)
+   * recycles the per-image pool instead of freeing it, and decompressors
+   * keep constant derived tables from one image to the next.  May be set
+   * by outer application after creating the JPEG object.
+   */
+  boolean recycle_image_pool;
+
+  /* If nonzero, a power of 2 up to 4096: all objects and every row of
+   * LJPEG_alloc_sarray/barray arrays start on a multiple of this many
+   * bytes, and rows are padded to a multiple of it.  May be set by outer
+   * application before LJPEG_jpeg_start_compress/decompress.
+   */
+  long row_alignment;
+
+  /* If TRUE, the rows of coefficient-block virtual arrays that do not fit
+   * within max_memory_to_use are kept packed in memory, with only their
+   * nonzero coefficients stored, instead of in backing store.  May be set
+   * by outer application before the arrays are realized.
+   */
+  boolean pack_block_arrays;
 };
 
 
@@ -861,6 +1040,46 @@ struct LJPEG_jpeg_memory_mgr {
 typedef LJPEG_JMETHOD(boolean, LJPEG_jpeg_marker_parser_method, (LJPEG_j_decompress_ptr cinfo));
 
 
+/* One image of a batch for LJPEG_jpeg_decode_batch. */
+
+typedef struct {
+  const JOCTET * data;		/* the compressed image */
+  size_t size;			/* its length in bytes */
+  LJPEG_JSAMPROW buffer;	/* where the decompressed image goes */
+  size_t buffer_size;		/* space at buffer, in samples */
+  size_t row_stride;		/* samples from one row to the next, 0=packed */
+  /* Set by LJPEG_jpeg_decode_batch: */
+  LJPEG_JDIMENSION width, height; /* output dimensions */
+  int components;		/* samples per pixel */
+  long num_warnings;		/* corrupt-data warnings for this image */
+  boolean done;			/* TRUE once the image has been decoded */
+} LJPEG_jpeg_batch_item;
+
+/* What LJPEG_jpeg_probe finds out about a JPEG datastream. */
+
+typedef struct {
+  LJPEG_JDIMENSION image_width;	/* nominal image width (from SOF marker) */
+  LJPEG_JDIMENSION image_height; /* nominal image height */
+  int num_components;		/* # of color components in JPEG image */
+  int data_precision;		/* bits of precision in image data */
+  int sof_marker;		/* SOFn marker code (0xC0..0xCF) */
+  boolean progressive_mode;	/* TRUE if SOFn specifies progressive mode */
+  boolean arith_code;		/* TRUE=arithmetic coding, FALSE=Huffman */
+  int component_id[MAX_COMPONENTS]; /* identifiers, in SOF order */
+  int h_samp_factor[MAX_COMPONENTS]; /* horizontal sampling factors */
+  int v_samp_factor[MAX_COMPONENTS]; /* vertical sampling factors */
+  boolean saw_JFIF_marker;	/* TRUE iff a JFIF APP0 marker was found */
+  boolean saw_Adobe_marker;	/* TRUE iff an Adobe APP14 marker was found */
+  UINT8 Adobe_transform;	/* Color transform code from Adobe marker */
+  boolean saw_ICC_profile;	/* TRUE iff an ICC_PROFILE APP2 was found */
+  int orientation;		/* Exif orientation 1..8, or 0 if none */
+} LJPEG_jpeg_probe_info;
+
+/* Routine signature for setting each batch image's decompression parameters */
+typedef LJPEG_JMETHOD(void, LJPEG_jpeg_batch_setup_method,
+		      (LJPEG_j_decompress_ptr cinfo, LJPEG_jpeg_batch_item * item));
+
+
 /* Declarations for routines called by application.
  * The LJPEG_JPP macro hides prototype parameters from compilers that can't cope.
  * Note LJPEG_JPP requires double parentheses.
@@ -884,12 +1103,18 @@ typedef LJPEG_JMETHOD(boolean, LJPEG_jpeg_marker_parser_method, (LJPEG_j_decompr
 #define LJPEG_jpeg_std_error		        LJPEG_jStdError
 #define LJPEG_jpeg_CreateCompress	        LJPEG_jCreaCompress
 #define LJPEG_jpeg_CreateDecompress	        LJPEG_jCreaDecompress
+#define LJPEG_jpeg_CreateCompressAlloc	    LJPEG_jCreaCompAlloc
+#define LJPEG_jpeg_CreateDecompressAlloc    LJPEG_jCreaDecompAlloc
 #define LJPEG_jpeg_destroy_compress	        LJPEG_jDestCompress
 #define LJPEG_jpeg_destroy_decompress	    LJPEG_jDestDecompress
 #define LJPEG_jpeg_stdio_dest		        LJPEG_jStdDest
 #define LJPEG_jpeg_stdio_src		        LJPEG_jStdSrc
 #define LJPEG_jpeg_mem_dest		            LJPEG_jMemDest
+#define LJPEG_jpeg_mem_dest_alloc	        LJPEG_jMemDestAlloc
+#define LJPEG_jpeg_scatter_dest	            LJPEG_jScatDest
 #define LJPEG_jpeg_mem_src		            LJPEG_jMemSrc
+#define LJPEG_jpeg_mmap_src		            LJPEG_jMmapSrc
+#define LJPEG_jpeg_gather_src	            LJPEG_jGathSrc
 #define LJPEG_jpeg_set_defaults	            LJPEG_jSetDefaults
 #define LJPEG_jpeg_set_colorspace	        LJPEG_jSetColorspace
 #define LJPEG_jpeg_default_colorspace	    LJPEG_jDefColorspace
@@ -906,6 +1131,7 @@ typedef LJPEG_JMETHOD(boolean, LJPEG_jpeg_marker_parser_method, (LJPEG_j_decompr
 #define LJPEG_jpeg_write_scanlines	        LJPEG_jWrtScanlines
 #define LJPEG_jpeg_finish_compress	        LJPEG_jFinCompress
 #define LJPEG_jpeg_calc_jpeg_dimensions	    LJPEG_jCjpegDimensions
+#define LJPEG_jpeg_estimate_compress	    LJPEG_jEstCompress
 #define LJPEG_jpeg_write_raw_data	        LJPEG_jWrtRawData
 #define LJPEG_jpeg_write_marker	            LJPEG_jWrtMarker
 #define LJPEG_jpeg_write_m_header	        LJPEG_jWrtMHeader
@@ -920,10 +1146,19 @@ typedef LJPEG_JMETHOD(boolean, LJPEG_jpeg_marker_parser_method, (LJPEG_j_decompr
 #define LJPEG_jpeg_start_output	            LJPEG_jStrtOutput
 #define LJPEG_jpeg_finish_output	        LJPEG_jFinOutput
 #define LJPEG_jpeg_input_complete	        LJPEG_jInComplete
+#define LJPEG_jpeg_push_src		            LJPEG_jPushSrc
+#define LJPEG_jpeg_feed		                LJPEG_jFeed
+#define LJPEG_jpeg_feed_end	            LJPEG_jFeedEnd
+#define LJPEG_jpeg_push_start	            LJPEG_jPushStart
+#define LJPEG_jpeg_decode_batch	            LJPEG_jDecBatch
+#define LJPEG_jpeg_mjpeg_stream	            LJPEG_jMJPEGStream
+#define LJPEG_jpeg_probe		            LJPEG_jProbe
 #define LJPEG_jpeg_new_colormap	            LJPEG_jNewCMap
+#define LJPEG_jpeg_new_scale	            LJPEG_jNewScale
 #define LJPEG_jpeg_consume_input	        LJPEG_jConsumeInput
 #define LJPEG_jpeg_core_output_dimensions	LJPEG_jCoreDimensions
 #define LJPEG_jpeg_calc_output_dimensions	LJPEG_jCalcDimensions
+#define LJPEG_jpeg_estimate_decompress	    LJPEG_jEstDecompress
 #define LJPEG_jpeg_save_markers	            LJPEG_jSaveMarkers
 #define LJPEG_jpeg_set_marker_processor	    LJPEG_jSetMarker
 #define LJPEG_jpeg_read_coefficients	    LJPEG_jReadCoefs
@@ -958,6 +1193,21 @@ EXTERN(void) LJPEG_jpeg_CreateCompress LJPEG_JPP((LJPEG_j_compress_ptr cinfo,
 				      int version, size_t structsize));
 EXTERN(void) LJPEG_jpeg_CreateDecompress LJPEG_JPP((LJPEG_j_decompress_ptr cinfo,
 					int version, size_t structsize));
+/* Variants that take the memory manager's chunks from an application-
+ * supplied allocator (which must outlive the object) instead of jmemsys.
+ */
+#define LJPEG_jpeg_create_compress_alloc(cinfo,allocator) \
+    LJPEG_jpeg_CreateCompressAlloc((cinfo), (allocator), JPEG_LIB_VERSION, \
+			     (size_t) sizeof(struct LJPEG_jpeg_compress_struct))
+#define LJPEG_jpeg_create_decompress_alloc(cinfo,allocator) \
+    LJPEG_jpeg_CreateDecompressAlloc((cinfo), (allocator), JPEG_LIB_VERSION, \
+			       (size_t) sizeof(struct LJPEG_jpeg_decompress_struct))
+EXTERN(void) LJPEG_jpeg_CreateCompressAlloc LJPEG_JPP((LJPEG_j_compress_ptr cinfo,
+				struct LJPEG_jpeg_allocator * allocator,
+				int version, size_t structsize));
+EXTERN(void) LJPEG_jpeg_CreateDecompressAlloc LJPEG_JPP((LJPEG_j_decompress_ptr cinfo,
+				struct LJPEG_jpeg_allocator * allocator,
+				int version, size_t structsize));
 /* Destruction of JPEG compression objects */
 EXTERN(void) LJPEG_jpeg_destroy_compress LJPEG_JPP((LJPEG_j_compress_ptr cinfo));
 EXTERN(void) LJPEG_jpeg_destroy_decompress LJPEG_JPP((LJPEG_j_decompress_ptr cinfo));
@@ -974,6 +1224,22 @@ EXTERN(void) LJPEG_jpeg_mem_dest LJPEG_JPP((LJPEG_j_compress_ptr cinfo,
 EXTERN(void) LJPEG_jpeg_mem_src LJPEG_JPP((LJPEG_j_decompress_ptr cinfo,
 			      unsigned char * inbuffer,
 			      unsigned long insize));
+/* Memory destination with an initial size and a caller's allocator. */
+EXTERN(void) LJPEG_jpeg_mem_dest_alloc LJPEG_JPP((LJPEG_j_compress_ptr cinfo,
+				     unsigned char ** outbuffer,
+				     unsigned long * outsize,
+				     size_t size_hint,
+				     struct LJPEG_jpeg_buffer_allocator * allocator));
+/* Data destination manager: a list of caller-supplied fixed buffers. */
+EXTERN(void) LJPEG_jpeg_scatter_dest LJPEG_JPP((LJPEG_j_compress_ptr cinfo,
+				   LJPEG_jpeg_output_chunk * chunks,
+				   int num_chunks));
+/* Data source manager: a stdio stream read through a memory mapping. */
+EXTERN(void) LJPEG_jpeg_mmap_src LJPEG_JPP((LJPEG_j_decompress_ptr cinfo, FILE * infile));
+/* Data source manager: a list of memory buffers read in turn. */
+EXTERN(void) LJPEG_jpeg_gather_src LJPEG_JPP((LJPEG_j_decompress_ptr cinfo,
+				 const LJPEG_jpeg_input_chunk * chunks,
+				 int num_chunks));
 
 /* Default parameter setup for compression */
 EXTERN(void) LJPEG_jpeg_set_defaults LJPEG_JPP((LJPEG_j_compress_ptr cinfo));
@@ -1010,6 +1276,10 @@ EXTERN(void) LJPEG_jpeg_finish_compress LJPEG_JPP((LJPEG_j_compress_ptr cinfo));
 /* Precalculate JPEG dimensions for current compression parameters. */
 EXTERN(void) LJPEG_jpeg_calc_jpeg_dimensions LJPEG_JPP((LJPEG_j_compress_ptr cinfo));
 
+/* Predict the memory and passes LJPEG_jpeg_start_compress will set up. */
+EXTERN(void) LJPEG_jpeg_estimate_compress LJPEG_JPP((LJPEG_j_compress_ptr cinfo,
+					 LJPEG_jpeg_estimate * estimate));
+
 /* Replaces LJPEG_jpeg_write_scanlines when writing raw downsampled data. */
 EXTERN(LJPEG_JDIMENSION) LJPEG_jpeg_write_raw_data LJPEG_JPP((LJPEG_j_compress_ptr cinfo,
 					    LJPEG_JSAMPIMAGE data,
@@ -1041,6 +1311,10 @@ EXTERN(int) LJPEG_jpeg_read_header LJPEG_JPP((LJPEG_j_decompress_ptr cinfo,
  * give a suspension return (the stdio source module doesn't).
  */
 
+/* Read the image geometry from a buffer without a JPEG object. */
+EXTERN(boolean) LJPEG_jpeg_probe LJPEG_JPP((const JOCTET * data, size_t size,
+				    LJPEG_jpeg_probe_info * info));
+
 /* Main entry points for decompression */
 EXTERN(boolean) LJPEG_jpeg_start_decompress LJPEG_JPP((LJPEG_j_decompress_ptr cinfo));
 EXTERN(LJPEG_JDIMENSION) LJPEG_jpeg_read_scanlines LJPEG_JPP((LJPEG_j_decompress_ptr cinfo,
@@ -1060,6 +1334,7 @@ EXTERN(boolean) LJPEG_jpeg_start_output LJPEG_JPP((LJPEG_j_decompress_ptr cinfo,
 EXTERN(boolean) LJPEG_jpeg_finish_output LJPEG_JPP((LJPEG_j_decompress_ptr cinfo));
 EXTERN(boolean) LJPEG_jpeg_input_complete LJPEG_JPP((LJPEG_j_decompress_ptr cinfo));
 EXTERN(void) LJPEG_jpeg_new_colormap LJPEG_JPP((LJPEG_j_decompress_ptr cinfo));
+EXTERN(void) LJPEG_jpeg_new_scale LJPEG_JPP((LJPEG_j_decompress_ptr cinfo));
 EXTERN(int) LJPEG_jpeg_consume_input LJPEG_JPP((LJPEG_j_decompress_ptr cinfo));
 /* Return value is one of: */
 /* #define JPEG_SUSPENDED	0    Suspended due to lack of input data */
@@ -1068,10 +1343,33 @@ EXTERN(int) LJPEG_jpeg_consume_input LJPEG_JPP((LJPEG_j_decompress_ptr cinfo));
 #define JPEG_ROW_COMPLETED	3 /* Completed one iMCU row */
 #define JPEG_SCAN_COMPLETED	4 /* Completed last iMCU row of a scan */
 
+/* Push-style decoding: the application feeds data as it arrives.
+ * Return values are as for LJPEG_jpeg_consume_input.
+ */
+EXTERN(void) LJPEG_jpeg_push_src LJPEG_JPP((LJPEG_j_decompress_ptr cinfo));
+EXTERN(int) LJPEG_jpeg_feed LJPEG_JPP((LJPEG_j_decompress_ptr cinfo,
+			       const JOCTET * data, size_t len));
+EXTERN(int) LJPEG_jpeg_feed_end LJPEG_JPP((LJPEG_j_decompress_ptr cinfo));
+EXTERN(int) LJPEG_jpeg_push_start LJPEG_JPP((LJPEG_j_decompress_ptr cinfo,
+				     LJPEG_JSAMPARRAY image));
+
+/* Decode a series of in-memory images on one object, reusing its setup. */
+EXTERN(int) LJPEG_jpeg_decode_batch LJPEG_JPP((LJPEG_j_decompress_ptr cinfo,
+				       LJPEG_jpeg_batch_item * items,
+				       int num_items,
+				       LJPEG_jpeg_batch_setup_method setup));
+
+/* Prepare an object to decode a Motion-JPEG stream one frame at a time. */
+EXTERN(void) LJPEG_jpeg_mjpeg_stream LJPEG_JPP((LJPEG_j_decompress_ptr cinfo));
+
 /* Precalculate output dimensions for current decompression parameters. */
 EXTERN(void) LJPEG_jpeg_core_output_dimensions LJPEG_JPP((LJPEG_j_decompress_ptr cinfo));
 EXTERN(void) LJPEG_jpeg_calc_output_dimensions LJPEG_JPP((LJPEG_j_decompress_ptr cinfo));
 
+/* Predict the memory and passes LJPEG_jpeg_start_decompress will set up. */
+EXTERN(void) LJPEG_jpeg_estimate_decompress LJPEG_JPP((LJPEG_j_decompress_ptr cinfo,
+					   LJPEG_jpeg_estimate * estimate));
+
 /* Control saving of COM and APPn markers into marker_list. */
 EXTERN(void) LJPEG_jpeg_save_markers
 	LJPEG_JPP((LJPEG_j_decompress_ptr cinfo, int marker_code,
@@ -1148,6 +1446,7 @@ struct LJPEG_jpeg_inverse_dct { long dummy; };
 struct LJPEG_jpeg_upsampler { long dummy; };
 struct LJPEG_jpeg_color_deconverter { long dummy; };
 struct LJPEG_jpeg_color_quantizer { long dummy; };
+struct LJPEG_jpeg_table_cache { long dummy; };
 #endif /* JPEG_INTERNALS */
 #endif /* INCOMPLETE_TYPES_BROKEN */
 
@@ -197,6 +197,7 @@ typedef struct {
   /* Space for the eventually created colormap is stashed here */
   LJPEG_JSAMPARRAY sv_colormap;	/* colormap allocated at init time */
   int desired;			/* desired # of colors = size of colormap */
+  void * boxlist;		/* LJPEG_select_colors workspace, ditto */
 
   /* Variables for accumulating image statistics */
   hist3d histogram;		/* pointer to the histogram */
@@ -540,13 +541,11 @@ LOCAL(void)
 LJPEG_select_colors (LJPEG_j_decompress_ptr cinfo, int desired_colors)
 /* Master routine for color selection */
 {
-  LJPEG_boxptr boxlist;
+  LJPEG_my_cquantize_ptr cquantize = (LJPEG_my_cquantize_ptr) cinfo->cquantize;
+  LJPEG_boxptr boxlist = (LJPEG_boxptr) cquantize->boxlist;
   int numboxes;
   int i;
 
-  /* Allocate workspace for box list */
-  boxlist = (LJPEG_boxptr) (*cinfo->mem->LJPEG_alloc_small)
-    ((LJPEG_j_common_ptr) cinfo, JPOOL_IMAGE, desired_colors * SIZEOF(LJPEG_box));
   /* Initialize one box containing whole space */
   numboxes = 1;
   boxlist[0].c0min = 0;
@@ -1286,8 +1285,13 @@ LJPEG_jinit_2pass_quantizer (LJPEG_j_decompress_ptr cinfo)
     cquantize->sv_colormap = (*cinfo->mem->LJPEG_alloc_sarray)
       ((LJPEG_j_common_ptr) cinfo,JPOOL_IMAGE, (LJPEG_JDIMENSION) desired, (LJPEG_JDIMENSION) 3);
     cquantize->desired = desired;
-  } else
+    /* The box list is needed each time a colormap is selected */
+    cquantize->boxlist = (*cinfo->mem->LJPEG_alloc_small)
+      ((LJPEG_j_common_ptr) cinfo, JPOOL_IMAGE, desired * SIZEOF(LJPEG_box));
+  } else {
     cquantize->sv_colormap = NULL;
+    cquantize->boxlist = NULL;
+  }
 
   /* Only F-S dithering or no dithering is supported. */
   /* If user asks for ordered dither, give him F-S. */
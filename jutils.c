@@ -116,6 +116,81 @@ const int LJPEG_jpeg_natural_order2[2*2+16] = {
 };
 
 
+/*
+ * The decompressor's sample-value tables depend only on BITS_IN_JSAMPLE,
+ * so rather than have every decompression object allocate and fill its own
+ * copies, we let the compiler build them once for the whole process.
+ * TBL_n(m,i) expands to the n initializers m(i), m(i+1), ..., m(i+n-1);
+ * TBL_SAMPLES covers MAXJSAMPLE+1 values, TBL_CENTER covers CENTERJSAMPLE.
+ */
+
+#define TBL_4(m,i)	m(i) m((i)+1) m((i)+2) m((i)+3)
+#define TBL_16(m,i)	TBL_4(m,i) TBL_4(m,(i)+4) TBL_4(m,(i)+8) TBL_4(m,(i)+12)
+#define TBL_64(m,i)	TBL_16(m,i) TBL_16(m,(i)+16) \
+			TBL_16(m,(i)+32) TBL_16(m,(i)+48)
+#define TBL_256(m,i)	TBL_64(m,i) TBL_64(m,(i)+64) \
+			TBL_64(m,(i)+128) TBL_64(m,(i)+192)
+#define TBL_1024(m,i)	TBL_256(m,i) TBL_256(m,(i)+256) \
+			TBL_256(m,(i)+512) TBL_256(m,(i)+768)
+
+#if BITS_IN_JSAMPLE == 8
+#define TBL_SAMPLES(m)	TBL_256(m,0)
+#define TBL_CENTER(m)	TBL_64(m,0) TBL_64(m,64)
+#else
+#define TBL_SAMPLES(m)	TBL_1024(m,0) TBL_1024(m,1024) \
+			TBL_1024(m,2048) TBL_1024(m,3072)
+#define TBL_CENTER(m)	TBL_1024(m,0) TBL_1024(m,1024)
+#endif
+
+
+/*
+ * LJPEG_jpeg_range_limit is the sample range-limiting table described in
+ * jdmaster.c; cinfo->sample_range_limit points MAXJSAMPLE+1 entries into it.
+ * In order, it holds MAXJSAMPLE+1 zeroes, the values 0..MAXJSAMPLE,
+ * MAXJSAMPLE+1+CENTERJSAMPLE copies of MAXJSAMPLE, 2*(MAXJSAMPLE+1)-
+ * CENTERJSAMPLE zeroes, and finally the values 0..CENTERJSAMPLE-1.
+ */
+
+#define RL_ZERO(i)	0,
+#define RL_SAME(i)	(i),
+#define RL_MAX(i)	MAXJSAMPLE,
+
+const LJPEG_JSAMPLE LJPEG_jpeg_range_limit[5 * (MAXJSAMPLE+1) + CENTERJSAMPLE] = {
+  TBL_SAMPLES(RL_ZERO)
+  TBL_SAMPLES(RL_SAME)
+  TBL_SAMPLES(RL_MAX) TBL_CENTER(RL_MAX)
+  TBL_SAMPLES(RL_ZERO) TBL_CENTER(RL_ZERO)
+  TBL_CENTER(RL_SAME)
+};
+
+
+/*
+ * Tables for YCC->RGB colorspace conversion, used by jdcolor.c and
+ * jdmerge.c; see jdcolor.c for the derivation.  Entry i is for the
+ * Cb or Cr value x = i - CENTERJSAMPLE.  The RGB_SHIFT bias makes the
+ * shifted quantity nonnegative, so that >> rounds towards minus infinity
+ * here just as RIGHT_SHIFT does in the original table-building loop.
+ */
+
+#define SCALEBITS	16
+#define ONE_HALF	((INT32) 1 << (SCALEBITS-1))
+#define FIX(x)		((INT32) ((x) * (1L<<SCALEBITS) + 0.5))
+#define RGB_SHIFT	((INT32) 4096 << SCALEBITS)
+
+#define CR_R(i)  (int) ((FIX(1.40200) * ((INT32) (i) - CENTERJSAMPLE) + \
+			 ONE_HALF + RGB_SHIFT) >> SCALEBITS) - 4096,
+#define CB_B(i)  (int) ((FIX(1.77200) * ((INT32) (i) - CENTERJSAMPLE) + \
+			 ONE_HALF + RGB_SHIFT) >> SCALEBITS) - 4096,
+#define CR_G(i)  (- FIX(0.71414)) * ((INT32) (i) - CENTERJSAMPLE),
+/* Cb=>G also has ONE_HALF added in, so the inner loop need not do it */
+#define CB_G(i)  (- FIX(0.34414)) * ((INT32) (i) - CENTERJSAMPLE) + ONE_HALF,
+
+const int LJPEG_jpeg_Cr_r_tab[MAXJSAMPLE+1] = { TBL_SAMPLES(CR_R) };
+const int LJPEG_jpeg_Cb_b_tab[MAXJSAMPLE+1] = { TBL_SAMPLES(CB_B) };
+const INT32 LJPEG_jpeg_Cr_g_tab[MAXJSAMPLE+1] = { TBL_SAMPLES(CR_G) };
+const INT32 LJPEG_jpeg_Cb_g_tab[MAXJSAMPLE+1] = { TBL_SAMPLES(CB_G) };
+
+
 /*
  * Arithmetic utilities
  */